@@ -10,7 +10,7 @@
 #include <memory>
 
 #include "controlblocks/code_tools.h"
-#include "controlblocks/gui.h"
+#include "controlblocks/gui/gui.h"
 
 #include <pybind11/embed.h>
 namespace py = pybind11;
@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "controlblocks/batch_runner.h"
+#include "controlblocks/code_generator.h"
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui_data.h"
+#include "controlblocks/realtime_pacer.h"
+#include "controlblocks/signal_logger.h"
+
+#include <pybind11/embed.h>
+namespace py = pybind11;
+
+static void ConfigurePython()
+{
+    char *pyhome_path = std::getenv("PYTHONHOME");
+
+    if (pyhome_path != nullptr)
+    {
+        // WARNING! According to Py_SetPythonHome(..) this must be static, or
+        // otherwise ensured that out-lives initialized CPython instance!
+        std::string pyhome_str = pyhome_path;
+        static std::wstring pyhome_runtime_wstr(pyhome_str.begin(),
+                                                pyhome_str.end());
+        Py_SetPythonHome(const_cast<wchar_t *>(pyhome_runtime_wstr.data()));
+    }
+}
+
+static void PrintUsage(const char *exe)
+{
+    std::cout << "Usage: " << exe << " <diagram.toml> [options]\n"
+              << "Options:\n"
+              << "  --workspace <file.py>  Python file to run before the sim\n"
+              << "  --tf <seconds>         Final simulation time\n"
+              << "  --dt <seconds>         Timestep\n"
+              << "  --solver <name>        ODE solver (RK4, Cash-Karp54, "
+                 "dopri5,\n"
+              << "                         \"Cash-Karp54 (adaptive)\", "
+                 "\"dopri5 (adaptive)\",\n"
+              << "                         \"Rosenbrock4 (stiff)\")\n"
+              << "  --abs-tol <value>      Absolute tolerance for adaptive "
+                 "solvers\n"
+              << "  --rel-tol <value>      Relative tolerance for adaptive "
+                 "solvers\n"
+              << "  --output <file.csv>    Where to write the logged signals\n"
+              << "  --realtime <factor>    Run at a multiple of real time and "
+                 "report\n"
+              << "                         deadline statistics\n"
+              << "  --cpu <index>          Pin the simulation to a CPU "
+                 "(Linux)\n"
+              << "  --priority <value>     SCHED_FIFO priority for the "
+                 "simulation (Linux)\n"
+              << "  --threads <count>      Threads used to compute the "
+                 "diagram\n"
+              << "  --native               Compile the diagram and switch "
+                 "to it once built\n"
+              << "  --no-fuse              Compute linear blocks one by one "
+                 "instead of fused\n"
+              << "  --no-fold              Compute constant and unobserved "
+                 "blocks every step\n"
+              << "  --no-loop-solve        Leave algebraic loops uncomputed "
+                 "instead of solving\n"
+              << "  --profile <trace.json> Time every block and save a "
+                 "Chrome trace\n"
+              << "  --batch <spec.toml>    Run the diagram once for each set "
+                 "of parameters\n"
+              << "                         in the spec and write a summary "
+                 "of each run\n"
+              << "  --jobs <count>         Batch runs to do at the same time "
+                 "(default: one\n"
+              << "                         per CPU)\n"
+              << "  --generate <model.h>   Write the diagram as standalone "
+                 "C++ instead of\n"
+              << "                         running it\n";
+}
+
+static void PrintProfile(Profiler &profiler)
+{
+    StepProfile step = profiler.GetStepProfile();
+    if (step.steps == 0)
+    {
+        return;
+    }
+    std::cout << "Step: " << step.step_time / step.steps * 1e6
+              << " us mean, " << step.graph_time / step.step_time * 100.0
+              << "% in blocks\n";
+
+    // Slowest blocks first
+    std::vector<BlockProfile> blocks = profiler.GetBlockProfiles();
+    std::sort(blocks.begin(), blocks.end(),
+              [](const BlockProfile &a, const BlockProfile &b)
+              { return a.total > b.total; });
+    for (size_t i = 0; i < blocks.size() && i < 10; ++i)
+    {
+        const BlockProfile &block = blocks[i];
+        std::cout << "  " << block.name << ": " << block.calls << " calls, "
+                  << block.total * 1e3 << " ms total, "
+                  << block.total / std::max<size_t>(block.calls, 1) * 1e6
+                  << " us mean, " << block.max * 1e6 << " us max\n";
+    }
+}
+
+static int RunBatch(const std::string &diagram_file,
+                    const std::string &batch_file, const GuiData &sim_data,
+                    int num_jobs)
+{
+    std::string errors = "";
+    BatchRunner runner;
+    if (!runner.LoadSpec(batch_file, &errors))
+    {
+        std::cerr << errors;
+        return 1;
+    }
+    size_t num_runs = runner.NumRuns();
+    std::cerr << "Running " << num_runs << " simulations on " << num_jobs
+              << " threads" << std::endl;
+
+    // The runs load their diagrams quietly, and progress goes to stderr
+    size_t num_failed = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+    bool is_success = runner.Run(
+        diagram_file, sim_data, num_jobs,
+        [&num_failed, num_runs](const BatchResult &result)
+        {
+            std::cerr << "Run " << result.index + 1 << "/" << num_runs << ": "
+                      << (result.success ? "done" : result.error) << " ("
+                      << result.wall_time << " s)" << std::endl;
+            num_failed += result.success ? 0 : 1;
+        },
+        &errors);
+    auto wall_end = std::chrono::steady_clock::now();
+
+    if (!is_success)
+    {
+        std::cerr << errors;
+        return 1;
+    }
+    std::cout << num_runs - num_failed << " of " << num_runs
+              << " runs succeeded in "
+              << std::chrono::duration<double>(wall_end - wall_start).count()
+              << " s" << std::endl;
+
+    return (num_failed == 0) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Parse the command line
+    std::string diagram_file = argv[1];
+    std::string workspace_file = "";
+    std::string output_file = "signals.csv";
+    double realtime_factor = 0.0;
+    std::string trace_file = "";
+    std::string batch_file = "";
+    std::string generate_file = "";
+    int num_jobs = std::max(1u, std::thread::hardware_concurrency());
+    GuiData sim_data;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--native")
+        {
+            sim_data.native = true;
+            continue;
+        }
+        if (arg == "--no-fuse")
+        {
+            sim_data.fuse_linear = false;
+            continue;
+        }
+        if (arg == "--no-fold")
+        {
+            sim_data.fold_constants = false;
+            continue;
+        }
+        if (arg == "--no-loop-solve")
+        {
+            sim_data.solve_loops = false;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        std::string val = argv[++i];
+        if (arg == "--workspace")
+        {
+            workspace_file = val;
+        }
+        else if (arg == "--tf")
+        {
+            sim_data.sim_time = std::stod(val);
+        }
+        else if (arg == "--dt")
+        {
+            sim_data.dt = std::stod(val);
+        }
+        else if (arg == "--solver")
+        {
+            sim_data.solver = val;
+        }
+        else if (arg == "--abs-tol")
+        {
+            sim_data.abs_tol = std::stod(val);
+        }
+        else if (arg == "--rel-tol")
+        {
+            sim_data.rel_tol = std::stod(val);
+        }
+        else if (arg == "--output")
+        {
+            output_file = val;
+        }
+        else if (arg == "--realtime")
+        {
+            realtime_factor = std::stod(val);
+        }
+        else if (arg == "--cpu")
+        {
+            sim_data.rt_cpu = std::stoi(val);
+        }
+        else if (arg == "--priority")
+        {
+            sim_data.rt_priority = std::stoi(val);
+        }
+        else if (arg == "--threads")
+        {
+            sim_data.sim_threads = std::stoi(val);
+        }
+        else if (arg == "--batch")
+        {
+            batch_file = val;
+        }
+        else if (arg == "--generate")
+        {
+            generate_file = val;
+        }
+        else if (arg == "--jobs")
+        {
+            num_jobs = std::stoi(val);
+        }
+        else if (arg == "--profile")
+        {
+            trace_file = val;
+            sim_data.profile = true;
+        }
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Configure python using environment variables and start the interpreter
+    ConfigurePython();
+    py::scoped_interpreter python;
+
+    // Load the workspace variables
+    if (!workspace_file.empty())
+    {
+        py::object scope = py::module_::import("__main__").attr("__dict__");
+        py::eval_file(workspace_file, scope);
+    }
+
+    if (!batch_file.empty())
+    {
+        return RunBatch(diagram_file, batch_file, sim_data, num_jobs);
+    }
+
+    // Load the diagram
+    Diagram diagram;
+    diagram.LoadDiagram(diagram_file);
+
+    if (!generate_file.empty())
+    {
+        std::string errors = "";
+        CodeGenerator generator;
+        if (!generator.WriteFile(diagram, sim_data, generate_file, &errors))
+        {
+            std::cerr << errors;
+            return 1;
+        }
+        std::cout << "Wrote " << generate_file << std::endl;
+        return 0;
+    }
+
+    // Run the simulation on this thread, either as fast as possible or
+    // locked to the wall clock
+    SignalLogger logger;
+    logger.Init(diagram.GetBlocks());
+
+    std::string errors = "";
+    if (!RealTimePacer::ConfigureThread(sim_data.rt_cpu, sim_data.rt_priority,
+                                        &errors))
+    {
+        std::cerr << errors;
+    }
+
+    bool realtime = (realtime_factor > 0.0);
+    RealTimePacer pacer;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    diagram.Start(sim_data);
+    pacer.Start(sim_data.dt / std::max(realtime_factor, 1e-6));
+    while (diagram.IsRunning())
+    {
+        if (realtime)
+        {
+            pacer.Wait();
+            pacer.BeginStep();
+        }
+
+        diagram.Step(sim_data);
+        logger.Record(diagram.GetTime());
+
+        if (realtime)
+        {
+            pacer.EndStep();
+        }
+    }
+    auto wall_end = std::chrono::steady_clock::now();
+    double wall_time =
+        std::chrono::duration<double>(wall_end - wall_start).count();
+
+    std::cout << "Simulated " << diagram.GetTime() << " s in " << wall_time
+              << " s (" << logger.NumSamples() << " steps)" << std::endl;
+
+    if (realtime)
+    {
+        RealTimeStats stats = pacer.GetStats();
+        std::cout << "Missed deadlines: " << stats.missed_deadlines << " of "
+                  << stats.steps << "\n"
+                  << "Latency (ms): mean " << stats.mean_latency * 1000.0
+                  << ", max " << stats.max_latency * 1000.0 << "\n"
+                  << "Wake-up (ms): mean " << stats.mean_wakeup * 1000.0
+                  << ", max " << stats.max_wakeup * 1000.0 << ", jitter "
+                  << stats.jitter * 1000.0 << std::endl;
+    }
+
+    if (sim_data.profile)
+    {
+        PrintProfile(diagram.GetProfiler());
+        if (!diagram.GetProfiler().WriteChromeTrace(trace_file))
+        {
+            std::cerr << "Could not write " << trace_file << std::endl;
+        }
+    }
+
+    // Save the results
+    if (!logger.WriteCsv(output_file))
+    {
+        std::cerr << "Could not write " << output_file << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
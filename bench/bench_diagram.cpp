@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui_data.h"
+#include "diagram_generator.h"
+
+using BenchUtils::DiagramShape;
+
+/**
+ * @brief Reaches into the diagram for the internals that only the simulation
+ * calls.
+ *
+ */
+class DiagramBenchmark
+{
+public:
+    static void ComputeGraph(Diagram &diagram, double t)
+    {
+        diagram.ComputeGraph(t);
+    }
+
+    // Evaluate the whole diagram like the first evaluation of a step. With
+    // the cache of the last evaluation kept, the same x and t would compute
+    // nothing.
+    static void Dynamics(Diagram &diagram, double t)
+    {
+        diagram.eval_valid_ = false;
+        diagram.Dynamics(diagram.diagram_x_, diagram.diagram_dx_, t);
+    }
+};
+
+// Start a run that won't reach its final time during the benchmark. Unless
+// optimized, every block is computed as it is in the diagram, without folding
+// constants, pruning, fusing linear blocks or solving loops.
+static void StartDiagram(Diagram &diagram, const std::string &solver,
+                         bool optimized = false)
+{
+    GuiData gui_data;
+    gui_data.solver = solver;
+    gui_data.dt = 0.01;
+    gui_data.sim_time = 1e12;
+    gui_data.fold_constants = optimized;
+    gui_data.fuse_linear = optimized;
+    gui_data.solve_loops = optimized;
+
+    BenchUtils::QuietOutput quiet;
+    diagram.Start(gui_data);
+}
+
+static void BM_ComputeGraph(benchmark::State &state, DiagramShape shape,
+                            bool optimized)
+{
+    Diagram diagram;
+    BenchUtils::GenerateDiagram(diagram, shape, state.range(0));
+    StartDiagram(diagram, "RK4", optimized);
+
+    for (auto _ : state)
+    {
+        DiagramBenchmark::ComputeGraph(diagram, 0.0);
+    }
+    state.SetComplexityN(diagram.GetBlocks().size());
+    state.counters["blocks"] = diagram.GetBlocks().size();
+}
+
+static void BM_Dynamics(benchmark::State &state, DiagramShape shape)
+{
+    Diagram diagram;
+    BenchUtils::GenerateDiagram(diagram, shape, state.range(0));
+    StartDiagram(diagram, "RK4");
+
+    for (auto _ : state)
+    {
+        DiagramBenchmark::Dynamics(diagram, 0.0);
+    }
+    state.SetComplexityN(diagram.GetBlocks().size());
+    state.counters["blocks"] = diagram.GetBlocks().size();
+}
+
+static void BM_Step(benchmark::State &state, std::string solver,
+                    bool optimized)
+{
+    Diagram diagram;
+    BenchUtils::GenerateDiagram(diagram, DiagramShape::FEEDBACK,
+                                state.range(0));
+    StartDiagram(diagram, solver, optimized);
+
+    GuiData gui_data;
+    gui_data.solver = solver;
+    for (auto _ : state)
+    {
+        diagram.Step(gui_data);
+    }
+    state.SetComplexityN(diagram.GetBlocks().size());
+    state.counters["blocks"] = diagram.GetBlocks().size();
+}
+
+static void BM_SaveDiagram(benchmark::State &state, DiagramShape shape)
+{
+    Diagram diagram;
+    BenchUtils::GenerateDiagram(diagram, shape, state.range(0));
+    std::string filename =
+        (std::filesystem::temp_directory_path() / "controlblocks_bench.toml")
+            .string();
+
+    for (auto _ : state)
+    {
+        diagram.SaveDiagram(filename);
+    }
+    std::remove(filename.c_str());
+    state.SetComplexityN(diagram.GetBlocks().size());
+}
+
+static void BM_LoadDiagram(benchmark::State &state, DiagramShape shape)
+{
+    std::string filename =
+        (std::filesystem::temp_directory_path() / "controlblocks_bench.toml")
+            .string();
+    size_t num_blocks = 0;
+    {
+        Diagram diagram;
+        BenchUtils::GenerateDiagram(diagram, shape, state.range(0));
+        diagram.SaveDiagram(filename);
+        num_blocks = diagram.GetBlocks().size();
+    }
+
+    for (auto _ : state)
+    {
+        Diagram diagram;
+        BenchUtils::QuietOutput quiet;
+        diagram.LoadDiagram(filename);
+    }
+    std::remove(filename.c_str());
+    state.SetComplexityN(num_blocks);
+}
+
+// Disconnect and reconnect the last wire of a chain, which is the worst case
+// for looking up the wire by ID.
+static void BM_AddRemoveWire(benchmark::State &state)
+{
+    Diagram diagram;
+    BenchUtils::GenerateDiagram(diagram, DiagramShape::CHAIN, state.range(0));
+
+    BenchUtils::QuietOutput quiet;
+    for (auto _ : state)
+    {
+        std::shared_ptr<ControlBlock::Wire> wire = diagram.GetWires().back();
+        int from = wire->GetFromId();
+        int to = wire->GetToId();
+        diagram.RemoveWire(wire->GetId());
+        diagram.AddWire(from, to);
+    }
+    state.SetComplexityN(diagram.GetBlocks().size());
+}
+
+// Diagram sizes from 10 to 10,000 blocks
+#define DIAGRAM_SIZES RangeMultiplier(10)->Range(10, 10000)->Complexity()
+
+BENCHMARK_CAPTURE(BM_ComputeGraph, chain, DiagramShape::CHAIN, false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_ComputeGraph, fan_out, DiagramShape::FAN_OUT, false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_ComputeGraph, mux_tree, DiagramShape::MUX_TREE, false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_ComputeGraph, state_space, DiagramShape::STATE_SPACE,
+                  false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_ComputeGraph, feedback, DiagramShape::FEEDBACK, false)
+    ->DIAGRAM_SIZES;
+
+// The same graphs with constants folded and linear blocks fused
+BENCHMARK_CAPTURE(BM_ComputeGraph, chain_optimized, DiagramShape::CHAIN, true)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_ComputeGraph, feedback_optimized, DiagramShape::FEEDBACK,
+                  true)
+    ->DIAGRAM_SIZES;
+
+BENCHMARK_CAPTURE(BM_Dynamics, state_space, DiagramShape::STATE_SPACE)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Dynamics, feedback, DiagramShape::FEEDBACK)
+    ->DIAGRAM_SIZES;
+
+BENCHMARK_CAPTURE(BM_Step, rk4, std::string("RK4"), false)->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Step, cash_karp54, std::string("Cash-Karp54"), false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Step, dopri5, std::string("dopri5"), false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Step, cash_karp54_adaptive,
+                  std::string("Cash-Karp54 (adaptive)"), false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Step, dopri5_adaptive, std::string("dopri5 (adaptive)"),
+                  false)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_Step, rk4_optimized, std::string("RK4"), true)
+    ->DIAGRAM_SIZES;
+
+// The Jacobian is dense, so the stiff solver stops at 1,000 blocks
+BENCHMARK_CAPTURE(BM_Step, rosenbrock4, std::string("Rosenbrock4 (stiff)"),
+                  false)
+    ->RangeMultiplier(10)
+    ->Range(10, 1000)
+    ->Complexity();
+
+BENCHMARK_CAPTURE(BM_SaveDiagram, feedback, DiagramShape::FEEDBACK)
+    ->DIAGRAM_SIZES;
+BENCHMARK_CAPTURE(BM_LoadDiagram, feedback, DiagramShape::FEEDBACK)
+    ->DIAGRAM_SIZES;
+
+BENCHMARK(BM_AddRemoveWire)->DIAGRAM_SIZES;
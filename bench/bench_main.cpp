@@ -0,0 +1,25 @@
+#include <benchmark/benchmark.h>
+
+#include <pybind11/embed.h>
+
+#include "diagram_generator.h"
+
+namespace py = pybind11;
+
+// The state space blocks read their matrices from the Python workspace, so
+// the interpreter has to outlive every benchmark.
+int main(int argc, char **argv)
+{
+    py::scoped_interpreter guard{};
+    BenchUtils::DefineWorkspace();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <benchmark/benchmark.h>
+
+#include "controlblocks/state_space.h"
+#include "controlblocks/vector_utils.h"
+
+// Stack one three element vector per block, as a Mux tree of that many
+// inputs would.
+static void BM_StackVectors(benchmark::State &state)
+{
+    std::vector<Eigen::VectorXd> vectors(state.range(0),
+                                         Eigen::VectorXd::Ones(3));
+    for (auto _ : state)
+    {
+        Eigen::VectorXd stacked = ControlUtils::StackVectors(vectors);
+        benchmark::DoNotOptimize(stacked.data());
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+// Derivative of a system with as many states as the range and a quarter as
+// many inputs
+static void BM_StateSpaceUpdateDynamics(benchmark::State &state)
+{
+    int num_states = state.range(0);
+    int num_inputs = std::max(1, num_states / 4);
+
+    ControlUtils::StateSpace ss(
+        Eigen::MatrixXd::Random(num_states, num_states),
+        Eigen::MatrixXd::Random(num_states, num_inputs),
+        Eigen::MatrixXd::Random(1, num_states),
+        Eigen::MatrixXd::Zero(1, num_inputs));
+    ss.CheckDimensions(num_inputs);
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(num_states);
+    Eigen::VectorXd u = Eigen::VectorXd::Random(num_inputs);
+    Eigen::VectorXd dx(num_states);
+    for (auto _ : state)
+    {
+        ss.UpdateDynamics(x, u, dx);
+        benchmark::DoNotOptimize(dx.data());
+    }
+    state.SetComplexityN(num_states);
+}
+
+BENCHMARK(BM_StackVectors)->RangeMultiplier(10)->Range(10, 10000)->Complexity();
+BENCHMARK(BM_StateSpaceUpdateDynamics)
+    ->RangeMultiplier(4)
+    ->Range(2, 512)
+    ->Complexity();
@@ -0,0 +1,181 @@
+#include "diagram_generator.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "controlblocks/python_utils.h"
+
+namespace py = pybind11;
+
+namespace BenchUtils
+{
+    // Connect an output port of one block to an input port of another
+    static void Connect(Diagram &diagram,
+                        std::shared_ptr<ControlBlock::Block> from, int output,
+                        std::shared_ptr<ControlBlock::Block> to, int input)
+    {
+        diagram.AddWire(from->GetOutputPortId(output),
+                        to->GetInputPortId(input));
+    }
+
+    static std::shared_ptr<ControlBlock::StateSpaceBlock>
+    AddStateSpace(Diagram &diagram)
+    {
+        std::shared_ptr<ControlBlock::StateSpaceBlock> ss =
+            diagram.AddBlock<ControlBlock::StateSpaceBlock>();
+        ss->SetMatrixNames({"bench_A", "bench_B", "bench_C", "bench_D"});
+        return ss;
+    }
+
+    // The step response of a state space block, so the signals fed by it
+    // change over time and can't be folded away as constants
+    static std::shared_ptr<ControlBlock::Block> AddSource(Diagram &diagram)
+    {
+        std::shared_ptr<ControlBlock::ConstantBlock> step =
+            diagram.AddBlock<ControlBlock::ConstantBlock>();
+        step->SetValue(1.0);
+        std::shared_ptr<ControlBlock::StateSpaceBlock> source =
+            AddStateSpace(diagram);
+        Connect(diagram, step, 0, source, 0);
+        return source;
+    }
+
+    static void GenerateChain(Diagram &diagram, int num_blocks)
+    {
+        std::shared_ptr<ControlBlock::Block> prev = AddSource(diagram);
+        for (int i = 0; i < num_blocks - 3; ++i)
+        {
+            std::shared_ptr<ControlBlock::GainBlock> gain =
+                diagram.AddBlock<ControlBlock::GainBlock>();
+            gain->SetGain(1.0);
+            Connect(diagram, prev, 0, gain, 0);
+            prev = gain;
+        }
+        Connect(diagram, prev, 0,
+                diagram.AddBlock<ControlBlock::DisplayBlock>(), 0);
+    }
+
+    static void GenerateFanOut(Diagram &diagram, int num_blocks)
+    {
+        std::shared_ptr<ControlBlock::Block> source = AddSource(diagram);
+        for (int i = 0; i < std::max(1, (num_blocks - 2) / 2); ++i)
+        {
+            std::shared_ptr<ControlBlock::GainBlock> gain =
+                diagram.AddBlock<ControlBlock::GainBlock>();
+            gain->SetGain(2.0);
+            Connect(diagram, source, 0, gain, 0);
+            Connect(diagram, gain, 0,
+                    diagram.AddBlock<ControlBlock::DisplayBlock>(), 0);
+        }
+    }
+
+    static void GenerateMuxTree(Diagram &diagram, int num_blocks)
+    {
+        // A tree with n leaves has n - 1 muxes. Each leaf scales the source.
+        std::shared_ptr<ControlBlock::Block> source = AddSource(diagram);
+        std::vector<std::shared_ptr<ControlBlock::Block>> level;
+        for (int i = 0; i < std::max(2, (num_blocks - 1) / 2); ++i)
+        {
+            std::shared_ptr<ControlBlock::GainBlock> leaf =
+                diagram.AddBlock<ControlBlock::GainBlock>();
+            leaf->SetGain(static_cast<double>(i));
+            Connect(diagram, source, 0, leaf, 0);
+            level.push_back(leaf);
+        }
+
+        // Stack pairs of signals until one is left. An odd one out moves up
+        // to the next level as it is.
+        while (level.size() > 1)
+        {
+            std::vector<std::shared_ptr<ControlBlock::Block>> next;
+            for (size_t i = 0; i + 1 < level.size(); i += 2)
+            {
+                std::shared_ptr<ControlBlock::MuxBlock> mux =
+                    diagram.AddBlock<ControlBlock::MuxBlock>();
+                Connect(diagram, level[i], 0, mux, 0);
+                Connect(diagram, level[i + 1], 0, mux, 1);
+                next.push_back(mux);
+            }
+            if (level.size() % 2 == 1)
+            {
+                next.push_back(level.back());
+            }
+            level = next;
+        }
+    }
+
+    static void GenerateStateSpace(Diagram &diagram, int num_blocks)
+    {
+        std::shared_ptr<ControlBlock::ConstantBlock> source =
+            diagram.AddBlock<ControlBlock::ConstantBlock>();
+        source->SetValue(1.0);
+        for (int i = 0; i < std::max(1, num_blocks - 1); ++i)
+        {
+            Connect(diagram, source, 0, AddStateSpace(diagram), 0);
+        }
+    }
+
+    static void GenerateFeedback(Diagram &diagram, int num_blocks)
+    {
+        // Each loop is r -> sum -> plant -> -1 back into the sum
+        for (int i = 0; i < std::max(1, num_blocks / 4); ++i)
+        {
+            std::shared_ptr<ControlBlock::ConstantBlock> reference =
+                diagram.AddBlock<ControlBlock::ConstantBlock>();
+            reference->SetValue(1.0);
+            std::shared_ptr<ControlBlock::SumBlock> sum =
+                diagram.AddBlock<ControlBlock::SumBlock>();
+            std::shared_ptr<ControlBlock::StateSpaceBlock> plant =
+                AddStateSpace(diagram);
+            std::shared_ptr<ControlBlock::GainBlock> feedback =
+                diagram.AddBlock<ControlBlock::GainBlock>();
+            feedback->SetGain(-1.0);
+
+            Connect(diagram, reference, 0, sum, 0);
+            Connect(diagram, sum, 0, plant, 0);
+            Connect(diagram, plant, 0, feedback, 0);
+            Connect(diagram, feedback, 0, sum, 1);
+        }
+    }
+
+    void DefineWorkspace()
+    {
+        Eigen::MatrixXd A(2, 2);
+        A << 0.0, 1.0, -4.0, -0.8;
+        Eigen::MatrixXd B(2, 1);
+        B << 0.0, 1.0;
+        Eigen::MatrixXd C(1, 2);
+        C << 4.0, 0.0;
+        Eigen::MatrixXd D = Eigen::MatrixXd::Zero(1, 1);
+
+        py::dict global_vars = py::globals();
+        global_vars["bench_A"] = A;
+        global_vars["bench_B"] = B;
+        global_vars["bench_C"] = C;
+        global_vars["bench_D"] = D;
+    }
+
+    void GenerateDiagram(Diagram &diagram, DiagramShape shape, int num_blocks)
+    {
+        QuietOutput quiet;
+        switch (shape)
+        {
+        case DiagramShape::CHAIN:
+            GenerateChain(diagram, num_blocks);
+            break;
+        case DiagramShape::FAN_OUT:
+            GenerateFanOut(diagram, num_blocks);
+            break;
+        case DiagramShape::MUX_TREE:
+            GenerateMuxTree(diagram, num_blocks);
+            break;
+        case DiagramShape::STATE_SPACE:
+            GenerateStateSpace(diagram, num_blocks);
+            break;
+        case DiagramShape::FEEDBACK:
+            GenerateFeedback(diagram, num_blocks);
+            break;
+        }
+    }
+} // namespace BenchUtils
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "controlblocks/diagram.h"
+
+namespace BenchUtils
+{
+    /**
+     * @brief Layouts of the generated diagrams. The source is the step
+     * response of a state space block, so its signals change over time.
+     *
+     * CHAIN: a source through a line of gains into a display
+     * FAN_OUT: one source driving many gain and display pairs
+     * MUX_TREE: gains of one source stacked by a binary tree of muxes
+     * STATE_SPACE: one constant driving many state space blocks
+     * FEEDBACK: many sum, state space and gain loops
+     */
+    enum class DiagramShape
+    {
+        CHAIN,
+        FAN_OUT,
+        MUX_TREE,
+        STATE_SPACE,
+        FEEDBACK
+    };
+
+    /**
+     * @brief Define the matrices used by the generated state space blocks in
+     * the Python workspace, a damped second order system with one input and
+     * one output. The interpreter must already be running.
+     *
+     */
+    void DefineWorkspace();
+
+    /**
+     * @brief Fill an empty diagram with about the given number of blocks in
+     * the given shape. The shapes are built from repeating groups, so the
+     * block count is rounded to a whole number of groups.
+     *
+     * @param diagram Diagram to add the blocks to
+     * @param shape Layout of the blocks
+     * @param num_blocks Number of blocks to aim for
+     */
+    void GenerateDiagram(Diagram &diagram, DiagramShape shape, int num_blocks);
+
+    /**
+     * @brief Silence std::cout while in scope, since the diagram reports every
+     * wire it connects. Without a buffer the stream drops everything, and
+     * restoring the buffer clears the error state.
+     *
+     */
+    class QuietOutput
+    {
+    public:
+        QuietOutput() : old_buf_(std::cout.rdbuf(nullptr)) {}
+        ~QuietOutput() { std::cout.rdbuf(old_buf_); }
+
+    private:
+        std::streambuf *old_buf_;
+    };
+} // namespace BenchUtils
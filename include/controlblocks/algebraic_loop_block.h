@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controlblocks/block.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief A loop of blocks without state, which the diagram computes in
+     * their place. Every block in such a loop waits on another, so the loop
+     * is cut at a few signals, the tear variables, and the blocks are
+     * computed in order from a guess of them. Newton's method then adjusts
+     * the guess until the blocks give back the same values.
+     *
+     * Each evaluation starts from the previous solution and reuses the
+     * Newton Jacobian while it keeps converging, so a linear loop usually
+     * costs two passes over its blocks. The Jacobian is found by finite
+     * differences, with one more pass for each tear variable.
+     *
+     * Like FusedLinearBlock, the block doesn't have ports of its own. Its
+     * inputs are the members' input ports driven from outside the loop and
+     * its outputs are every member's output ports.
+     *
+     */
+    class AlgebraicLoopBlock : public Block
+    {
+    public:
+        AlgebraicLoopBlock(Diagram &diagram)
+            : Block(diagram), tolerance_(1e-10), max_iterations_(50),
+              has_jacobian_(false), warned_(false), t_(0.0)
+        {
+        }
+
+        /**
+         * @brief Take over a loop and pick where to tear it.
+         *
+         * @param members Blocks in the loop, none of which are dynamical
+         * systems
+         */
+        void SetMembers(const std::vector<std::shared_ptr<Block>> &members);
+
+        const std::vector<std::shared_ptr<Block>> &GetMembers();
+
+        // Overriden Block functions
+        void Compute(double t) override;
+        void InferSizes() override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool IsFoldable() override;
+
+    private:
+        // Members in the order they are computed once the loop is torn
+        std::vector<std::shared_ptr<Block>> members_;
+
+        // Outputs whose values are guessed, and the guess stacked
+        std::vector<std::shared_ptr<Port>> tears_;
+        Eigen::VectorXd z_;
+        Eigen::VectorXd g_;
+        Eigen::VectorXd r_;
+
+        // Jacobian of the residual g(z) - z, factored, and the guess and
+        // values used to difference it
+        Eigen::MatrixXd jacobian_;
+        Eigen::FullPivLU<Eigen::MatrixXd> lu_;
+        Eigen::VectorXd z_step_;
+        Eigen::VectorXd g_step_;
+
+        double tolerance_;
+        int max_iterations_;
+        bool has_jacobian_;
+        bool warned_;
+
+        // Time of the last evaluation
+        double t_;
+
+        // Compute the members with the tear variables set to z, and store
+        // what the members give back for them in g
+        void Evaluate(double t, const Eigen::VectorXd &z, Eigen::VectorXd &g);
+
+        // Difference the residual around z_, whose values are in g_, and
+        // leave the members evaluated at z_. Returns false if the Jacobian
+        // is singular.
+        bool UpdateJacobian(double t);
+
+        bool IsConverged();
+    };
+
+} // namespace ControlBlock
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <toml++/toml.h>
+
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui_data.h"
+
+/**
+ * @brief A parameter varied across a batch. It either belongs to a block,
+ * found by name or ID, or is a workspace variable. Its value is taken from a
+ * list in turn, or drawn at random for each run.
+ *
+ */
+typedef struct batch_parameter_t
+{
+    // Block name or ID, or empty for a workspace variable
+    std::string block;
+    std::string name;
+
+    // Values to try, for a grid
+    std::vector<Eigen::MatrixXd> values;
+
+    // Or a distribution: "uniform" between a and b, or "normal" with mean a
+    // and standard deviation b
+    std::string distribution;
+    double a;
+    double b;
+} BatchParameter;
+
+/**
+ * @brief Outcome of one run of a batch. Times are in seconds.
+ *
+ */
+typedef struct batch_result_t
+{
+    size_t index;
+    bool success;
+    std::string error;
+
+    // Value of each parameter, in the order they were added
+    std::vector<Eigen::MatrixXd> values;
+
+    size_t steps;
+    double sim_time;
+    double wall_time;
+
+    // Final value of each display block
+    std::vector<Eigen::VectorXd> displays;
+} BatchResult;
+
+/**
+ * @brief Runs one diagram many times with different parameters, spread over
+ * a pool of threads. Every run loads its own copy of the diagram, and the
+ * Python workspace is copied into each copy up front, so runs only touch
+ * Python while they start. Summaries are written as each run finishes, and
+ * each run's signals can be saved as well.
+ *
+ */
+class BatchRunner
+{
+public:
+    BatchRunner();
+    ~BatchRunner() {}
+
+    /**
+     * @brief Read the parameters and output settings from a TOML file.
+     *
+     * @param filename Specification file
+     * @param errors Description of anything that could not be read
+     * @return true if the file was read
+     */
+    bool LoadSpec(const std::string &filename, std::string *errors);
+
+    void AddParameter(const BatchParameter &param);
+
+    // Runs for each point of the grid, for sampling the distributions
+    void SetSamples(size_t samples);
+
+    /**
+     * @brief Simulate groups of runs together as the lanes of an ensemble
+     * (see Diagram::StartEnsemble()). Only block parameters that are scalars
+     * or vectors can vary between runs, and traces aren't saved.
+     *
+     * @param lanes Runs in each ensemble, or 1 to run them separately
+     */
+    void SetLanes(size_t lanes);
+
+    void SetSeed(uint64_t seed);
+
+    // Where to write the summaries, and a directory for each run's signals.
+    // Leave empty to skip.
+    void SetSummaryFile(const std::string &filename);
+    void SetTraceDirectory(const std::string &directory);
+
+    // Number of runs the parameters describe
+    size_t NumRuns();
+
+    /**
+     * @brief Run every combination of the parameters. Needs the Python
+     * interpreter, held by the calling thread.
+     *
+     * @param diagram_file Diagram to run
+     * @param sim_data Timing and solver settings for every run
+     * @param num_threads Runs to do at the same time
+     * @param on_result Called as each run finishes, one at a time. Can be
+     * empty.
+     * @param errors Description of anything that stopped the batch
+     * @return true if the batch ran. Individual runs may still have failed.
+     */
+    bool Run(const std::string &diagram_file, const GuiData &sim_data,
+             int num_threads,
+             const std::function<void(const BatchResult &)> &on_result,
+             std::string *errors);
+
+private:
+    std::vector<BatchParameter> params_;
+    size_t samples_;
+    size_t lanes_;
+    uint64_t seed_;
+    std::string summary_file_;
+    std::string trace_dir_;
+
+    // Summary output, shared by the runs
+    std::mutex output_mutex_;
+    std::ofstream summary_;
+
+    // Choose the parameter values of every run
+    std::vector<std::vector<Eigen::MatrixXd>> GenerateRuns();
+
+    void RunOne(const std::string &diagram_file, const GuiData &sim_data,
+                const std::unordered_map<std::string, Eigen::MatrixXd>
+                    &workspace,
+                BatchResult &result);
+
+    // Run a group of runs as the lanes of one ensemble
+    void RunLanes(const std::string &diagram_file, const GuiData &sim_data,
+                  const std::unordered_map<std::string, Eigen::MatrixXd>
+                      &workspace,
+                  std::vector<BatchResult> &results);
+
+    bool ApplyParameters(Diagram &diagram,
+                         const std::vector<Eigen::MatrixXd> &values,
+                         std::string *errors);
+
+    void WriteSummaryHeader(Diagram &diagram);
+    void WriteSummary(const BatchResult &result);
+
+    static bool ParseValue(const toml::node &node, Eigen::MatrixXd *value);
+};
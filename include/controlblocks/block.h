@@ -6,25 +6,47 @@
 #include <string>
 #include <vector>
 
-#include "imgui.h"
-#include "imnodes.h"
 #include "toml++/toml.h"
 #include <Eigen/Dense>
 
 #include "controlblocks/code_tools.h"
 #include "controlblocks/port.h"
 #include "controlblocks/serializable.h"
+#include "controlblocks/state_space.h"
 
+class CodeGenerator;
 class Diagram;
 class Workspace;
 
 namespace ControlBlock
 {
+    /**
+     * @brief When a block is computed. Continuous blocks are computed on
+     * every evaluation of the diagram, and discrete blocks every period
+     * seconds from offset, holding their outputs in between.
+     *
+     */
+    typedef struct sample_time_t
+    {
+        // Seconds between samples. Zero for continuous blocks, and negative
+        // for blocks that take the sample time of their inputs.
+        double period;
+
+        // Time of the first sample
+        double offset;
+    } SampleTime;
+
     class Block : public Serializable
     {
 
     public:
-        Block(Diagram &diagram) : diagram_(diagram) {}
+        Block(Diagram &diagram)
+            : diagram_(diagram), x_pos_(0.0), y_pos_(0.0), x_view_(nullptr),
+              dx_view_(nullptr), x_lanes_view_(nullptr),
+              dx_lanes_view_(nullptr), lane_stride_(0), num_lanes_(0),
+              sample_time_{-1.0, 0.0}
+        {
+        }
         ~Block() {}
 
         void Init(std::string block_name, std::vector<std::string> input_names,
@@ -34,15 +56,185 @@ namespace ControlBlock
         void Broadcast();
         virtual bool ApplyInitial();
         virtual void Compute(double t);
-        virtual void Render();
-        virtual void Settings();
+
+        /**
+         * @brief Compute the outputs of a dynamical system without direct
+         * feedthrough, which only depend on its states. The diagram calls
+         * this ahead of the blocks that read the outputs, and Compute() once
+         * the block's inputs are ready. By default the whole block is
+         * computed.
+         *
+         * @param t Current time
+         */
+        virtual void ComputeOutput(double t);
+
+        /**
+         * @brief Set the width of each output from the widths of the inputs.
+         * This runs once when the simulation starts, in execution order, so
+         * blocks can size their buffers and skip shape checks in Compute().
+         * Throws std::runtime_error if the input widths are not compatible.
+         */
+        virtual void InferSizes();
+
+        /**
+         * @brief Write the Jacobian of each output with respect to the
+         * diagram state from the Jacobians of the inputs, and for dynamical
+         * systems the block's rows of the diagram Jacobian. Blocks that can't
+         * supply one analytically return false, and the stiff solver falls
+         * back to finite differences.
+         *
+         * @param state_offset Where the block's states start in the diagram
+         * state
+         * @param dfdx The block's rows of the diagram Jacobian. Empty for
+         * blocks without states.
+         * @return true if the Jacobian was computed
+         */
+        virtual bool ComputeJacobian(int state_offset,
+                                     Eigen::Ref<Eigen::MatrixXd> dfdx);
+
+        /**
+         * @brief Describe the block as a linear time invariant system, with
+         * the inputs stacked in port order as u, the outputs stacked as y
+         * and the block's own states as x. Blocks with no states only have a
+         * D matrix. The diagram fuses connected linear blocks into one
+         * system when the simulation starts. This runs after InferSizes(),
+         * and blocks that aren't linear return false.
+         *
+         * @param ss Where to store the system
+         * @return true if the block is linear time invariant
+         */
+        virtual bool GetLinearSystem(ControlUtils::StateSpace *ss);
+
+        /**
+         * @brief If the block's outputs only depend on its current inputs,
+         * and not on time or any state. When all of its inputs are
+         * constant, such a block is computed once when the simulation
+         * starts rather than on every evaluation.
+         */
+        virtual bool IsFoldable();
+
+        /**
+         * @brief If the block's states are advanced in discrete steps rather
+         * than by the ODE solver. Discrete blocks are only computed at
+         * sample times, and their outputs are held in between. Without a
+         * period of their own they are sampled once per step.
+         */
+        virtual bool IsDiscrete();
+
+        /**
+         * @brief Set when the block is computed. Blocks inherit the sample
+         * time of their inputs by default, so blocks that only read one
+         * discrete rate run at that rate.
+         *
+         * @param period Seconds between samples, zero to compute the block
+         * on every evaluation, or negative to inherit
+         * @param offset Time of the first sample
+         */
+        void SetSampleTime(double period, double offset = 0.0);
+        SampleTime GetSampleTime();
+
+        /**
+         * @brief If any output depends on the current inputs. Dynamical
+         * systems whose outputs only depend on their states return false,
+         * so loops through them are evaluated with the outputs at the
+         * current state rather than those of the previous evaluation.
+         */
+        virtual bool HasDirectFeedthrough();
+
+        /**
+         * @brief Advance the discrete states to the next sample. The diagram
+         * calls this once per step, right after computing every block at the
+         * sample time t.
+         *
+         * @param t Current sample time
+         * @param dt Time until the next sample
+         */
+        virtual void Update(double t, double dt);
+
+        /**
+         * @brief Compute every lane of an ensemble run at once. Inputs and
+         * outputs have one column per lane, and dynamical systems read and
+         * write their rows of the lane states. Blocks that can't do this
+         * return false, and the ensemble won't start.
+         *
+         * @param t Current time
+         * @return true if the lanes were computed
+         */
+        virtual bool ComputeLanes(double t);
+
+        /**
+         * @brief Compute the output lanes of a system without direct
+         * feedthrough, like ComputeOutput(). By default all of the lanes are
+         * computed.
+         *
+         * @param t Current time
+         * @return true if the lanes were computed
+         */
+        virtual bool ComputeOutputLanes(double t);
+
+        /**
+         * @brief Write the block's math as C++ through the code generator,
+         * using fixed-size Eigen types for its signals, states and
+         * parameters. This runs after the simulation has started, so sizes
+         * and workspace variables are resolved. Blocks that can't be
+         * generated return false.
+         *
+         * @param gen Code generator, which names everything the block uses
+         * @return true if the block's code was generated
+         */
+        virtual bool GenerateCode(CodeGenerator &gen);
+
+        /**
+         * @brief Set a parameter by name, for tools that run the same diagram
+         * with different settings. Every block accepts "x0", which is passed
+         * to SetInitial(). Scalars are 1x1 and vectors are one column. For
+         * ensemble runs, a value with one column per lane sets each lane.
+         *
+         * @param name Parameter to set
+         * @param value New value
+         * @return false if the block has no such parameter or the value is
+         * the wrong shape
+         */
+        virtual bool SetParameter(const std::string &name,
+                                  const Eigen::MatrixXd &value);
+
+        /**
+         * @brief Get the names of the workspace variables the block reads
+         * when the simulation starts.
+         *
+         */
+        virtual std::vector<std::string> GetWorkspaceNames();
 
         // Dynamics
         virtual void SetInitial(Eigen::VectorXd x0);
-        virtual bool GetDx(Eigen::VectorXd *dx);
-        void SetState(Eigen::VectorXd x);
+        Eigen::VectorXd GetState();
         int NumStates();
 
+        /**
+         * @brief Point the block's state and derivative at its segment of the
+         * diagram's state vector. The diagram does this before every
+         * evaluation so no states are copied in or out of the blocks.
+         *
+         * @param x First element of this block's state
+         * @param dx First element of this block's derivative
+         */
+        void BindState(const double *x, double *dx);
+
+        /**
+         * @brief Point the block at its rows of the ensemble state and
+         * derivative, which have one column per lane.
+         *
+         * @param x First element of this block's state in the first lane
+         * @param dx First element of this block's derivative in the first lane
+         * @param stride Distance between lanes, the total number of states
+         * @param num_lanes Number of lanes
+         */
+        void BindLanes(const double *x, double *dx, int stride, int num_lanes);
+
+        // Initial state of each lane, or empty to start every lane from the
+        // block's initial state
+        const Eigen::MatrixXd &GetInitialLanes();
+
         // Serialization
         toml::table Serialize() override;
         void Deserialize(toml::table data) override;
@@ -53,8 +245,13 @@ namespace ControlBlock
         // Block characteristics
         int GetId();
         std::string GetName();
+        void SetName(const std::string &name);
         bool IsDynamicalSystem();
-        void SetPosition(const ImVec2 pos);
+
+        // Node position on the diagram canvas (grid space)
+        void SetPosition(float x, float y);
+        float GetX();
+        float GetY();
 
         // Ports
         int NumInputPorts();
@@ -69,11 +266,20 @@ namespace ControlBlock
 
         void RemoveConnectedPort(std::shared_ptr<Port> port);
 
-        // Inputs
-        Eigen::VectorXd GetInput(int port_id);
+        // Inputs, by the index of the port in the block
+        const Eigen::VectorXd &GetInput(int index);
 
-        // Outputs
-        void SetOutput(int port_id, Eigen::VectorXd val);
+        // Outputs, by the index of the port in the block
+        void SetOutput(int index, const Eigen::VectorXd &val);
+        Eigen::VectorXd &GetOutputBuffer(int index);
+
+        // Jacobians of the inputs and outputs, by the index of the port
+        const Eigen::MatrixXd &GetInputJacobian(int index);
+        Eigen::MatrixXd &GetOutputJacobian(int index);
+
+        // Ensemble lanes of the inputs and outputs, by the index of the port
+        const Eigen::MatrixXd &GetInputLanes(int index);
+        Eigen::MatrixXd &GetOutputLanes(int index);
 
     protected:
         // Block characteristics
@@ -81,15 +287,40 @@ namespace ControlBlock
         std::string name_;
         bool dynamic_sys_;
 
+        // Canvas position
+        float x_pos_;
+        float y_pos_;
+
         // Diagram membership
         Diagram &diagram_;
 
         // Timing
         double prev_compute_t_;
+        SampleTime sample_time_;
 
-        // Internal state
+        // Initial state. Its size is the number of states in the block.
         Eigen::VectorXd x_;
-        Eigen::VectorXd dx_;
+
+        // Segments of the diagram state and derivative bound by the diagram
+        const double *x_view_;
+        double *dx_view_;
+
+        // Views of the bound state and derivative, or of x_ if unbound
+        Eigen::Map<const Eigen::VectorXd> StateView();
+        Eigen::Map<Eigen::VectorXd> DerivativeView();
+
+        // Rows of the ensemble state and derivative bound by the diagram
+        typedef Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<>>
+            ConstLanesView;
+        typedef Eigen::Map<Eigen::MatrixXd, 0, Eigen::OuterStride<>>
+            LanesView;
+        const double *x_lanes_view_;
+        double *dx_lanes_view_;
+        int lane_stride_;
+        int num_lanes_;
+        Eigen::MatrixXd x0_lanes_;
+        ConstLanesView StateLanesView();
+        LanesView DerivativeLanesView();
 
         // Block ports
         std::vector<std::shared_ptr<Port>> inputs_;
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controlblocks/block.h"
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui_data.h"
+
+/**
+ * @brief Where the value of an output port sits among the signals exchanged
+ * with a compiled model.
+ *
+ */
+typedef struct signal_slot_t
+{
+    int port_id;
+    int offset;
+    int size;
+} SignalSlot;
+
+/**
+ * @brief Turns a diagram into a self-contained C++ header that runs the same
+ * model without the block graph. Every signal becomes a fixed-size Eigen
+ * vector in a Signals struct, the states live in a State struct, and each
+ * block writes its math inline into one Evaluate() function in execution
+ * order. The header only needs Eigen.
+ *
+ * The generated Step() advances the model by the diagram's timestep with
+ * fixed step RK4, whatever solver the diagram is set to. As in the
+ * simulator, discrete blocks are sampled and updated at the start of each
+ * step, and the signals keep the values of the last evaluation.
+ *
+ * Blocks take part through Block::GenerateCode(), which uses the functions
+ * below to name their signals, states and parameters.
+ *
+ */
+class CodeGenerator
+{
+public:
+    CodeGenerator();
+    ~CodeGenerator() {}
+
+    /**
+     * @brief Generate the code for a diagram. The diagram is started to
+     * resolve signal widths, states and workspace variables, so it needs the
+     * Python interpreter unless the workspace was captured, and it is
+     * stopped again afterwards.
+     *
+     * @param diagram Diagram to generate
+     * @param gui_data Timestep and initial settings
+     * @param name Namespace of the generated code
+     * @param code Where to store the code
+     * @param errors Blocks that could not be generated, and other problems
+     * @return true if the code was generated
+     */
+    bool Generate(Diagram &diagram, GuiData &gui_data, const std::string &name,
+                  std::string *code, std::string *errors);
+
+    /**
+     * @brief Generate the code for a diagram into a file. The namespace is
+     * the file name without its extension.
+     *
+     */
+    bool WriteFile(Diagram &diagram, GuiData &gui_data,
+                   const std::string &filename, std::string *errors);
+
+    /**
+     * @brief Generate the code for a diagram that has already started,
+     * without restarting it. The diagram uses this to compile itself.
+     *
+     */
+    bool GenerateStarted(Diagram &diagram, const std::string &name,
+                         std::string *code, std::string *errors);
+
+    /**
+     * @brief Get C entry points for the last generated code, to append to
+     * it when it is built as a shared library (see NativeModel).
+     *
+     * @param name Namespace the code was generated in
+     * @return std::string Code of the entry points
+     */
+    std::string ExportFunctions(const std::string &name);
+
+    // Where each output port's value is in the signals of the entry points
+    const std::vector<SignalSlot> &GetSignalLayout();
+
+    // The rest are for blocks, while they generate their code. Expressions
+    // refer to the block being generated.
+
+    // Value of an input, which is zero if it isn't connected
+    std::string Input(int index);
+    int InputSize(int index);
+
+    // Value of an output, which can be assigned to
+    std::string Output(int index);
+    int OutputSize(int index);
+
+    // States of the block. Continuous states also have a derivative, which
+    // should be written on every evaluation.
+    std::string State();
+    std::string Derivative();
+
+    /**
+     * @brief Add a signal of the block's own that isn't an output, such as
+     * the value shown by a display block.
+     *
+     * @param name Name of the signal within the block
+     * @param size Width of the signal
+     * @return std::string Expression for the signal
+     */
+    std::string Signal(const std::string &name, int size);
+
+    /**
+     * @brief Add a constant matrix with a fixed value to the generated code.
+     *
+     * @param name Name of the parameter within the block
+     * @param value Value of the parameter
+     * @return std::string Expression for the parameter
+     */
+    std::string Parameter(const std::string &name,
+                          const Eigen::MatrixXd &value);
+
+    // A literal that reads back as exactly the same double
+    static std::string Number(double value);
+
+    // The time of the evaluation, and the timestep of the model, or the
+    // time between samples for discrete blocks
+    std::string Time();
+    double GetDt();
+
+    // Add a statement to the block's part of Evaluate(). Discrete blocks are
+    // only evaluated at sample times.
+    void Compute(const std::string &statement);
+
+    // Add a statement that advances a discrete block's states, run once per
+    // step after the sample
+    void Update(const std::string &statement);
+
+    static std::string MatrixType(int rows, int cols);
+
+private:
+    // Block being generated, and where its states are
+    std::shared_ptr<ControlBlock::Block> block_;
+    int state_offset_;
+    bool discrete_;
+    std::string discrete_state_;
+    double dt_;
+    double sample_dt_;
+
+    // Signal of each output port, by port ID, and the order they are
+    // exchanged in
+    std::unordered_map<int, std::string> signals_;
+    std::vector<SignalSlot> layout_;
+    std::vector<std::string> layout_members_;
+
+    // Pieces of the generated code
+    std::ostringstream parameters_;
+    std::ostringstream signal_members_;
+    std::ostringstream state_members_;
+    std::ostringstream initialize_;
+    std::ostringstream evaluate_;
+    std::ostringstream update_;
+
+    void Reset();
+    bool GenerateBlocks(Diagram &diagram, std::string *errors);
+    std::string Assemble(const std::string &name, const Eigen::VectorXd &x0,
+                         bool has_discrete);
+
+    // Prefix for the names of the block's signals and parameters
+    std::string BlockPrefix();
+
+    // Turn a block or port name into a C++ identifier
+    static std::string Identifier(const std::string &name);
+
+    // An expression that constructs a matrix with the given value
+    static std::string Literal(const Eigen::MatrixXd &value);
+};
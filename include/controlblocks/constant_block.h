@@ -14,14 +14,24 @@ namespace ControlBlock
     class ConstantBlock : public Block
     {
     public:
-        ConstantBlock(Diagram &diagram)
-            : Block(diagram), val_(0.0), min_node_width_(50.0)
-        {
-        }
+        ConstantBlock(Diagram &diagram) : Block(diagram), val_(0.0) {}
 
         void Init(std::string block_name = "Constant");
         void Compute(double t) override;
-        void Render() override;
+        void InferSizes() override;
+        bool ComputeLanes(double t) override;
+        bool IsFoldable() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+
+        // Constant value
+        double GetValue();
+        void SetValue(double val);
+
+        // Accepts "value", or one value per lane
+        bool SetParameter(const std::string &name,
+                          const Eigen::MatrixXd &value) override;
 
         // Serialization
         toml::table Serialize() override;
@@ -30,9 +40,10 @@ namespace ControlBlock
     private:
         double val_;
 
-        std::string output_port_name_;
+        // Value of each lane in an ensemble run, or empty to use val_
+        Eigen::RowVectorXd lane_vals_;
 
-        const float min_node_width_;
+        std::string output_port_name_;
     };
 
 } // namespace ControlBlock
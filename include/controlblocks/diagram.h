@@ -1,15 +1,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <ostream>
+#include <unordered_map>
 
-#include "imgui.h"
-#include "imgui_impl_opengl3.h"
-#include "imgui_impl_sdl.h"
-#include "imnodes.h"
-#include "implot.h"
 #include "toml++/toml.h"
 
 // Boost
@@ -19,30 +19,29 @@
 #include <boost/numeric/odeint/external/eigen/eigen.hpp>
 using namespace boost::numeric::odeint;
 
-// SDL
-#include <SDL.h>
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-#include <SDL_opengles2.h>
-#else
-#include <SDL_opengl.h>
-#endif
-
+#include "controlblocks/algebraic_loop_block.h"
 #include "controlblocks/block.h"
-#include "controlblocks/file_utils.h"
+#include "controlblocks/execution_schedule.h"
+#include "controlblocks/fused_linear_block.h"
 #include "controlblocks/gui_data.h"
-#include "controlblocks/gui_utils.h"
+#include "controlblocks/native_model.h"
 #include "controlblocks/port.h"
+#include "controlblocks/profiler.h"
 #include "controlblocks/sim_clock.h"
+#include "controlblocks/thread_pool.h"
 #include "controlblocks/wire.h"
 
 // Block types
 #include "controlblocks/constant_block.h"
+#include "controlblocks/discrete_state_space_block.h"
 #include "controlblocks/display_block.h"
 #include "controlblocks/gain_block.h"
 #include "controlblocks/mux_block.h"
+#include "controlblocks/rate_transition_block.h"
 #include "controlblocks/state_space_block.h"
 #include "controlblocks/sum_block.h"
-
+#include "controlblocks/unit_delay_block.h"
+#include "controlblocks/zero_order_hold_block.h"
 
 using namespace std::placeholders;
 
@@ -54,6 +53,13 @@ typedef struct block_types_t
 // Make Eigen::VectorXd work with Boost integrator
 typedef Eigen::VectorXd state_type;
 
+// Ensemble runs keep one column of states per lane
+typedef Eigen::MatrixXd ensemble_state_type;
+
+// The Rosenbrock stepper works on ublas vectors and matrices
+typedef boost::numeric::ublas::vector<double> stiff_state_type;
+typedef boost::numeric::ublas::matrix<double> stiff_matrix_type;
+
 /**
  * @brief This class manages all the blocks that are in a control diagram
  *
@@ -63,22 +69,89 @@ class Diagram
 
 public:
     Diagram()
-        : num_items_(0), sim_running_(false), sim_paused_(false), filename_(""),
-          focus_(false)
+        : fold_constants_(true), solve_loops_(true), fuse_linear_(true),
+          num_threads_(1),
+          native_(false), native_active_(false), num_items_(0),
+          sim_running_(false), sim_paused_(false), abs_tol_(1e-6),
+          rel_tol_(1e-6), tick_(0.0), ticks_per_step_(1), num_ticks_(0),
+          eval_t_(0.0), eval_valid_(false), num_lanes_(0), ck54_step_(0.0),
+          quiet_(false), null_log_(nullptr)
     {
     }
     ~Diagram() {}
 
-    Diagram(const Diagram &diagram)
+    Diagram(const Diagram &diagram) : quiet_(false), null_log_(nullptr)
     {
         this->blocks_ = diagram.blocks_;
         this->wires_ = diagram.wires_;
+        this->block_index_ = diagram.block_index_;
+        this->port_index_ = diagram.port_index_;
         this->num_items_ = diagram.num_items_;
         this->sim_running_ = diagram.sim_running_;
     }
 
     void Init();
-    void Update(GuiData &gui_data);
+
+    /**
+     * @brief Start a new simulation run using the timing and solver settings.
+     * This does not need the GUI, so it can be used by headless runners.
+     *
+     * @param gui_data Simulation settings
+     */
+    void Start(GuiData &gui_data);
+
+    /**
+     * @brief Advance a running simulation by one timestep.
+     *
+     * @param gui_data Simulation settings
+     */
+    void Step(GuiData &gui_data);
+
+    /**
+     * @brief Start an ensemble run, which simulates many copies of the
+     * diagram at once. Every signal and state has one column per lane, so
+     * each block does one matrix operation for all lanes. Lanes start from
+     * the blocks' initial states, or the per-lane values given through
+     * Block::SetParameter(). Ensembles need a fixed step solver and blocks
+     * that support lanes.
+     *
+     * @param gui_data Simulation settings
+     * @param num_lanes Number of copies to simulate
+     * @return false if the ensemble can't run
+     */
+    bool StartEnsemble(GuiData &gui_data, int num_lanes);
+
+    /**
+     * @brief Advance every lane of a running ensemble by one timestep.
+     *
+     * @param gui_data Simulation settings
+     */
+    void StepEnsemble(GuiData &gui_data);
+
+    // State of every lane, one column each
+    const ensemble_state_type &GetEnsembleState();
+    int NumLanes();
+
+    // Simulation control
+    void Pause();
+    void Resume();
+    void Stop();
+
+    /**
+     * @brief Determine if the simulation is running (not paused or stopped).
+     *
+     * @return true if the simulation is running
+     */
+    bool IsRunning();
+    bool IsPaused();
+
+    /**
+     * @brief Get all blocks in the diagram, including dynamical systems.
+     *
+     * @return std::vector<std::shared_ptr<ControlBlock::Block>> All blocks
+     */
+    std::vector<std::shared_ptr<ControlBlock::Block>> GetBlocks();
+    std::vector<std::shared_ptr<ControlBlock::Wire>> GetWires();
 
     /**
      * @brief Get the simulation time
@@ -95,7 +168,35 @@ public:
     double GetDt();
 
     /**
-     * @brief Add an element to the ImGui canvas with a unique ID
+     * @brief Get the profiler, which times the blocks and steps of runs
+     * started with profiling enabled.
+     *
+     * @return Profiler& The diagram's profiler
+     */
+    Profiler &GetProfiler();
+
+    /**
+     * @brief Drop the messages the diagram and its blocks print while
+     * loading, editing and starting. Diagrams run on other threads use this
+     * so they don't write to the shared std::cout.
+     *
+     * @param quiet true to drop the messages
+     */
+    void SetQuiet(bool quiet);
+
+    // Stream for the diagram's messages, std::cout unless quiet
+    std::ostream &Log();
+
+    /**
+     * @brief Print an error on the Python console. This takes the GIL, so it
+     * can be called from any thread.
+     *
+     * @param msg Error to print
+     */
+    void PrintError(const std::string &msg);
+
+    /**
+     * @brief Add an element to the diagram with a unique ID
      *
      * @return int Unique ID to add to the canvas
      */
@@ -119,7 +220,15 @@ public:
     void RemoveItem(int id);
 
     /**
-     * @brief Remove a port based on its ImGui ID. Calls RemoveItem()
+     * @brief Register a port that was added to a block after the block was
+     * added to the diagram, so wires can find it.
+     *
+     * @param port The new port
+     */
+    void AddPort(std::shared_ptr<ControlBlock::Port> port);
+
+    /**
+     * @brief Remove a port based on its ID. Calls RemoveItem()
      *
      * @param id ID to remove.
      */
@@ -129,8 +238,9 @@ public:
      * @brief Create and register a new block with the diagram
      *
      * @tparam T The block type to create
+     * @return std::shared_ptr<T> The new block
      */
-    template <typename T> void AddBlock(ImVec2 pos)
+    template <typename T> std::shared_ptr<T> AddBlock()
     {
         // Create block
         std::shared_ptr<T> T_block = std::make_shared<T>(*this);
@@ -138,9 +248,6 @@ public:
         // Initialize block
         T_block->Init();
 
-        // Set the block's position
-        T_block->SetPosition(pos);
-
         // Register block in diagram
         if (!T_block->IsDynamicalSystem())
         {
@@ -151,6 +258,9 @@ public:
             // If it is a dynamical block, then insert in that list instead
             dyn_blocks_.push_back(T_block);
         }
+        this->IndexBlock(T_block);
+
+        return T_block;
     }
 
     template <typename T> void LoadBlock(toml::table block_tbl)
@@ -174,14 +284,49 @@ public:
             // If it is a dynamical block, then insert in that list instead
             dyn_blocks_.push_back(T_block);
         }
+        this->IndexBlock(T_block);
     }
 
+    /**
+     * @brief Give a workspace variable a value for this diagram only. Blocks
+     * use it instead of the Python variable of the same name.
+     *
+     * @param name Variable name
+     * @param value Value to use
+     */
+    void SetWorkspaceVariable(const std::string &name,
+                              const Eigen::MatrixXd &value);
+    void ClearWorkspaceVariables();
+
+    /**
+     * @brief Look up a workspace variable, first in the diagram's own values
+     * and then in the Python workspace. Only the Python lookup takes the GIL.
+     *
+     * @param name Variable name
+     * @param msg Description of the error, if any
+     * @param var Where to store the value
+     * @return true if the variable was found
+     */
+    bool GetWorkspaceVariable(const std::string &name, std::string *msg,
+                              Eigen::MatrixXd *var);
+
+    /**
+     * @brief Copy every workspace variable the blocks read from Python into
+     * the diagram's own values, so the diagram can start without Python.
+     *
+     * @param errors Variables that could not be found
+     * @return true if every variable was found
+     */
+    bool CaptureWorkspace(std::string *errors);
+    const std::unordered_map<std::string, Eigen::MatrixXd> &
+    GetWorkspaceVariables();
+
     // Wire editing
     void AddWire(int from, int to);
     void RemoveWire(int id);
 
     // Block removal
-    void DetectBlockRemoval();
+    void RemoveBlock(int id);
 
     // Save / Load / New
     void SaveDiagram(std::string filename);
@@ -189,12 +334,76 @@ public:
     void ClearDiagram();
 
 private:
+    // The benchmarks time the graph and solver internals directly
+    friend class DiagramBenchmark;
+
+    // Code generation reads the compiled schedule and state layout
+    friend class CodeGenerator;
+
     std::vector<std::shared_ptr<ControlBlock::Block>> blocks_;
     std::vector<std::shared_ptr<ControlBlock::Wire>> wires_;
 
     // Dynamical systems
     std::vector<std::shared_ptr<ControlBlock::Block>> dyn_blocks_;
-    std::vector<Eigen::VectorXd> dyn_block_states_;
+
+    // State of every dynamical system in one vector. Each block owns the
+    // segment starting at its offset, fixed when the simulation starts.
+    state_type diagram_x_;
+    state_type diagram_dx_;
+    std::vector<int> state_offsets_;
+
+    // Compiled execution order, with fused blocks in place of the linear
+    // blocks they replace, and the order of the blocks themselves. Blocks
+    // fed only by constants are computed once when folding.
+    ControlBlock::ExecutionSchedule schedule_;
+    ControlBlock::ExecutionSchedule block_schedule_;
+    bool fold_constants_;
+
+    // Loops without state, each solved by a block that takes the place of
+    // its members, and the loop of each member by block ID
+    bool solve_loops_;
+    std::vector<std::shared_ptr<ControlBlock::AlgebraicLoopBlock>>
+        loop_blocks_;
+    std::unordered_map<int, size_t> loop_groups_;
+
+    // Groups of connected linear blocks computed as one system, where each
+    // one's states start, and the group of each member by block ID
+    bool fuse_linear_;
+    std::vector<std::shared_ptr<ControlBlock::FusedLinearBlock>> fused_blocks_;
+    std::vector<int> fused_offsets_;
+    std::unordered_map<int, size_t> fused_groups_;
+
+    // Workspace variables that take the place of the Python ones
+    std::unordered_map<std::string, Eigen::MatrixXd> workspace_;
+
+    // Optional timing of the blocks and steps
+    Profiler profiler_;
+
+    // Optional threads for computing independent blocks at the same time,
+    // and which levels of the schedule are worth splitting between them
+    int num_threads_;
+    std::unique_ptr<ControlUtils::ThreadPool> thread_pool_;
+    std::vector<bool> parallel_levels_;
+
+    // Optional compiled copy of the diagram that takes over from the blocks
+    // once it is built. The blocks' outputs are copied back from it after
+    // every step, and blocks without outputs are computed from them.
+    bool native_;
+    bool native_active_;
+    NativeModel native_model_;
+    std::vector<std::shared_ptr<ControlBlock::Port>> native_ports_;
+    std::vector<std::shared_ptr<ControlBlock::Block>> native_sinks_;
+    Eigen::VectorXd native_signals_;
+
+    // Blocks only computed at their sample times, in execution order
+    std::vector<std::shared_ptr<ControlBlock::Block>> discrete_blocks_;
+
+    // Period and offset of each entry in the schedule in ticks, and whether
+    // the entry is sampled at the current tick. Continuous entries have a
+    // period of 0.
+    std::vector<long long> sample_periods_;
+    std::vector<long long> sample_offsets_;
+    std::vector<bool> sample_hits_;
 
     // ID tracking
     int num_items_;
@@ -204,50 +413,192 @@ private:
     bool sim_running_;
     bool sim_paused_;
 
-    // Simulation timing
+    // Simulation timing. Each step is taken in ticks of the base rate,
+    // which divides the step and every sample time.
     double dt_;
     double tf_;
+    double tick_;
+    int ticks_per_step_;
+    long long num_ticks_;
     SimClock clk_;
 
+    // Error tolerances for the adaptive solvers
+    double abs_tol_;
+    double rel_tol_;
+
+    // State, derivative and time of the last evaluation in this step, and
+    // which entries of the schedule the next one has to compute again
+    state_type eval_x_;
+    state_type eval_dx_;
+    double eval_t_;
+    bool eval_valid_;
+    std::vector<bool> changed_;
+
     // ODE solvers
     runge_kutta4<state_type> rk4_stepper;
     runge_kutta_dopri5<state_type> rkd5_stepper;
     runge_kutta_cash_karp54<state_type> rkck54_stepper;
 
-    // File management
-    std::string filename_;
-
-    // Window management
-    bool focus_;
+    // Adaptive ODE solvers. dopri5 interpolates its dense output at each
+    // sample time, while Cash-Karp54 shortens its last step to land on it.
+    typedef controlled_runge_kutta<runge_kutta_cash_karp54<state_type>>
+        controlled_ck54_type;
+    typedef dense_output_runge_kutta<
+        controlled_runge_kutta<runge_kutta_dopri5<state_type>>>
+        dense_dopri5_type;
+    controlled_ck54_type rkck54_controlled_stepper;
+    dense_dopri5_type rkd5_dense_stepper;
+
+    // Ensemble state, derivative and fixed step solvers
+    int num_lanes_;
+    ensemble_state_type ensemble_x_;
+    ensemble_state_type ensemble_dx_;
+    runge_kutta4<ensemble_state_type> ensemble_rk4_stepper;
+    runge_kutta_cash_karp54<ensemble_state_type> ensemble_rkck54_stepper;
+    runge_kutta_dopri5<ensemble_state_type> ensemble_rkd5_stepper;
+
+    // Step size the Cash-Karp54 controller will try next
+    double ck54_step_;
+
+    // Stiff ODE solver. It keeps its own copy of the state since it needs
+    // ublas types, and asks the diagram for the Jacobian on every step. The
+    // stepper can't be assigned, so a new one is made for each run.
+    typedef rosenbrock4_controller<rosenbrock4<double>>
+        controlled_rosenbrock4_type;
+    typedef rosenbrock4_dense_output<controlled_rosenbrock4_type>
+        dense_rosenbrock4_type;
+    std::unique_ptr<dense_rosenbrock4_type> rosenbrock4_dense_stepper;
+    stiff_state_type stiff_x_;
+
+    // Diagram Jacobian and the state and derivatives used to build it
+    Eigen::MatrixXd jac_;
+    state_type jac_x_;
+    state_type jac_f0_;
+    state_type jac_f1_;
+
+    // Cleared once a block can't supply an analytic Jacobian, so the rest of
+    // the run goes straight to finite differences.
+    bool analytic_jacobian_;
 
     // Diagram simulation
     void InitSim();
     void Compute(GuiData &gui_data);
-    void ComputeGraph(double t);
+
+    // Advance the diagram by one tick of the base rate
+    void Tick(GuiData &gui_data);
+    void ComputeGraph(double t, bool sample = false,
+                      bool changed_only = false);
+    void ComputeGraphProfiled(double t, bool sample, bool changed_only);
+    void ComputeGraphParallel(double t, bool sample, bool changed_only);
+    static void ComputeEntry(const ControlBlock::ScheduledBlock &entry,
+                             double t);
+
+    /**
+     * @brief Fuse each group of two or more connected linear blocks into one
+     * system and compile the schedule with the fused blocks in their place.
+     * Groups that something outside feeds back into within an evaluation,
+     * or whose loops have no unique solution, are left alone.
+     *
+     */
+    void FuseLinearBlocks();
+
+    /**
+     * @brief Report the loops without state that the schedule found, and
+     * when solving them, compile the schedule again with a block that
+     * iterates each loop in place of its members.
+     *
+     */
+    void SolveAlgebraicLoops();
+
+    // Compile the schedule with the fused and loop blocks in place of their
+    // members
+    void CompileSchedule();
+
+    // Decide which levels of the schedule to compute in parallel
+    void PlanParallelLevels();
+
+    // Start building the compiled diagram, switch to it between steps once
+    // it is ready, and copy its signals back to the blocks
+    void BuildNative();
+    void ActivateNative();
+    void PublishNative();
+
+    // Find the base rate from the step and the sample times in the schedule,
+    // and when each entry is sampled. Returns false if they don't share one.
+    bool PlanSampleTimes();
+
+    // Compute the diagram at the current tick if any discrete block is
+    // sampled, and advance those blocks to their next sample. Returns true if
+    // any block was sampled.
+    bool UpdateDiscrete();
+
+    // Advance the state by one sample time with the adaptive solvers
+    void StepControlledCK54();
+    void StepDenseDopri5();
+    void StepDenseRosenbrock4();
+
+    // Restart the solver's dense output stepper, if it has one, from the
+    // current state and time
+    void ResetDenseStepper(const std::string &solver);
 
     // ODE Solving
     void Dynamics(const state_type &x, state_type &dxdt, const double t);
+    void BindStates(const double *x, double *dxdt);
+
+    /**
+     * @brief Compute the derivative of the diagram state with the blocks.
+     * After the first evaluation of a step, only the blocks downstream of
+     * the systems whose states changed, or of time if it changed, are
+     * computed again.
+     *
+     * @param x Diagram state
+     * @param dxdt Where to store the derivative
+     * @param t Time to evaluate the diagram at
+     */
+    void ComputeStates(const double *x, double *dxdt, double t);
 
-    // Diagram rendering
-    void MenuBar();
-    void Render();
-    void AddBlockPopup();
-    void EditWires();
-    void EditSettings();
+    // Ensemble solving. Computing the lanes fails if a block doesn't
+    // support them.
+    void EnsembleDynamics(const ensemble_state_type &x,
+                          ensemble_state_type &dxdt, const double t);
+    void BindLanes(const double *x, double *dxdt, int num_states);
+    bool ComputeGraphLanes(double t);
 
-    // Shortcuts
-    void Shortcuts();
+    // Stiff ODE solving
+    void StiffDynamics(const stiff_state_type &x, stiff_state_type &dxdt,
+                       const double t);
+    void StiffJacobian(const stiff_state_type &x, stiff_matrix_type &J,
+                       const double &t, stiff_state_type &dfdt);
 
-    // File operations
-    void NewDiagram();
-    void Load();
-    void Save();
-    void SaveAs();
+    /**
+     * @brief Build the diagram Jacobian from the blocks in execution order.
+     * Each block maps the Jacobians of its inputs to those of its outputs and
+     * its own rows of the diagram Jacobian.
+     *
+     * @return false if a block can't supply its Jacobian analytically
+     */
+    bool AnalyticJacobian();
 
-    // Block removal
-    void RemoveBlock(int id);
+    /**
+     * @brief Build the diagram Jacobian column by column by perturbing each
+     * state of jac_x_. jac_f0_ must hold the derivative at jac_x_.
+     *
+     * @param t Time to evaluate the diagram at
+     */
+    void FiniteDifferenceJacobian(double t);
 
     // Block searching
     std::shared_ptr<ControlBlock::Port> GetPortByImNodesId(int id);
-    int GetDynamicBlockIndex(std::shared_ptr<ControlBlock::Block> blk);
+
+    // Lookup tables from ID to block and port, kept up to date as items are
+    // added and removed so wires can be connected without searching.
+    std::unordered_map<int, std::shared_ptr<ControlBlock::Block>> block_index_;
+    std::unordered_map<int, std::shared_ptr<ControlBlock::Port>> port_index_;
+    void IndexBlock(std::shared_ptr<ControlBlock::Block> block);
+    void UnindexBlock(std::shared_ptr<ControlBlock::Block> block);
+
+    // Messages go to std::cout unless quiet. The null log has no buffer, so
+    // it drops everything written to it.
+    bool quiet_;
+    std::ostream null_log_;
 };
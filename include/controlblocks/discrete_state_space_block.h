@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iostream>
+
+#include <Eigen/Dense>
+#include <toml++/toml.h>
+
+#include "controlblocks/state_space_block.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief A discrete-time linear system, x[k + 1] = A x[k] + B u[k] and
+     * y[k] = C x[k] + D u[k], with its matrices read from the workspace like
+     * a state space block. The states are advanced once per sample, and
+     * without a sample time of its own the block is sampled once per step.
+     *
+     */
+    class DiscreteStateSpaceBlock : public StateSpaceBlock
+    {
+    public:
+        DiscreteStateSpaceBlock(Diagram &diagram) : StateSpaceBlock(diagram)
+        {
+        }
+
+        void Init(std::string block_name = "Discrete State Space");
+
+        // Overriden Block functions
+        void Compute(double t) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
+        bool IsDiscrete() override;
+        void Update(double t, double dt) override;
+        bool GenerateCode(CodeGenerator &gen) override;
+
+        // Serialization
+        toml::table Serialize() override;
+    };
+
+} // namespace ControlBlock
@@ -14,25 +14,33 @@ namespace ControlBlock
     class DisplayBlock : public Block
     {
     public:
-        DisplayBlock(Diagram &diagram)
-            : Block(diagram), val_(0), min_node_width_(50.0)
-        {
-        }
+        DisplayBlock(Diagram &diagram) : Block(diagram), val_(0) {}
 
         void Init(std::string block_name = "Display");
         void Compute(double t) override;
-        void Render() override;
+        void InferSizes() override;
+        bool ComputeLanes(double t) override;
+        bool IsFoldable() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+
+        // Get the most recently displayed value
+        const Eigen::VectorXd &GetValue();
+
+        // Get the most recently displayed value of each lane in an ensemble
+        // run, one column per lane
+        const Eigen::MatrixXd &GetLaneValues();
 
         // Serialization
         toml::table Serialize() override;
 
     private:
         Eigen::VectorXd val_;
+        Eigen::MatrixXd lane_vals_;
 
         std::string input_port_name_;
         std::string output_port_name_;
-
-        const float min_node_width_;
     };
 
 } // namespace ControlBlock
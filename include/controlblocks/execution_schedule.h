@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "controlblocks/block.h"
+#include "controlblocks/port.h"
+
+namespace ControlBlock
+{
+    typedef struct scheduled_block_t
+    {
+        std::shared_ptr<Block> block;
+
+        // Index of the block in the diagram's dynamical system list, or -1 if
+        // the block is not a dynamical system.
+        int dyn_idx;
+
+        // If the block is only computed at sample times, and when they are.
+        // Blocks that inherit their sample time have it resolved from the
+        // blocks they read.
+        bool discrete;
+        SampleTime sample_time;
+
+        // If only the outputs of a dynamical system without direct
+        // feedthrough are computed. A later entry computes the whole block.
+        bool output_only;
+    } ScheduledBlock;
+
+    /**
+     * @brief A flat execution order for the blocks in a diagram. This is
+     * compiled once when the simulation starts so that every evaluation of the
+     * diagram is a single linear pass over the blocks.
+     *
+     */
+    class ExecutionSchedule
+    {
+    public:
+        ExecutionSchedule() : breaks_loops_(false) {}
+        ~ExecutionSchedule() {}
+
+        /**
+         * @brief Topologically sort the blocks using the port connections.
+         * Dynamical systems without direct feedthrough compute their outputs
+         * first, which breaks the feedback loops through them. Loops through
+         * other systems are broken with their outputs from the previous
+         * evaluation. Loops without a dynamical system can't be ordered, and
+         * are reported by GetAlgebraicLoops().
+         *
+         * @param blocks Non-dynamical blocks in the diagram
+         * @param dyn_blocks Dynamical system blocks in the diagram. Slots can
+         * be empty, so the indices match the diagram's list when some of its
+         * systems have been fused.
+         * @param step Period of discrete blocks without one of their own
+         * @param fold Take blocks fed only by constants out of the order to
+         * be computed once, and drop blocks whose outputs are never observed
+         */
+        void Compile(const std::vector<std::shared_ptr<Block>> &blocks,
+                     const std::vector<std::shared_ptr<Block>> &dyn_blocks,
+                     double step, bool fold = false);
+
+        /**
+         * @brief Remove all blocks from the schedule.
+         *
+         */
+        void Clear();
+
+        const std::vector<ScheduledBlock> &GetOrder() const;
+
+        /**
+         * @brief Get where each level starts in the order, followed by the end
+         * of the order. Blocks in the same level don't read each other's
+         * outputs, so they can be computed in any order or at the same time.
+         *
+         */
+        const std::vector<size_t> &GetLevels() const;
+        const std::vector<std::shared_ptr<Block>> &GetUnscheduled() const;
+
+        /**
+         * @brief Get the blocks whose inputs are all constant, in the order
+         * to compute them. Their outputs never change, so they are computed
+         * once before the first evaluation.
+         *
+         */
+        const std::vector<ScheduledBlock> &GetFolded() const;
+
+        /**
+         * @brief Get the blocks that feed neither a block without outputs,
+         * such as a display, nor a dynamical system. Nothing would see their
+         * outputs, so they are never computed.
+         *
+         */
+        const std::vector<ScheduledBlock> &GetPruned() const;
+
+        /**
+         * @brief Get the positions in the order that have to be computed
+         * again when a dynamical system's states change: the system itself
+         * and everything downstream of its outputs, in order.
+         *
+         * @param dyn_idx Index of the system in the diagram's list
+         */
+        const std::vector<size_t> &GetStateDependents(int dyn_idx) const;
+
+        // Positions in the order that have to be computed again when the
+        // time changes, in order
+        const std::vector<size_t> &GetTimeDependents() const;
+
+        /**
+         * @brief If a loop had to be broken at a system with direct
+         * feedthrough. The blocks ahead of it read its output from the
+         * previous evaluation, so computing only the dependents of what
+         * changed would not give the same result as computing everything.
+         *
+         */
+        bool BreaksLoops() const;
+
+        /**
+         * @brief Get the loops of blocks without state, each of which has to
+         * be solved as a whole since every block in it waits on another.
+         * Their blocks and anything downstream are left unscheduled, and the
+         * blocks of each loop are in the order they were given.
+         *
+         */
+        const std::vector<std::vector<std::shared_ptr<Block>>> &
+        GetAlgebraicLoops() const;
+        size_t Size() const;
+
+    private:
+        // Blocks in the order they should be computed
+        std::vector<ScheduledBlock> order_;
+        std::vector<size_t> levels_;
+
+        // Blocks that will never be computed because they are disconnected or
+        // are part of a loop with no dynamical system to break it.
+        std::vector<std::shared_ptr<Block>> unscheduled_;
+
+        // Blocks taken out of the order when folding
+        std::vector<ScheduledBlock> folded_;
+        std::vector<ScheduledBlock> pruned_;
+
+        // Positions in the order that depend on each system's states and on
+        // time
+        std::vector<std::vector<size_t>> state_dependents_;
+        std::vector<size_t> time_dependents_;
+        bool breaks_loops_;
+
+        // Loops with no state in them
+        std::vector<std::vector<std::shared_ptr<Block>>> loops_;
+
+        // Regroup order_ by level and fill in levels_. order_nodes holds the
+        // graph node of each entry in order_, and is regrouped with it.
+        void GroupLevels(std::vector<size_t> &order_nodes,
+                         const std::vector<std::vector<size_t>> &producers,
+                         const std::vector<std::vector<size_t>> &consumers);
+
+        // Fill in loops_ from the nodes that couldn't be ordered. The first
+        // num_stateless nodes are the blocks without state.
+        void FindLoops(const std::vector<std::shared_ptr<Block>> &nodes,
+                       size_t num_stateless, const std::vector<bool> &stuck,
+                       const std::vector<std::vector<size_t>> &producers,
+                       const std::vector<std::vector<size_t>> &consumers);
+
+        // Resolve the sample time of node n into rates. Inherited ones come
+        // from the node's producers, which have to be resolved first. Nodes
+        // that only read constants are marked in constant_rate.
+        void
+        ResolveSampleTime(size_t n, bool is_dynamic,
+                          const std::vector<std::shared_ptr<Block>> &nodes,
+                          const std::vector<std::vector<size_t>> &producers,
+                          double step, std::vector<SampleTime> &rates,
+                          std::vector<bool> &constant_rate) const;
+
+        // Positions in the order of the seed nodes and every node downstream
+        // of them, sorted
+        std::vector<size_t>
+        Downstream(const std::vector<size_t> &seeds,
+                   const std::vector<std::vector<size_t>> &consumers,
+                   const std::vector<int> &position) const;
+    };
+} // namespace ControlBlock
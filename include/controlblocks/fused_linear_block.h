@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controlblocks/block.h"
+#include "controlblocks/state_space.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief A group of connected linear blocks reduced to one state space
+     * system, which the diagram computes in their place. The signals between
+     * the blocks are eliminated, including any algebraic loops, so each
+     * evaluation is one pair of matrix-vector products however many blocks
+     * went into it.
+     *
+     * The block doesn't have ports of its own. Its inputs are the members'
+     * input ports driven from outside the group and its outputs are every
+     * member's output ports, so the rest of the diagram reads the same
+     * signals as before. Its states are the members' states one after
+     * another, which the diagram lays out next to each other.
+     *
+     */
+    class FusedLinearBlock : public Block
+    {
+    public:
+        FusedLinearBlock(Diagram &diagram) : Block(diagram) {}
+
+        /**
+         * @brief Reduce the blocks to one system. Their sizes must already
+         * have been inferred.
+         *
+         * @param members Blocks to fuse, with the dynamical systems in the
+         * order their states are laid out
+         * @return false if a block isn't linear, or a loop between them
+         * without a state has no unique solution
+         */
+        bool Fuse(const std::vector<std::shared_ptr<Block>> &members);
+
+        const std::vector<std::shared_ptr<Block>> &GetMembers();
+
+        // Overriden Block functions
+        void Compute(double t) override;
+        void ComputeOutput(double t) override;
+        bool ComputeLanes(double t) override;
+        bool ComputeOutputLanes(double t) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
+        bool HasDirectFeedthrough() override;
+
+    private:
+        std::vector<std::shared_ptr<Block>> members_;
+
+        // The members' inputs from outside the group to all of their outputs
+        ControlUtils::StateSpace ss_;
+
+        // Stacked inputs and outputs, and their lanes and Jacobians
+        Eigen::VectorXd u_;
+        Eigen::VectorXd y_;
+        Eigen::MatrixXd u_lanes_;
+        Eigen::MatrixXd y_lanes_;
+        Eigen::MatrixXd du_;
+        Eigen::MatrixXd dy_;
+    };
+
+} // namespace ControlBlock
@@ -14,16 +14,27 @@ namespace ControlBlock
     class GainBlock : public Block
     {
     public:
-        GainBlock(Diagram &diagram)
-            : Block(diagram), val_(0.0), min_node_width_(50.0)
-        {
-        }
+        GainBlock(Diagram &diagram) : Block(diagram), val_(0.0) {}
 
         void Init(std::string block_name = "Gain");
         bool ApplyInitial() override;
         void SetInitial(Eigen::VectorXd x0) override;
         void Compute(double t) override;
-        void Render() override;
+        void InferSizes() override;
+        bool ComputeLanes(double t) override;
+        bool IsFoldable() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
+
+        // Gain value
+        double GetGain();
+        void SetGain(double gain);
+
+        // Accepts "gain", or one gain per lane
+        bool SetParameter(const std::string &name,
+                          const Eigen::MatrixXd &value) override;
 
         // Serialization
         toml::table Serialize() override;
@@ -31,12 +42,13 @@ namespace ControlBlock
 
     private:
         double val_;
+
+        // Gain of each lane in an ensemble run, or empty to use val_
+        Eigen::RowVectorXd lane_vals_;
         Eigen::VectorXd x0_;
 
         std::string input_port_name_;
         std::string output_port_name_;
-
-        const float min_node_width_;
     };
 
 } // namespace ControlBlock
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "imgui.h"
+#include "imnodes.h"
+
+#include "controlblocks/block.h"
+#include "controlblocks/constant_block.h"
+#include "controlblocks/discrete_state_space_block.h"
+#include "controlblocks/display_block.h"
+#include "controlblocks/gain_block.h"
+#include "controlblocks/mux_block.h"
+#include "controlblocks/rate_transition_block.h"
+#include "controlblocks/sim_worker.h"
+#include "controlblocks/state_space_block.h"
+#include "controlblocks/sum_block.h"
+#include "controlblocks/unit_delay_block.h"
+#include "controlblocks/zero_order_hold_block.h"
+
+/**
+ * @brief Draws the blocks of a diagram as ImNodes nodes and shows their
+ * settings windows. Blocks know nothing about the GUI, so all of the drawing
+ * for each block type lives here.
+ *
+ */
+class BlockRenderer
+{
+public:
+    BlockRenderer() : min_node_width_(50.0), worker_(nullptr) {}
+    ~BlockRenderer() {}
+
+    /**
+     * @brief Draw a block as a node in the current ImNodes editor.
+     *
+     * @param block Block to draw
+     */
+    void Render(std::shared_ptr<ControlBlock::Block> block);
+
+    /**
+     * @brief Show the settings window for a block if it has been opened.
+     *
+     * @param block Block to show the settings of
+     */
+    void Settings(std::shared_ptr<ControlBlock::Block> block);
+
+    /**
+     * @brief Forget the state of every settings window.
+     *
+     */
+    void Clear();
+
+    /**
+     * @brief Show the values published by a simulation thread instead of
+     * reading them from the blocks, which the thread may be writing.
+     *
+     * @param worker Simulation thread running the diagram
+     */
+    void SetSimWorker(SimWorker *worker);
+
+private:
+    float min_node_width_;
+
+    // Whether the settings window is open for each block ID
+    std::map<int, bool> settings_open_;
+
+    // Source of the simulated values, if the diagram runs on its own thread
+    SimWorker *worker_;
+
+    // Per-type rendering
+    void RenderConstant(std::shared_ptr<ControlBlock::ConstantBlock> block);
+    void RenderGain(std::shared_ptr<ControlBlock::GainBlock> block);
+    void RenderSum(std::shared_ptr<ControlBlock::SumBlock> block);
+    void RenderDisplay(std::shared_ptr<ControlBlock::DisplayBlock> block);
+    void RenderMux(std::shared_ptr<ControlBlock::MuxBlock> block);
+    void RenderStateSpace(std::shared_ptr<ControlBlock::StateSpaceBlock> block);
+    void RenderSampled(std::shared_ptr<ControlBlock::Block> block);
+
+    // Per-type settings
+    void SettingsMux(std::shared_ptr<ControlBlock::MuxBlock> block);
+    void
+    SettingsStateSpace(std::shared_ptr<ControlBlock::StateSpaceBlock> block);
+    void SettingsRateTransition(
+        std::shared_ptr<ControlBlock::RateTransitionBlock> block);
+    void SettingsInitialValue(std::shared_ptr<ControlBlock::Block> block,
+                              const Eigen::VectorXd &x0);
+    void SettingsSampleTime(std::shared_ptr<ControlBlock::Block> block);
+
+    // Shared pieces of the node layout
+    float BeginBlockNode(std::shared_ptr<ControlBlock::Block> block);
+    void EndBlockNode();
+};
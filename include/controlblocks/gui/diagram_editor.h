@@ -0,0 +1,98 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
+#include "imgui_impl_sdl.h"
+#include "imnodes.h"
+#include <SDL.h>
+#if defined(IMGUI_IMPL_OPENGL_ES2)
+#include <SDL_opengles2.h>
+#else
+#include <SDL_opengl.h>
+#endif
+
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui/block_renderer.h"
+#include "controlblocks/gui/file_utils.h"
+#include "controlblocks/gui/gui_utils.h"
+#include "controlblocks/gui_data.h"
+#include "controlblocks/sim_worker.h"
+
+/**
+ * @brief The node editor window for a diagram. This handles everything the user
+ * does to a diagram through the GUI, while the diagram itself only holds the
+ * blocks and runs the simulation.
+ *
+ */
+class DiagramEditor
+{
+public:
+    DiagramEditor(Diagram &diagram, SimWorker &worker)
+        : diagram_(diagram), worker_(worker), filename_(""), focus_(false)
+    {
+        renderer_.SetSimWorker(&worker_);
+    }
+    ~DiagramEditor() {}
+
+    /**
+     * @brief Handle the simulation controls and draw the diagram.
+     *
+     * @param gui_data Simulation settings and toolbar events
+     */
+    void Update(GuiData &gui_data);
+
+private:
+    Diagram &diagram_;
+    BlockRenderer renderer_;
+
+    // Runs the simulation. The diagram is only edited while it is stopped.
+    SimWorker &worker_;
+
+    // Blocks that have been given their initial position in ImNodes
+    std::set<int> placed_blocks_;
+
+    // File management
+    std::string filename_;
+
+    // Window management
+    bool focus_;
+
+    // Diagram rendering
+    void MenuBar();
+    void Render();
+
+    // Each block's time relative to the slowest block, from 0 to 1
+    std::map<int, float> BlockHeat();
+    void AddBlockPopup();
+    void EditWires();
+    void EditSettings();
+    void Shortcuts();
+
+    // Block removal
+    void DetectBlockRemoval();
+
+    // Save / Load / New
+    void NewDiagram();
+    void Load();
+    void Save();
+    void SaveAs();
+    void ClearDiagram();
+
+    // Copy the node positions from ImNodes into the blocks before saving
+    void StorePositions();
+
+    template <typename T> void AddBlock(ImVec2 pos)
+    {
+        std::shared_ptr<T> block = diagram_.AddBlock<T>();
+
+        // Place the block where the user clicked
+        ImNodes::SetNodeScreenSpacePos(block->GetId(), pos);
+        placed_blocks_.insert(block->GetId());
+    }
+};
@@ -1,10 +1,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
@@ -19,14 +21,17 @@
 #endif
 
 #include "controlblocks/block.h"
+#include "controlblocks/code_generator.h"
 #include "controlblocks/diagram.h"
+#include "controlblocks/gui/diagram_editor.h"
+#include "controlblocks/gui/workspace.h"
 #include "controlblocks/gui_data.h"
-#include "controlblocks/workspace.h"
+#include "controlblocks/sim_worker.h"
 
 class Gui
 {
 public:
-    Gui(){};
+    Gui() : worker_(diagram_), editor_(diagram_, worker_){};
 
     void Init();
     bool Update();
@@ -41,11 +46,15 @@ private:
     SDL_GLContext gl_context;
 
     Diagram diagram_;
+    SimWorker worker_;
+    DiagramEditor editor_;
     Workspace workspace_;
     GuiData gui_data_;
 
     void Menubar();
     void Toolbar();
+    void RealTimeWindow();
+    void ProfileWindow();
 
     void SaveDiagram();
     void LoadDiagram();
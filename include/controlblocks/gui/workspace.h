@@ -23,10 +23,10 @@
 #endif
 #include "TextEditor.h"
 
-#include "controlblocks/console.h"
-#include "controlblocks/file_utils.h"
+#include "controlblocks/gui/console.h"
+#include "controlblocks/gui/file_utils.h"
 #include "controlblocks/gui_data.h"
-#include "controlblocks/gui_utils.h"
+#include "controlblocks/gui/gui_utils.h"
 
 namespace py = pybind11;
 
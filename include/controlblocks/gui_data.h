@@ -4,8 +4,17 @@
 #include <string>
 #include <vector>
 
-static const std::vector<std::string> ode_solvers = {"RK4", "Cash-Karp54",
-                                                     "dopri5"};
+// The adaptive solvers choose their own internal steps to meet the error
+// tolerances and only report the state every dt.
+static const std::vector<std::string> ode_solvers = {
+    "RK4", "Cash-Karp54", "dopri5", "Cash-Karp54 (adaptive)",
+    "dopri5 (adaptive)", "Rosenbrock4 (stiff)"};
+
+// How the simulation thread paces itself against the wall clock. Real time
+// runs a fixed multiple of real time, and frame budget steps for a fixed
+// amount of wall time each rendered frame.
+static const std::vector<std::string> pacing_modes = {
+    "As fast as possible", "Real time", "Frame budget"};
 
 typedef struct gui_data_t
 {
@@ -21,4 +30,42 @@ typedef struct gui_data_t
     // ODE solver
     std::string solver = ode_solvers[0];
 
+    // Error tolerances for the adaptive solvers
+    double abs_tol = 1e-6;
+    double rel_tol = 1e-6;
+
+    // Pacing
+    std::string pacing = pacing_modes[0];
+    double realtime_factor = 1.0;
+    double frame_budget_ms = 8.0;
+
+    // Simulation thread CPU (-1 for any) and SCHED_FIFO priority (0 for
+    // normal scheduling), used on Linux
+    int rt_cpu = -1;
+    int rt_priority = 0;
+
+    // Time every block and step of the run
+    bool profile = false;
+
+    // Threads used to compute the diagram, including the simulation thread.
+    // Levels of independent blocks that are expensive enough are split
+    // between them.
+    int sim_threads = 1;
+
+    // Reduce connected linear blocks to one state space system each when
+    // the simulation starts
+    bool fuse_linear = true;
+
+    // Compute blocks fed only by constants once when the simulation starts,
+    // and skip blocks whose outputs nothing observes
+    bool fold_constants = true;
+
+    // Solve loops of blocks without state by iterating them on every
+    // evaluation, rather than leaving them uncomputed
+    bool solve_loops = true;
+
+    // Compile the diagram to native code in the background and switch to
+    // it once it is ready
+    bool native = false;
+
 } GuiData;
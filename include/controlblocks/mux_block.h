@@ -7,7 +7,6 @@
 #include <toml++/toml.h>
 
 #include "controlblocks/block.h"
-#include "controlblocks/vector_utils.h"
 
 namespace ControlBlock
 {
@@ -15,16 +14,21 @@ namespace ControlBlock
     class MuxBlock : public Block
     {
     public:
-        MuxBlock(Diagram &diagram)
-            : Block(diagram), num_mux_inputs(2), min_node_width_(50.0),
-              settings_open_(false)
-        {
-        }
+        MuxBlock(Diagram &diagram) : Block(diagram), num_mux_inputs(2) {}
 
         void Init(std::string block_name = "Mux");
         void Compute(double t) override;
-        void Render() override;
-        void Settings() override;
+        void InferSizes() override;
+        bool ComputeLanes(double t) override;
+        bool IsFoldable() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
+
+        // Number of inputs
+        int GetNumInputs();
+        void SetNumInputs(int num_inputs);
 
         // Serialization
         toml::table Serialize() override;
@@ -34,10 +38,6 @@ namespace ControlBlock
         int num_mux_inputs;
 
         std::string output_port_name_;
-
-        const float min_node_width_;
-
-        bool settings_open_;
     };
 
 } // namespace ControlBlock
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+/**
+ * @brief A diagram compiled to native code and loaded as a shared library.
+ * The code comes from CodeGenerator, with its C entry points added by
+ * CodeGenerator::ExportFunctions(). Building compiles it with the system
+ * compiler on a background thread, or loads it straight away if the same code
+ * was compiled before, so the simulation can keep going in the interpreter
+ * until the library is ready.
+ *
+ * Compiled libraries are cached by a hash of their code, in
+ * $CONTROLBLOCKS_CACHE, $XDG_CACHE_HOME/controlblocks or
+ * ~/.cache/controlblocks. The compiler and Eigen headers can be overridden
+ * with $CONTROLBLOCKS_CXX and $CONTROLBLOCKS_EIGEN_DIR.
+ *
+ */
+class NativeModel
+{
+public:
+    NativeModel();
+    ~NativeModel();
+
+    NativeModel(const NativeModel &) = delete;
+    NativeModel &operator=(const NativeModel &) = delete;
+
+    /**
+     * @brief Start building a model, and forget the previous one. This
+     * returns right away.
+     *
+     * @param source Generated code with its C entry points
+     * @param num_states Number of states the model integrates
+     * @param num_signals Total width of the signals it exchanges
+     */
+    void Build(const std::string &source, int num_states, int num_signals);
+
+    // Forget the model
+    void Reset();
+
+    // If the model is loaded and can be evaluated. This never waits.
+    bool IsReady();
+
+    // If the model could not be compiled or loaded
+    bool IsFailed();
+
+    // Wait for the build to finish, and return IsReady()
+    bool Wait();
+
+    // Description of why the build failed
+    std::string GetError();
+
+    // Compute the derivative of the states at time t. Only call these once
+    // the model is ready.
+    void Evaluate(const double *x, double *dx, double t);
+
+    // Copy the signals out of or into the model, in the order of
+    // CodeGenerator::GetSignalLayout()
+    void GetSignals(double *values);
+    void SetSignals(const double *values);
+
+    // A stable hash of the code, which names the cached library
+    static std::string Hash(const std::string &source);
+
+    static std::string CacheDirectory();
+
+    // A compiled library, shared by every model with the same code
+    struct Library;
+
+private:
+    std::shared_ptr<Library> library_;
+
+    // This model's own state in the library
+    void *instance_;
+    bool ready_;
+    int num_states_;
+    int num_signals_;
+
+    // Entry points
+    void (*destroy_)(void *);
+    void (*evaluate_)(void *, const double *, double *, double);
+    void (*get_signals_)(void *, double *);
+    void (*set_signals_)(void *, const double *);
+
+    // Look up the entry points and make an instance once the library loads
+    bool Load();
+};
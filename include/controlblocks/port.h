@@ -28,7 +28,7 @@ namespace ControlBlock
         Port(int id, std::string name, PortType type, int parent_id,
              bool is_optional = false)
             : id_(id), name_(name), type_(type), in_conn_(nullptr),
-              parent_id_(parent_id), is_optional_(is_optional)
+              parent_id_(parent_id), is_optional_(is_optional), size_(1)
         {
             // Default to be scalar 0 in case the port is optional
             val_ = Eigen::VectorXd::Zero(1);
@@ -53,20 +53,94 @@ namespace ControlBlock
         void AddConnection(std::shared_ptr<Port> p);
         void RemoveConnection(std::shared_ptr<Port> p);
         bool ConnectedInput();
+        std::shared_ptr<Port> GetConnection();
+        const std::vector<std::shared_ptr<Port>> &GetOutputConnections();
 
         // Inputs
-        Eigen::VectorXd GetValue();
+        /**
+         * @brief Get the port's value. Connected input ports read straight
+         * from the output port that drives them, so no values are copied
+         * along wires.
+         *
+         * @return const Eigen::VectorXd& The current value
+         */
+        const Eigen::VectorXd &GetValue();
         bool IsReady();
 
         // Outputs
         void Broadcast();
-        void Receive(Eigen::VectorXd val, Port &caller);
+        void Receive(Port &caller);
 
         // Port characteristics
         int GetId();
         std::string GetName();
         PortType GetType();
-        void SetValue(Eigen::VectorXd val);
+        void SetValue(const Eigen::VectorXd &val);
+
+        /**
+         * @brief Get the value buffer of an output port so a block can write
+         * its output in place. The buffer keeps its allocation between
+         * writes of the same size.
+         *
+         * @return Eigen::VectorXd& The output buffer
+         */
+        Eigen::VectorXd &GetBuffer();
+
+        /**
+         * @brief Get the width of the signal through this port. Connected
+         * input ports have the width of the output driving them.
+         *
+         * @return int Number of elements in the signal
+         */
+        int GetSize();
+
+        /**
+         * @brief Fix the width of the signal. Output ports preallocate their
+         * buffer, and unconnected input ports read zeros of this width. The
+         * value is only reset if the width changes.
+         *
+         * @param size Number of elements in the signal
+         */
+        void SetSize(int size);
+
+        /**
+         * @brief Get the Jacobian of the port's value with respect to the
+         * diagram state, used by the stiff solver. Connected input ports read
+         * the Jacobian of the output driving them.
+         *
+         * @return const Eigen::MatrixXd& Signal width by number of states
+         */
+        const Eigen::MatrixXd &GetJacobian();
+
+        /**
+         * @brief Get the Jacobian buffer of an output port so a block can
+         * write it in place. Unconnected input ports keep a zero Jacobian
+         * here.
+         *
+         * @return Eigen::MatrixXd& The Jacobian buffer
+         */
+        Eigen::MatrixXd &GetJacobianBuffer();
+
+        /**
+         * @brief Get the value of the port in every lane of an ensemble run,
+         * one column per lane. Connected input ports read the lanes of the
+         * output driving them.
+         *
+         * @return const Eigen::MatrixXd& Signal width by number of lanes
+         */
+        const Eigen::MatrixXd &GetLanes();
+
+        /**
+         * @brief Get the lane buffer of an output port so a block can write
+         * it in place. Unconnected input ports read zeros from here.
+         *
+         * @return Eigen::MatrixXd& The lane buffer
+         */
+        Eigen::MatrixXd &GetLanesBuffer();
+
+        // Size the lane buffer to the signal width and fill it with zeros
+        void ResetLanes(int num_lanes);
+
         int GetParentId();
         bool IsOptional();
 
@@ -83,13 +157,20 @@ namespace ControlBlock
 
         // Port characteristics
         std::string name_;
-        uint16_t size_;
+        int size_;
         PortType type_;
         bool is_optional_;
 
-        // Value
+        // Value. Output ports own the buffer their connections read from.
+        // Input ports only use it when they are not connected.
         Eigen::VectorXd val_;
 
+        // Jacobian of the value with respect to the diagram state
+        Eigen::MatrixXd jac_;
+
+        // Value in each lane of an ensemble run
+        Eigen::MatrixXd lanes_;
+
         // If the value is fresh
         bool ready_;
 
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "controlblocks/execution_schedule.h"
+
+/**
+ * @brief Timing of one block over a run. Times are in seconds.
+ *
+ */
+typedef struct block_profile_t
+{
+    int id;
+    std::string name;
+    size_t calls;
+    double total;
+    double min;
+    double max;
+} BlockProfile;
+
+/**
+ * @brief Timing of the simulation steps over a run. Graph time is spent
+ * computing blocks, and the rest of the step time is solver overhead.
+ *
+ */
+typedef struct step_profile_t
+{
+    size_t steps;
+    double step_time;
+    double graph_time;
+} StepProfile;
+
+/**
+ * @brief Records how long each block's Compute() takes and how each step is
+ * split between the blocks and the solver, and can save the run as a Chrome
+ * trace. The simulation records into its own buffers, and the results are
+ * copied out for other threads without making the simulation wait.
+ *
+ */
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    Profiler();
+    ~Profiler() {}
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    /**
+     * @brief Forget the previous run and track the blocks in a schedule.
+     *
+     * @param order Blocks in execution order
+     */
+    void Init(const std::vector<ControlBlock::ScheduledBlock> &order);
+
+    /**
+     * @brief Record a call to Compute().
+     *
+     * @param index Position of the block in the schedule given to Init()
+     * @param start When the call started
+     * @param end When the call returned
+     */
+    void RecordBlock(size_t index, clock::time_point start,
+                     clock::time_point end);
+
+    // Record one evaluation of the whole graph
+    void RecordGraph(clock::time_point start, clock::time_point end);
+
+    // Record one simulation step. This also publishes the results.
+    void RecordStep(clock::time_point start, clock::time_point end);
+
+    // Latest published results
+    std::vector<BlockProfile> GetBlockProfiles();
+    StepProfile GetStepProfile();
+
+    /**
+     * @brief Save the run in the Chrome trace_event format, which can be
+     * opened in chrome://tracing or Perfetto. Only call this while the
+     * simulation is stopped.
+     *
+     * @param filename File to write
+     * @return true if the file was written
+     */
+    bool WriteChromeTrace(const std::string &filename);
+
+private:
+    bool enabled_;
+
+    // Where times in the trace are measured from
+    clock::time_point epoch_;
+
+    // Block names and IDs, fixed by Init()
+    std::vector<int> ids_;
+    std::vector<std::string> names_;
+
+    // Results written by the simulation
+    std::vector<BlockProfile> blocks_;
+    StepProfile steps_;
+
+    // Copies of the results for other threads
+    std::mutex mutex_;
+    std::vector<BlockProfile> published_blocks_;
+    StepProfile published_steps_;
+
+    // Trace of every call, limited so long runs can't exhaust memory.
+    // Blocks are stored by schedule index, graph evaluations as -1 and steps
+    // as -2.
+    typedef struct trace_event_t
+    {
+        int index;
+        int64_t start_ns;
+        int64_t duration_ns;
+    } TraceEvent;
+    std::vector<TraceEvent> trace_;
+    size_t max_trace_events_;
+
+    void AddTraceEvent(int index, clock::time_point start,
+                       clock::time_point end);
+};
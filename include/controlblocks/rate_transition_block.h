@@ -0,0 +1,61 @@
+#pragma once
+
+#include <iostream>
+
+#include <Eigen/Dense>
+#include <toml++/toml.h>
+
+#include "controlblocks/block.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief Moves a signal between two rates. The block's sample time is
+     * the rate it outputs at, so it should be the slower one when going from
+     * a slow rate to a fast one. With the delay on, the output is the input
+     * of the previous sample, which keeps the value steady over each slow
+     * period and breaks the path between the rates; without it the input is
+     * passed straight through at the block's samples.
+     *
+     */
+    class RateTransitionBlock : public Block
+    {
+    public:
+        RateTransitionBlock(Diagram &diagram)
+            : Block(diagram), x0_(Eigen::VectorXd::Zero(1)), delay_(true)
+        {
+        }
+
+        void Init(std::string block_name = "Rate Transition");
+
+        void SetDelay(bool delay);
+        bool GetDelay();
+
+        // Output before the first sample when delayed
+        const Eigen::VectorXd &GetInitial();
+
+        // Overriden Block functions
+        bool ApplyInitial() override;
+        void SetInitial(Eigen::VectorXd x0) override;
+        void Compute(double t) override;
+        void ComputeOutput(double t) override;
+        void InferSizes() override;
+        bool IsDiscrete() override;
+        bool HasDirectFeedthrough() override;
+        void Update(double t, double dt) override;
+        bool GenerateCode(CodeGenerator &gen) override;
+
+        // Serialization
+        toml::table Serialize() override;
+        void Deserialize(toml::table data) override;
+
+    private:
+        // Output before the first sample when delayed. Its width is the
+        // input's.
+        Eigen::VectorXd x0_;
+
+        bool delay_;
+    };
+
+} // namespace ControlBlock
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Timing statistics of a real time run. Times are in seconds.
+ *
+ */
+typedef struct realtime_stats_t
+{
+    size_t steps = 0;
+
+    // Steps that finished after the next step should have started
+    size_t missed_deadlines = 0;
+
+    // Time from when a step should start until it finishes
+    double mean_latency = 0.0;
+    double max_latency = 0.0;
+
+    // Time from when a step should start until it does, and the standard
+    // deviation of that delay
+    double mean_wakeup = 0.0;
+    double max_wakeup = 0.0;
+    double jitter = 0.0;
+} RealTimeStats;
+
+/**
+ * @brief Schedules simulation steps against the monotonic clock, one every
+ * period, and records how well each step meets its deadline. Step k is
+ * released at start + k * period and must finish before step k + 1 is
+ * released. A late step doesn't move the schedule, so the simulation catches
+ * up rather than drifting behind the wall clock.
+ *
+ */
+class RealTimePacer
+{
+public:
+    RealTimePacer();
+    ~RealTimePacer() {}
+
+    /**
+     * @brief Release the next step now and one step every period after it.
+     * The statistics are kept.
+     *
+     * @param period Wall time between steps
+     */
+    void Start(double period);
+
+    void ResetStats();
+
+    /**
+     * @brief Get when the next step should start.
+     *
+     */
+    std::chrono::steady_clock::time_point NextRelease();
+
+    /**
+     * @brief Sleep until the next step should start.
+     *
+     */
+    void Wait();
+
+    // Call around each step to time it
+    void BeginStep();
+    void EndStep();
+
+    RealTimeStats GetStats();
+
+    /**
+     * @brief Pin the calling thread to a CPU and give it a SCHED_FIFO
+     * priority. Only supported on Linux, and raising the priority usually
+     * needs elevated privileges.
+     *
+     * @param cpu CPU to run on, or -1 to allow every CPU
+     * @param priority SCHED_FIFO priority, or 0 for normal scheduling
+     * @param errors Description of anything that could not be set
+     * @return true if everything was set
+     */
+    static bool ConfigureThread(int cpu, int priority, std::string *errors);
+
+private:
+    std::chrono::steady_clock::duration period_;
+    std::chrono::steady_clock::time_point release_;
+
+    RealTimeStats stats_;
+
+    // Running sum of squared differences from the mean wake-up delay
+    double wakeup_m2_;
+};
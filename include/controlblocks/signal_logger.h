@@ -0,0 +1,57 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controlblocks/block.h"
+#include "controlblocks/display_block.h"
+
+/**
+ * @brief Records the signals shown by the display blocks of a diagram at each
+ * timestep so they can be written to disk after a run.
+ *
+ */
+class SignalLogger
+{
+public:
+    SignalLogger() : row_size_(0) {}
+    ~SignalLogger() {}
+
+    /**
+     * @brief Select the signals to log from the blocks in a diagram.
+     *
+     * @param blocks All blocks in the diagram
+     */
+    void Init(const std::vector<std::shared_ptr<ControlBlock::Block>> &blocks);
+
+    /**
+     * @brief Save the current value of every logged signal.
+     *
+     * @param t Simulation time of the sample
+     */
+    void Record(double t);
+
+    /**
+     * @brief Write the logged samples as CSV, one row per timestep.
+     *
+     * @param filename File to write
+     * @return true if the file was written
+     */
+    bool WriteCsv(const std::string &filename);
+
+    size_t NumSamples();
+
+private:
+    std::vector<std::shared_ptr<ControlBlock::DisplayBlock>> displays_;
+
+    // Number of columns logged for each display, fixed by the first sample
+    std::vector<int> widths_;
+
+    // Samples stored row by row: time followed by each display's values
+    std::vector<double> samples_;
+    size_t row_size_;
+};
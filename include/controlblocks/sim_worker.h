@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "controlblocks/diagram.h"
+#include "controlblocks/display_block.h"
+#include "controlblocks/gui_data.h"
+#include "controlblocks/realtime_pacer.h"
+#include "controlblocks/triple_buffer.h"
+
+/**
+ * @brief Values published by the simulation thread after each step.
+ *
+ */
+typedef struct sim_snapshot_t
+{
+    double t;
+
+    // Value of each display block, in the order chosen by SimWorker::Start()
+    std::vector<Eigen::VectorXd> displays;
+} SimSnapshot;
+
+/**
+ * @brief Runs a diagram's simulation on its own thread so a slow step never
+ * holds up the GUI, and the GUI's frame rate never holds up the simulation.
+ * The controls are commands posted to the thread, and the results come back
+ * through a lock-free triple buffer.
+ *
+ * While the worker is running it owns the diagram, so the diagram must not be
+ * edited until Pause() or Stop() returns.
+ *
+ */
+class SimWorker
+{
+public:
+    SimWorker(Diagram &diagram);
+    ~SimWorker();
+
+    /**
+     * @brief Start a new run of the diagram. The diagram is initialized on
+     * the calling thread, since that reads the Python workspace, and is then
+     * handed to the worker.
+     *
+     * @param gui_data Timing and solver settings for the run
+     */
+    void Start(const GuiData &gui_data);
+
+    /**
+     * @brief Stop stepping, keeping the run so it can be resumed. Returns
+     * once the step in progress has finished.
+     *
+     */
+    void Pause();
+    void Resume();
+
+    /**
+     * @brief End the run. Returns once the step in progress has finished.
+     *
+     */
+    void Stop();
+
+    /**
+     * @brief Change how the worker paces itself. This can be called while
+     * the simulation runs.
+     *
+     * @param gui_data Pacing mode, real time factor and frame budget
+     */
+    void SetPacing(const GuiData &gui_data);
+
+    bool IsRunning();
+    bool IsPaused();
+    double GetTime();
+
+    /**
+     * @brief Get how many simulated seconds pass per wall clock second,
+     * measured since the run was last started, resumed or re-paced.
+     *
+     */
+    double GetRealTimeRatio();
+
+    /**
+     * @brief Get the deadline statistics of real time pacing since the run
+     * started.
+     *
+     */
+    RealTimeStats GetRealTimeStats();
+
+    /**
+     * @brief Pick up the latest values published by the worker. Call this
+     * once per frame before reading them. This also starts the worker's next
+     * slice of steps in frame budget mode.
+     *
+     */
+    void Refresh();
+
+    /**
+     * @brief Get the latest published value of a display block.
+     *
+     * @param block_id ID of the display block
+     * @return const Eigen::VectorXd* The value, or nullptr if nothing has been
+     * published for the block
+     */
+    const Eigen::VectorXd *GetDisplayValue(int block_id);
+
+    /**
+     * @brief Stop the run and forget the published values, such as when the
+     * diagram is cleared.
+     *
+     */
+    void ClearPublished();
+
+private:
+    Diagram &diagram_;
+
+    // Settings of the current run
+    GuiData gui_data_;
+
+    // Command state, shared with the worker under the mutex
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool run_;
+    bool busy_;
+    bool quit_;
+
+    // Pacing, shared with the worker under the mutex
+    typedef enum pacing_mode_t
+    {
+        AS_FAST_AS_POSSIBLE = 0,
+        REAL_TIME,
+        FRAME_BUDGET
+    } PacingMode;
+    PacingMode pacing_;
+    double realtime_factor_;
+    std::chrono::duration<double> frame_budget_;
+
+    // Wall and sim time that pacing is measured from
+    std::chrono::steady_clock::time_point pace_wall_start_;
+    double pace_sim_start_;
+
+    // Start of the current frame's slice, and whether it has time left
+    std::chrono::steady_clock::time_point frame_start_;
+    bool frame_ready_;
+
+    // Step schedule and statistics for real time pacing
+    RealTimePacer pacer_;
+
+    // CPU and SCHED_FIFO priority for the worker thread
+    int cpu_;
+    int priority_;
+    bool thread_config_pending_;
+
+    // Status for the GUI to read without locking
+    std::atomic<bool> running_;
+    std::atomic<bool> paused_;
+    std::atomic<double> time_;
+    std::atomic<double> realtime_ratio_;
+
+    // Published values. Only the worker writes the back of the buffer and
+    // only the GUI reads the front.
+    ControlUtils::TripleBuffer<SimSnapshot> snapshots_;
+    std::vector<std::shared_ptr<ControlBlock::DisplayBlock>> displays_;
+    std::unordered_map<int, int> display_index_;
+
+    std::thread thread_;
+
+    // Worker thread
+    void Loop();
+    void Publish();
+
+    // Wait as the pacing mode requires after a step. Called with the lock
+    // held.
+    void Pace(std::unique_lock<std::mutex> &lock);
+    bool CanStep();
+
+    // Measure pacing from now. Called with the lock held.
+    void ResetPacing();
+
+    // Block until the worker isn't in the middle of a step
+    void WaitIdle(std::unique_lock<std::mutex> &lock);
+};
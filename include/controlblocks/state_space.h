@@ -10,15 +10,64 @@ namespace ControlUtils
     class StateSpace
     {
     public:
-        StateSpace() {}
+        StateSpace() : discrete_dt_(0.0) {}
         StateSpace(Eigen::MatrixXd A, Eigen::MatrixXd B, Eigen::MatrixXd C,
                    Eigen::MatrixXd D)
-            : A_(A), B_(B), C_(C), D_(D)
+            : A_(A), B_(B), C_(C), D_(D), discrete_dt_(0.0)
         {
         }
 
-        Eigen::VectorXd UpdateDynamics(Eigen::VectorXd x, Eigen::VectorXd u);
-        Eigen::VectorXd GetOutput(Eigen::VectorXd x, Eigen::VectorXd u);
+        /**
+         * @brief Ensure A, B, C and D are consistent with each other and with
+         * an input of the given width. Throws std::runtime_error if not.
+         *
+         * @param num_inputs Width of the input, u
+         */
+        void CheckDimensions(int num_inputs);
+
+        // These do not check dimensions, so call CheckDimensions() first.
+        void UpdateDynamics(const Eigen::Ref<const Eigen::VectorXd> &x,
+                            const Eigen::Ref<const Eigen::VectorXd> &u,
+                            Eigen::Ref<Eigen::VectorXd> dx);
+        void GetOutput(const Eigen::Ref<const Eigen::VectorXd> &x,
+                       const Eigen::Ref<const Eigen::VectorXd> &u,
+                       Eigen::Ref<Eigen::VectorXd> y);
+
+        // Same as above for many lanes at once, one column per lane, so each
+        // product is a single matrix-matrix multiply.
+        void UpdateDynamicsLanes(const Eigen::Ref<const Eigen::MatrixXd> &X,
+                                 const Eigen::Ref<const Eigen::MatrixXd> &U,
+                                 Eigen::Ref<Eigen::MatrixXd> dX);
+        void GetOutputLanes(const Eigen::Ref<const Eigen::MatrixXd> &X,
+                            const Eigen::Ref<const Eigen::MatrixXd> &U,
+                            Eigen::Ref<Eigen::MatrixXd> Y);
+
+        /**
+         * @brief Compute the zero-order hold discretization of the system,
+         * Ad = exp(A dt) and Bd = integral of exp(A s) B over one step. The
+         * result is kept until dt or the matrices change.
+         *
+         * @param dt Sample time
+         */
+        void Discretize(double dt);
+
+        /**
+         * @brief Advance the state by one sample with the input held
+         * constant, x_next = Ad x + Bd u. Call Discretize() first.
+         */
+        void Advance(const Eigen::Ref<const Eigen::VectorXd> &x,
+                     const Eigen::Ref<const Eigen::VectorXd> &u,
+                     Eigen::Ref<Eigen::VectorXd> x_next);
+
+        // The discretized system from the last call to Discretize()
+        const Eigen::MatrixXd &GetDiscreteA();
+        const Eigen::MatrixXd &GetDiscreteB();
+
+        // The continuous system
+        const Eigen::MatrixXd &GetA();
+        const Eigen::MatrixXd &GetB();
+        const Eigen::MatrixXd &GetC();
+        const Eigen::MatrixXd &GetD();
 
         // Get the dimensions
         int NumInputs();
@@ -32,5 +81,10 @@ namespace ControlUtils
     private:
         // State space
         Eigen::MatrixXd A_, B_, C_, D_;
+
+        // Discretized system and the sample time it was computed for. A
+        // sample time of 0 means it hasn't been computed.
+        Eigen::MatrixXd Ad_, Bd_;
+        double discrete_dt_;
     };
 } // namespace ControlUtils
\ No newline at end of file
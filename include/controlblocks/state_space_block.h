@@ -15,30 +15,44 @@ namespace ControlBlock
     class StateSpaceBlock : public Block
     {
     public:
-        StateSpaceBlock(Diagram &diagram)
-            : Block(diagram), min_node_width_(50.0), settings_open_(true)
-        {
-        }
+        StateSpaceBlock(Diagram &diagram) : Block(diagram), zoh_(false) {}
 
         void Init(std::string block_name = "State Space");
 
         // Overriden Block functions
         bool ApplyInitial() override;
+        void SetInitial(Eigen::VectorXd x0) override;
+        std::vector<std::string> GetWorkspaceNames() override;
         void Compute(double t) override;
-        void Render() override;
-        void Settings() override;
+        void ComputeOutput(double t) override;
+        void InferSizes() override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
+        bool IsDiscrete() override;
+        bool HasDirectFeedthrough() override;
+        void Update(double t, double dt) override;
+        bool ComputeLanes(double t) override;
+        bool ComputeOutputLanes(double t) override;
+        bool GenerateCode(CodeGenerator &gen) override;
+
+        // Workspace variable names for A, B, C and D (in that order)
+        std::vector<std::string> GetMatrixNames();
+        void SetMatrixNames(const std::vector<std::string> &names);
+
+        // Exact zero-order hold mode. Instead of going through the ODE
+        // solver, the states are advanced once per sample with the
+        // discretized system, by default once per step.
+        bool GetZeroOrderHold();
+        void SetZeroOrderHold(bool zoh);
 
         // Serialization
         toml::table Serialize() override;
         void Deserialize(toml::table data) override;
 
-    private:
+    protected:
         ControlUtils::StateSpace ss;
 
-        const float min_node_width_;
-
-        bool settings_open_;
-
         // Matrices
         Eigen::MatrixXd A_;
         Eigen::MatrixXd B_;
@@ -50,6 +64,13 @@ namespace ControlBlock
         std::string B_mat_str_;
         std::string C_mat_str_;
         std::string D_mat_str_;
+
+        // Initial state. Empty, or the wrong size for A, starts at rest.
+        Eigen::VectorXd x0_;
+
+        // Zero-order hold mode, and where the next state is computed
+        bool zoh_;
+        Eigen::VectorXd x_next_;
     };
 
 } // namespace ControlBlock
@@ -14,11 +14,17 @@ namespace ControlBlock
     class SumBlock : public Block
     {
     public:
-        SumBlock(Diagram &diagram) : Block(diagram), min_node_width_(50.0) {}
+        SumBlock(Diagram &diagram) : Block(diagram), larger_input_(0) {}
 
         void Init(std::string block_name = "Sum");
         void Compute(double t) override;
-        void Render() override;
+        void InferSizes() override;
+        bool ComputeLanes(double t) override;
+        bool IsFoldable() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+        bool ComputeJacobian(int state_offset,
+                             Eigen::Ref<Eigen::MatrixXd> dfdx) override;
+        bool GetLinearSystem(ControlUtils::StateSpace *ss) override;
 
         // Serialization
         toml::table Serialize() override;
@@ -27,7 +33,8 @@ namespace ControlBlock
         std::string input1_, input2_;
         std::string output_port_name_;
 
-        const float min_node_width_;
+        // Index of the wider input, found by InferSizes()
+        int larger_input_;
     };
 
 } // namespace ControlBlock
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ControlUtils
+{
+    /**
+     * @brief A fixed set of threads for running independent tasks in
+     * parallel. The calling thread works alongside the pool, so a pool of n
+     * threads starts n - 1 of its own.
+     *
+     */
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t num_threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // Number of threads, including the caller
+        size_t NumThreads() const;
+
+        /**
+         * @brief Call task(i) for every i in [begin, end), spread over the
+         * threads, and return once all of them are done. The first exception
+         * thrown by a task is rethrown here. Only one thread may call this at
+         * a time.
+         *
+         * @param begin First index
+         * @param end One past the last index
+         * @param task Function to call with each index
+         */
+        void ParallelFor(size_t begin, size_t end,
+                         const std::function<void(size_t)> &task);
+
+    private:
+        std::vector<std::thread> workers_;
+
+        std::mutex mutex_;
+        std::condition_variable work_cv_;
+        std::condition_variable done_cv_;
+
+        // The current job. The generation changes with every job so the
+        // workers can tell a new one from the one they just finished.
+        const std::function<void(size_t)> *task_;
+        size_t end_;
+        std::atomic<size_t> next_;
+        uint64_t generation_;
+
+        // Workers still running the current job
+        size_t busy_;
+        bool quit_;
+        std::exception_ptr error_;
+
+        void WorkerLoop();
+        void RunTasks();
+    };
+} // namespace ControlUtils
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace ControlUtils
+{
+    /**
+     * @brief Hands the latest value from one producer thread to one consumer
+     * thread without locks. The producer fills the back slot and publishes it,
+     * and the consumer picks up the most recent publish, so neither ever
+     * waits on the other. Intermediate values the consumer doesn't pick up in
+     * time are dropped.
+     *
+     */
+    template <typename T> class TripleBuffer
+    {
+    public:
+        TripleBuffer() : front_(0), middle_(1), back_(2) {}
+        ~TripleBuffer() {}
+
+        /**
+         * @brief Set every slot to the same value. This allocates, so use it
+         * to size the slots before the producer starts. It is not safe to
+         * call while either thread is using the buffer.
+         *
+         * @param value Value to copy into each slot
+         */
+        void Reset(const T &value)
+        {
+            for (T &slot : slots_)
+            {
+                slot = value;
+            }
+            front_ = 0;
+            middle_.store(1);
+            back_ = 2;
+        }
+
+        // Producer side
+        T &Back() { return slots_[back_]; }
+
+        /**
+         * @brief Make the back slot available to the consumer and take over
+         * the slot it replaces.
+         *
+         */
+        void Publish()
+        {
+            uint8_t published = back_ | kFresh;
+            back_ = middle_.exchange(published, std::memory_order_acq_rel) &
+                    kIndexMask;
+        }
+
+        // Consumer side
+        const T &Front() const { return slots_[front_]; }
+
+        /**
+         * @brief Move the latest published value to the front slot.
+         *
+         * @return true if there was a new value
+         */
+        bool Consume()
+        {
+            if ((middle_.load(std::memory_order_acquire) & kFresh) == 0)
+            {
+                return false;
+            }
+            uint8_t old_front = front_;
+            front_ = middle_.exchange(old_front, std::memory_order_acq_rel) &
+                     kIndexMask;
+            return true;
+        }
+
+    private:
+        // The shared middle slot index carries a flag for unread values
+        static constexpr uint8_t kIndexMask = 0x3;
+        static constexpr uint8_t kFresh = 0x4;
+
+        T slots_[3];
+        uint8_t front_;
+        std::atomic<uint8_t> middle_;
+        uint8_t back_;
+    };
+} // namespace ControlUtils
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iostream>
+
+#include <Eigen/Dense>
+#include <toml++/toml.h>
+
+#include "controlblocks/block.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief Outputs its input from the previous sample, y[k] = u[k - 1].
+     * The output only depends on the held value, so a unit delay breaks the
+     * loops it is in. Without a sample time of its own it is sampled once
+     * per step.
+     *
+     */
+    class UnitDelayBlock : public Block
+    {
+    public:
+        UnitDelayBlock(Diagram &diagram)
+            : Block(diagram), x0_(Eigen::VectorXd::Zero(1))
+        {
+        }
+
+        void Init(std::string block_name = "Unit Delay");
+
+        // Output before the first sample
+        const Eigen::VectorXd &GetInitial();
+
+        // Overriden Block functions
+        bool ApplyInitial() override;
+        void SetInitial(Eigen::VectorXd x0) override;
+        void Compute(double t) override;
+        void ComputeOutput(double t) override;
+        void InferSizes() override;
+        bool IsDiscrete() override;
+        bool HasDirectFeedthrough() override;
+        void Update(double t, double dt) override;
+        bool GenerateCode(CodeGenerator &gen) override;
+
+        // Serialization
+        toml::table Serialize() override;
+        void Deserialize(toml::table data) override;
+
+    private:
+        // Output before the first sample. Its width is the input's.
+        Eigen::VectorXd x0_;
+    };
+
+} // namespace ControlBlock
@@ -1,9 +1,6 @@
 
 #pragma once
 
-#include "imgui.h"
-#include "imnodes.h"
-
 #include "controlblocks/port.h"
 
 class Diagram;
@@ -21,7 +18,6 @@ namespace ControlBlock
         ~Wire() {}
 
         void Init();
-        void Render();
 
         int GetId();
         int GetFromId();
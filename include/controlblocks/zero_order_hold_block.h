@@ -0,0 +1,38 @@
+#pragma once
+
+#include <iostream>
+
+#include <Eigen/Dense>
+#include <toml++/toml.h>
+
+#include "controlblocks/block.h"
+
+namespace ControlBlock
+{
+
+    /**
+     * @brief Samples its input and holds it until the next sample, which
+     * puts a continuous signal, or one at another rate, onto the block's
+     * sample time. Without a sample time of its own it is sampled once per
+     * step.
+     *
+     */
+    class ZeroOrderHoldBlock : public Block
+    {
+    public:
+        ZeroOrderHoldBlock(Diagram &diagram) : Block(diagram) {}
+
+        void Init(std::string block_name = "Zero-Order Hold");
+
+        // Overriden Block functions
+        void Compute(double t) override;
+        void InferSizes() override;
+        bool IsDiscrete() override;
+        bool GenerateCode(CodeGenerator &gen) override;
+
+        // Serialization
+        toml::table Serialize() override;
+        void Deserialize(toml::table data) override;
+    };
+
+} // namespace ControlBlock
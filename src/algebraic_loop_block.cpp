@@ -0,0 +1,329 @@
+#include "controlblocks/algebraic_loop_block.h"
+
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace ControlBlock
+{
+
+    void AlgebraicLoopBlock::SetMembers(
+        const std::vector<std::shared_ptr<Block>> &members)
+    {
+        members_.clear();
+        inputs_.clear();
+        outputs_.clear();
+        tears_.clear();
+        has_jacobian_ = false;
+        warned_ = false;
+        id_ = -1;
+        name_ = "Loop";
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            name_ += (i == 0 ? ": " : ", ") + members[i]->GetName();
+        }
+
+        // Every output in the loop is an output of this block
+        std::unordered_map<int, size_t> member_idx;
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            for (int j = 0; j < members[i]->NumOutputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = members[i]->GetOutputPort(j);
+                member_idx[port->GetId()] = i;
+                outputs_.push_back(port);
+            }
+        }
+
+        // Count what each member waits on within the loop. Inputs from
+        // outside the loop, connected or not, are this block's inputs.
+        std::vector<int> num_deps(members.size(), 0);
+        std::vector<std::vector<size_t>> consumers(members.size());
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            for (int j = 0; j < members[i]->NumInputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = members[i]->GetInputPort(j);
+                std::shared_ptr<Port> source = port->GetConnection();
+                auto iter = (source == nullptr)
+                                ? member_idx.end()
+                                : member_idx.find(source->GetId());
+                if (iter == member_idx.end())
+                {
+                    inputs_.push_back(port);
+                    continue;
+                }
+                num_deps[i]++;
+                consumers[iter->second].push_back(i);
+            }
+        }
+
+        // Order the members, and whenever none is ready, tear the loop at
+        // the inputs of the first one left. It reads the guesses for them.
+        std::vector<bool> ordered(members.size(), false);
+        std::unordered_map<int, bool> torn;
+        std::deque<size_t> ready;
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (num_deps[i] == 0)
+            {
+                ready.push_back(i);
+            }
+        }
+        while (members_.size() < members.size())
+        {
+            if (ready.empty())
+            {
+                size_t i = 0;
+                while (ordered[i])
+                {
+                    ++i;
+                }
+                for (int j = 0; j < members[i]->NumInputPorts(); ++j)
+                {
+                    std::shared_ptr<Port> source =
+                        members[i]->GetInputPort(j)->GetConnection();
+                    if (source == nullptr)
+                    {
+                        continue;
+                    }
+                    auto iter = member_idx.find(source->GetId());
+                    if (iter != member_idx.end() && !ordered[iter->second] &&
+                        !torn[source->GetId()])
+                    {
+                        torn[source->GetId()] = true;
+                        tears_.push_back(source);
+                    }
+                }
+                num_deps[i] = 0;
+                ready.push_back(i);
+            }
+
+            size_t i = ready.front();
+            ready.pop_front();
+            ordered[i] = true;
+            members_.push_back(members[i]);
+            for (size_t c : consumers[i])
+            {
+                if (--num_deps[c] == 0)
+                {
+                    ready.push_back(c);
+                }
+            }
+        }
+    }
+
+    const std::vector<std::shared_ptr<Block>> &AlgebraicLoopBlock::GetMembers()
+    {
+        return members_;
+    }
+
+    void AlgebraicLoopBlock::Compute(double t)
+    {
+        t_ = t;
+
+        // Start from the solution of the last evaluation
+        int num_tears = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            num_tears += tear->GetSize();
+        }
+        z_.resize(num_tears);
+        g_.resize(num_tears);
+        int idx = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            int size = tear->GetSize();
+            z_.segment(idx, size) = tear->GetBuffer();
+            idx += size;
+        }
+        this->Evaluate(t, z_, g_);
+        r_ = g_ - z_;
+
+        // Newton's method. A Jacobian kept from earlier steps is used until
+        // it stops halving the residual, and a singular one falls back to
+        // substituting the values back in.
+        bool fresh = false;
+        for (int i = 0; i < max_iterations_ && !this->IsConverged(); ++i)
+        {
+            if (!has_jacobian_)
+            {
+                if (!this->UpdateJacobian(t))
+                {
+                    z_ = g_;
+                    this->Evaluate(t, z_, g_);
+                    r_ = g_ - z_;
+                    continue;
+                }
+                fresh = true;
+            }
+
+            double prev_norm = r_.norm();
+            z_ -= lu_.solve(r_);
+            this->Evaluate(t, z_, g_);
+            r_ = g_ - z_;
+            if (!fresh && !(r_.norm() <= 0.5 * prev_norm))
+            {
+                has_jacobian_ = false;
+            }
+            fresh = false;
+        }
+
+        if (!this->IsConverged() && !warned_)
+        {
+            std::cout << "Algebraic loop '" << name_
+                      << "' did not converge at t = " << t << "\n";
+            warned_ = true;
+        }
+    }
+
+    void AlgebraicLoopBlock::InferSizes()
+    {
+        // Widths can depend on each other around the loop, so go around
+        // until they stop changing
+        std::vector<int> sizes(outputs_.size());
+        for (size_t pass = 0; pass <= members_.size(); ++pass)
+        {
+            for (size_t i = 0; i < outputs_.size(); ++i)
+            {
+                sizes[i] = outputs_[i]->GetSize();
+            }
+            for (std::shared_ptr<Block> member : members_)
+            {
+                member->InferSizes();
+            }
+
+            bool settled = true;
+            for (size_t i = 0; i < outputs_.size(); ++i)
+            {
+                settled = settled && sizes[i] == outputs_[i]->GetSize();
+            }
+            if (settled)
+            {
+                return;
+            }
+        }
+        throw std::runtime_error("Error: block '" + name_ +
+                                 "': signal widths around the loop keep "
+                                 "growing");
+    }
+
+    bool AlgebraicLoopBlock::ComputeJacobian(int state_offset,
+                                             Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // With the tears held fixed, the members give their Jacobians G. The
+        // tears' own Jacobians T then satisfy T = dg/dz T + G, where the
+        // Newton Jacobian is dg/dz - I.
+        if (!this->UpdateJacobian(t_))
+        {
+            return false;
+        }
+
+        int num_cols = dfdx.cols();
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            tear->GetJacobianBuffer().setZero(tear->GetSize(), num_cols);
+        }
+        for (std::shared_ptr<Block> member : members_)
+        {
+            if (!member->ComputeJacobian(state_offset, dfdx))
+            {
+                return false;
+            }
+        }
+
+        Eigen::MatrixXd G(z_.size(), num_cols);
+        int idx = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            int size = tear->GetSize();
+            G.middleRows(idx, size) = tear->GetJacobianBuffer();
+            idx += size;
+        }
+        Eigen::MatrixXd T = lu_.solve(-G);
+
+        // Go around again with the tears' Jacobians in place
+        idx = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            int size = tear->GetSize();
+            tear->GetJacobianBuffer() = T.middleRows(idx, size);
+            idx += size;
+        }
+        for (std::shared_ptr<Block> member : members_)
+        {
+            member->ComputeJacobian(state_offset, dfdx);
+        }
+        return true;
+    }
+
+    bool AlgebraicLoopBlock::IsFoldable()
+    {
+        for (std::shared_ptr<Block> member : members_)
+        {
+            if (!member->IsFoldable())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void AlgebraicLoopBlock::Evaluate(double t, const Eigen::VectorXd &z,
+                                      Eigen::VectorXd &g)
+    {
+        int idx = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            int size = tear->GetSize();
+            tear->GetBuffer() = z.segment(idx, size);
+            idx += size;
+        }
+
+        for (std::shared_ptr<Block> member : members_)
+        {
+            member->Compute(t);
+        }
+
+        idx = 0;
+        for (std::shared_ptr<Port> tear : tears_)
+        {
+            int size = tear->GetSize();
+            g.segment(idx, size) = tear->GetBuffer();
+            idx += size;
+        }
+    }
+
+    bool AlgebraicLoopBlock::UpdateJacobian(double t)
+    {
+        // Forward differences, with the step scaled to each tear
+        int n = z_.size();
+        const double eps = std::sqrt(std::numeric_limits<double>::epsilon());
+        jacobian_.resize(n, n);
+        z_step_ = z_;
+        g_step_.resize(n);
+        for (int j = 0; j < n; ++j)
+        {
+            double h = eps * std::max(1.0, std::abs(z_(j)));
+            z_step_(j) = z_(j) + h;
+            this->Evaluate(t, z_step_, g_step_);
+            jacobian_.col(j) = (g_step_ - g_) / h;
+            jacobian_(j, j) -= 1.0;
+            z_step_(j) = z_(j);
+        }
+        this->Evaluate(t, z_, g_);
+
+        lu_.compute(jacobian_);
+        has_jacobian_ = lu_.isInvertible();
+        return has_jacobian_;
+    }
+
+    bool AlgebraicLoopBlock::IsConverged()
+    {
+        return r_.norm() <= tolerance_ * (1.0 + z_.norm());
+    }
+
+} // namespace ControlBlock
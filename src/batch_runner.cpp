@@ -0,0 +1,681 @@
+#include "controlblocks/batch_runner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <sstream>
+
+#include <pybind11/embed.h>
+
+#include "controlblocks/display_block.h"
+#include "controlblocks/signal_logger.h"
+#include "controlblocks/thread_pool.h"
+
+namespace py = pybind11;
+
+// Write a value for a CSV cell. Scalars are written as they are, anything
+// larger is quoted with spaces between columns and semicolons between rows.
+static std::string FormatValue(const Eigen::MatrixXd &value)
+{
+    std::ostringstream out;
+    out.precision(10);
+    if (value.size() == 1)
+    {
+        out << value(0, 0);
+        return out.str();
+    }
+
+    out << "\"";
+    for (int i = 0; i < value.rows(); ++i)
+    {
+        for (int j = 0; j < value.cols(); ++j)
+        {
+            out << ((j > 0) ? " " : "") << value(i, j);
+        }
+        out << ((i + 1 < value.rows()) ? "; " : "");
+    }
+    out << "\"";
+    return out.str();
+}
+
+BatchRunner::BatchRunner() : samples_(1), lanes_(1), seed_(0) {}
+
+bool BatchRunner::LoadSpec(const std::string &filename, std::string *errors)
+{
+    toml::table spec;
+    try
+    {
+        spec = toml::parse_file(filename);
+    }
+    catch (const std::exception &e)
+    {
+        *errors += "Could not read " + filename + ": " + e.what() + "\n";
+        return false;
+    }
+
+    samples_ = std::max<int64_t>(1, spec["samples"].value_or(int64_t{1}));
+    lanes_ = std::max<int64_t>(1, spec["lanes"].value_or(int64_t{1}));
+    seed_ = spec["seed"].value_or(int64_t{0});
+    summary_file_ = spec["summary"].value_or("batch_summary.csv");
+    trace_dir_ = spec["traces"].value_or("");
+
+    toml::array *params_array = spec["parameters"].as_array();
+    if (params_array == nullptr)
+    {
+        return true;
+    }
+
+    bool is_success = true;
+    for (size_t i = 0; i < params_array->size(); ++i)
+    {
+        toml::table *param_tbl = params_array->at(i).as_table();
+        std::string label = "Parameter " + std::to_string(i + 1);
+        if (param_tbl == nullptr)
+        {
+            *errors += label + " is not a table\n";
+            is_success = false;
+            continue;
+        }
+
+        // Block parameters are found by block name or ID, workspace
+        // variables by their name alone
+        BatchParameter param = {"", "", {}, "", 0.0, 0.0};
+        if (toml::node *block = param_tbl->get("block"))
+        {
+            param.block = block->is_integer()
+                              ? std::to_string(block->value_or(int64_t{0}))
+                              : block->value_or(std::string(""));
+            param.name = (*param_tbl)["name"].value_or("");
+        }
+        else
+        {
+            param.name = (*param_tbl)["workspace"].value_or("");
+        }
+        if (param.name.empty())
+        {
+            *errors += label + " needs a block and name, or a workspace\n";
+            is_success = false;
+            continue;
+        }
+
+        // A list of values to try, or a distribution to draw from
+        toml::array *values = (*param_tbl)["values"].as_array();
+        toml::array *uniform = (*param_tbl)["uniform"].as_array();
+        toml::array *normal = (*param_tbl)["normal"].as_array();
+        toml::array *bounds = (uniform != nullptr) ? uniform : normal;
+        if (values != nullptr && !values->empty())
+        {
+            for (const toml::node &node : *values)
+            {
+                Eigen::MatrixXd value;
+                if (!ParseValue(node, &value))
+                {
+                    *errors += label + " has a value that is not a number, "
+                                       "vector or matrix\n";
+                    is_success = false;
+                    break;
+                }
+                param.values.push_back(value);
+            }
+        }
+        else if (bounds != nullptr && bounds->size() == 2 &&
+                 bounds->at(0).is_number() && bounds->at(1).is_number())
+        {
+            param.distribution = (uniform != nullptr) ? "uniform" : "normal";
+            param.a = bounds->at(0).value_or(0.0);
+            param.b = bounds->at(1).value_or(0.0);
+        }
+        else
+        {
+            *errors += label + " needs values, uniform = [low, high] or "
+                               "normal = [mean, std]\n";
+            is_success = false;
+            continue;
+        }
+
+        params_.push_back(param);
+    }
+
+    return is_success;
+}
+
+void BatchRunner::AddParameter(const BatchParameter &param)
+{
+    params_.push_back(param);
+}
+
+void BatchRunner::SetSamples(size_t samples)
+{
+    samples_ = std::max<size_t>(1, samples);
+}
+
+void BatchRunner::SetLanes(size_t lanes)
+{
+    lanes_ = std::max<size_t>(1, lanes);
+}
+
+void BatchRunner::SetSeed(uint64_t seed) { seed_ = seed; }
+
+void BatchRunner::SetSummaryFile(const std::string &filename)
+{
+    summary_file_ = filename;
+}
+
+void BatchRunner::SetTraceDirectory(const std::string &directory)
+{
+    trace_dir_ = directory;
+}
+
+size_t BatchRunner::NumRuns()
+{
+    size_t num_runs = samples_;
+    for (const BatchParameter &param : params_)
+    {
+        if (param.distribution.empty())
+        {
+            num_runs *= param.values.size();
+        }
+    }
+    return num_runs;
+}
+
+bool BatchRunner::Run(const std::string &diagram_file,
+                      const GuiData &sim_data, int num_threads,
+                      const std::function<void(const BatchResult &)> &on_result,
+                      std::string *errors)
+{
+    if (!std::ifstream(diagram_file).good())
+    {
+        *errors += "Could not open " + diagram_file + "\n";
+        return false;
+    }
+
+    // Load the diagram once here to check the parameters and copy the Python
+    // workspace before any runs start. Variables set by the parameters don't
+    // need to exist in Python. Every load is quiet, since reporting each
+    // block and wire would bury the results of the runs.
+    Diagram prototype;
+    prototype.SetQuiet(true);
+    prototype.LoadDiagram(diagram_file);
+    std::vector<std::vector<Eigen::MatrixXd>> runs = this->GenerateRuns();
+    if (!runs.empty() && !this->ApplyParameters(prototype, runs[0], errors))
+    {
+        return false;
+    }
+
+    // Lanes share everything but their states and block parameters
+    if (lanes_ > 1)
+    {
+        for (const BatchParameter &param : params_)
+        {
+            if (param.block.empty())
+            {
+                *errors += "Workspace variable '" + param.name +
+                           "' can't change between lanes\n";
+                return false;
+            }
+        }
+        if (!trace_dir_.empty())
+        {
+            *errors += "Traces aren't saved for runs in lanes\n";
+            return false;
+        }
+    }
+    if (!prototype.CaptureWorkspace(errors))
+    {
+        return false;
+    }
+    const std::unordered_map<std::string, Eigen::MatrixXd> &workspace =
+        prototype.GetWorkspaceVariables();
+
+    // Outputs
+    if (!trace_dir_.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(trace_dir_, error);
+        if (error)
+        {
+            *errors += "Could not create " + trace_dir_ + ": " +
+                       error.message() + "\n";
+            return false;
+        }
+    }
+    if (!summary_file_.empty())
+    {
+        summary_.open(summary_file_, std::ofstream::out | std::ofstream::trunc);
+        if (!summary_.is_open())
+        {
+            *errors += "Could not write " + summary_file_ + "\n";
+            return false;
+        }
+        this->WriteSummaryHeader(prototype);
+    }
+
+    // The runs read the copied workspace, so they start without Python and
+    // only take the GIL to report errors. With lanes, each group of runs is
+    // one ensemble.
+    size_t num_groups = (runs.size() + lanes_ - 1) / lanes_;
+    ControlUtils::ThreadPool pool(std::max(1, num_threads));
+    {
+        py::gil_scoped_release release;
+        pool.ParallelFor(
+            0, num_groups,
+            [&](size_t group)
+            {
+                size_t first = group * lanes_;
+                size_t count = std::min(lanes_, runs.size() - first);
+                std::vector<BatchResult> results(count);
+                for (size_t k = 0; k < count; ++k)
+                {
+                    results[k].index = first + k;
+                    results[k].success = false;
+                    results[k].values = runs[first + k];
+                    results[k].steps = 0;
+                    results[k].sim_time = 0.0;
+                    results[k].wall_time = 0.0;
+                }
+
+                if (lanes_ == 1)
+                {
+                    this->RunOne(diagram_file, sim_data, workspace,
+                                 results[0]);
+                }
+                else
+                {
+                    this->RunLanes(diagram_file, sim_data, workspace,
+                                   results);
+                }
+
+                std::lock_guard<std::mutex> lock(output_mutex_);
+                for (const BatchResult &result : results)
+                {
+                    this->WriteSummary(result);
+                    if (on_result)
+                    {
+                        on_result(result);
+                    }
+                }
+            });
+    }
+
+    if (summary_.is_open())
+    {
+        summary_.close();
+    }
+
+    return true;
+}
+
+std::vector<std::vector<Eigen::MatrixXd>> BatchRunner::GenerateRuns()
+{
+    size_t num_runs = this->NumRuns();
+    std::vector<std::vector<Eigen::MatrixXd>> runs(num_runs);
+
+    // Draws are made in run order from one seed, so a batch is repeatable
+    // however its runs are spread over the threads
+    std::mt19937_64 rng(seed_);
+    for (size_t r = 0; r < num_runs; ++r)
+    {
+        // The grid point is a mixed radix number, with the last parameter
+        // changing fastest
+        size_t point = r / samples_;
+        runs[r].resize(params_.size());
+        for (size_t p = params_.size(); p-- > 0;)
+        {
+            const BatchParameter &param = params_[p];
+            if (!param.distribution.empty())
+            {
+                continue;
+            }
+            runs[r][p] = param.values[point % param.values.size()];
+            point /= param.values.size();
+        }
+
+        for (size_t p = 0; p < params_.size(); ++p)
+        {
+            const BatchParameter &param = params_[p];
+            double value = 0.0;
+            if (param.distribution == "uniform")
+            {
+                value = std::uniform_real_distribution<double>(param.a,
+                                                               param.b)(rng);
+            }
+            else if (param.distribution == "normal")
+            {
+                value = std::normal_distribution<double>(param.a, param.b)(rng);
+            }
+            else
+            {
+                continue;
+            }
+            runs[r][p] = Eigen::MatrixXd::Constant(1, 1, value);
+        }
+    }
+
+    return runs;
+}
+
+void BatchRunner::RunOne(
+    const std::string &diagram_file, const GuiData &sim_data,
+    const std::unordered_map<std::string, Eigen::MatrixXd> &workspace,
+    BatchResult &result)
+{
+    auto wall_start = std::chrono::steady_clock::now();
+    try
+    {
+        Diagram diagram;
+        diagram.SetQuiet(true);
+        diagram.LoadDiagram(diagram_file);
+        for (const auto &variable : workspace)
+        {
+            diagram.SetWorkspaceVariable(variable.first, variable.second);
+        }
+        if (!this->ApplyParameters(diagram, result.values, &result.error))
+        {
+            return;
+        }
+
+        // The runs are already spread over the threads
+        GuiData run_data = sim_data;
+        run_data.sim_threads = 1;
+        run_data.profile = false;
+        diagram.Start(run_data);
+        if (!diagram.IsRunning())
+        {
+            result.error = "The diagram could not start";
+            return;
+        }
+
+        SignalLogger logger;
+        bool trace = !trace_dir_.empty();
+        if (trace)
+        {
+            logger.Init(diagram.GetBlocks());
+        }
+        while (diagram.IsRunning())
+        {
+            diagram.Step(run_data);
+            result.steps++;
+            if (trace)
+            {
+                logger.Record(diagram.GetTime());
+            }
+        }
+        result.sim_time = diagram.GetTime();
+
+        for (std::shared_ptr<ControlBlock::Block> blk : diagram.GetBlocks())
+        {
+            std::shared_ptr<ControlBlock::DisplayBlock> display =
+                std::dynamic_pointer_cast<ControlBlock::DisplayBlock>(blk);
+            if (display != nullptr)
+            {
+                result.displays.push_back(display->GetValue());
+            }
+        }
+
+        std::string trace_file =
+            (std::filesystem::path(trace_dir_) /
+             ("run_" + std::to_string(result.index) + ".csv"))
+                .string();
+        if (trace && !logger.WriteCsv(trace_file))
+        {
+            result.error = "Could not write " + trace_file;
+        }
+        result.success = result.error.empty();
+    }
+    catch (const std::exception &e)
+    {
+        result.error = e.what();
+    }
+
+    result.wall_time = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - wall_start)
+                           .count();
+}
+
+void BatchRunner::RunLanes(
+    const std::string &diagram_file, const GuiData &sim_data,
+    const std::unordered_map<std::string, Eigen::MatrixXd> &workspace,
+    std::vector<BatchResult> &results)
+{
+    auto wall_start = std::chrono::steady_clock::now();
+    size_t count = results.size();
+    std::string error = "";
+    size_t steps = 0;
+    double sim_time = 0.0;
+    try
+    {
+        Diagram diagram;
+        diagram.SetQuiet(true);
+        diagram.LoadDiagram(diagram_file);
+        for (const auto &variable : workspace)
+        {
+            diagram.SetWorkspaceVariable(variable.first, variable.second);
+        }
+
+        // Each parameter gets one column per lane
+        std::vector<Eigen::MatrixXd> lane_values(params_.size());
+        for (size_t p = 0; p < params_.size() && error.empty(); ++p)
+        {
+            int rows = results[0].values[p].rows();
+            lane_values[p].resize(rows, count);
+            for (size_t k = 0; k < count; ++k)
+            {
+                const Eigen::MatrixXd &value = results[k].values[p];
+                if (value.cols() != 1 || value.rows() != rows)
+                {
+                    error = "'" + params_[p].name +
+                            "' must be a scalar or a vector of the same size "
+                            "in every lane";
+                    break;
+                }
+                lane_values[p].col(k) = value.col(0);
+            }
+        }
+
+        GuiData run_data = sim_data;
+        run_data.sim_threads = 1;
+        run_data.profile = false;
+        bool started = false;
+        if (error.empty() &&
+            this->ApplyParameters(diagram, lane_values, &error))
+        {
+            started = diagram.StartEnsemble(run_data, count);
+        }
+        if (error.empty() && !started)
+        {
+            error = "The ensemble could not start";
+        }
+
+        while (started && diagram.IsRunning())
+        {
+            diagram.StepEnsemble(run_data);
+            steps++;
+        }
+        sim_time = diagram.GetTime();
+
+        for (std::shared_ptr<ControlBlock::Block> blk : diagram.GetBlocks())
+        {
+            std::shared_ptr<ControlBlock::DisplayBlock> display =
+                std::dynamic_pointer_cast<ControlBlock::DisplayBlock>(blk);
+            if (started && display != nullptr)
+            {
+                const Eigen::MatrixXd &lanes = display->GetLaneValues();
+                for (size_t k = 0; k < count; ++k)
+                {
+                    results[k].displays.push_back(lanes.col(k));
+                }
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+    }
+
+    // The lanes ran together, so each gets an equal share of the time
+    double wall_time = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - wall_start)
+                           .count();
+    for (BatchResult &result : results)
+    {
+        result.success = error.empty();
+        result.error = error;
+        result.steps = steps;
+        result.sim_time = sim_time;
+        result.wall_time = wall_time / count;
+    }
+}
+
+bool BatchRunner::ApplyParameters(Diagram &diagram,
+                                  const std::vector<Eigen::MatrixXd> &values,
+                                  std::string *errors)
+{
+    bool is_success = true;
+    std::vector<std::shared_ptr<ControlBlock::Block>> blocks =
+        diagram.GetBlocks();
+    for (size_t p = 0; p < params_.size(); ++p)
+    {
+        const BatchParameter &param = params_[p];
+        if (param.block.empty())
+        {
+            diagram.SetWorkspaceVariable(param.name, values[p]);
+            continue;
+        }
+
+        // Every block with the name gets the value
+        bool found = false;
+        for (std::shared_ptr<ControlBlock::Block> blk : blocks)
+        {
+            if (blk->GetName() != param.block &&
+                std::to_string(blk->GetId()) != param.block)
+            {
+                continue;
+            }
+            found = true;
+            if (!blk->SetParameter(param.name, values[p]))
+            {
+                *errors += "Block '" + param.block + "' can't set '" +
+                           param.name + "' to a " +
+                           std::to_string(values[p].rows()) + "x" +
+                           std::to_string(values[p].cols()) + " value\n";
+                is_success = false;
+            }
+        }
+        if (!found)
+        {
+            *errors += "No block named '" + param.block + "'\n";
+            is_success = false;
+        }
+    }
+    return is_success;
+}
+
+void BatchRunner::WriteSummaryHeader(Diagram &diagram)
+{
+    summary_ << "run";
+    for (const BatchParameter &param : params_)
+    {
+        summary_ << ","
+                 << (param.block.empty() ? param.name
+                                         : param.block + "." + param.name);
+    }
+    summary_ << ",success,steps,sim_time,wall_time";
+    for (std::shared_ptr<ControlBlock::Block> blk : diagram.GetBlocks())
+    {
+        if (std::dynamic_pointer_cast<ControlBlock::DisplayBlock>(blk))
+        {
+            summary_ << "," << blk->GetName();
+        }
+    }
+    summary_ << ",error\n";
+    summary_ << std::flush;
+}
+
+void BatchRunner::WriteSummary(const BatchResult &result)
+{
+    if (!summary_.is_open())
+    {
+        return;
+    }
+
+    summary_ << result.index;
+    for (const Eigen::MatrixXd &value : result.values)
+    {
+        summary_ << "," << FormatValue(value);
+    }
+    summary_ << "," << (result.success ? 1 : 0) << "," << result.steps << ","
+             << result.sim_time << "," << result.wall_time;
+    for (const Eigen::VectorXd &display : result.displays)
+    {
+        summary_ << "," << FormatValue(display);
+    }
+
+    // Keep the error in one quoted cell
+    std::string error = result.error;
+    std::replace(error.begin(), error.end(), '"', '\'');
+    std::replace(error.begin(), error.end(), '\n', ' ');
+    summary_ << ",\"" << error << "\"\n";
+
+    // Flush so the summaries can be followed while the batch runs
+    summary_ << std::flush;
+}
+
+bool BatchRunner::ParseValue(const toml::node &node, Eigen::MatrixXd *value)
+{
+    if (node.is_number())
+    {
+        *value = Eigen::MatrixXd::Constant(1, 1, node.value_or(0.0));
+        return true;
+    }
+
+    const toml::array *arr = node.as_array();
+    if (arr == nullptr || arr->empty())
+    {
+        return false;
+    }
+
+    // A list of numbers is a column vector
+    if (arr->at(0).is_number())
+    {
+        for (const toml::node &elem : *arr)
+        {
+            if (!elem.is_number())
+            {
+                return false;
+            }
+        }
+        value->resize(arr->size(), 1);
+        for (size_t i = 0; i < arr->size(); ++i)
+        {
+            (*value)(i, 0) = arr->at(i).value_or(0.0);
+        }
+        return true;
+    }
+
+    // A list of equally long lists of numbers is a matrix, one row each
+    const toml::array *first = arr->at(0).as_array();
+    if (first == nullptr || first->empty())
+    {
+        return false;
+    }
+    value->resize(arr->size(), first->size());
+    for (size_t i = 0; i < arr->size(); ++i)
+    {
+        const toml::array *row = arr->at(i).as_array();
+        if (row == nullptr || row->size() != first->size())
+        {
+            return false;
+        }
+        for (size_t j = 0; j < row->size(); ++j)
+        {
+            if (!row->at(j).is_number())
+            {
+                return false;
+            }
+            (*value)(i, j) = row->at(j).value_or(0.0);
+        }
+    }
+    return true;
+}
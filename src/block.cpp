@@ -14,8 +14,8 @@ namespace ControlBlock
         name_ = block_name;
         dynamic_sys_ = dynamic_sys;
 
-        std::cout << block_name << " created!\n";
-        std::cout << "INPUTS:\n";
+        diagram_.Log() << block_name << " created!\n";
+        diagram_.Log() << "INPUTS:\n";
 
         // Create input ports
         for (size_t i = 0; i < input_names.size(); ++i)
@@ -32,10 +32,10 @@ namespace ControlBlock
             inputs_.push_back(p);
             input_ids_.push_back(port_id);
 
-            std::cout << "- " << input_names[i] << std::endl;
+            diagram_.Log() << "- " << input_names[i] << std::endl;
         }
 
-        std::cout << "OUTPUTS:\n";
+        diagram_.Log() << "OUTPUTS:\n";
         // Create output ports
         for (size_t i = 0; i < output_names.size(); ++i)
         {
@@ -45,7 +45,7 @@ namespace ControlBlock
             outputs_.push_back(p);
             output_ids_.push_back(port_id);
 
-            std::cout << "- " << output_names[i] << std::endl;
+            diagram_.Log() << "- " << output_names[i] << std::endl;
         }
     }
 
@@ -69,43 +69,140 @@ namespace ControlBlock
 
     void Block::SetInitial(Eigen::VectorXd x0) { x_ = x0; }
 
-    void Block::Compute(double t)
+    bool Block::SetParameter(const std::string &name,
+                             const Eigen::MatrixXd &value)
+    {
+        if (name == "x0" && value.cols() == 1)
+        {
+            this->SetInitial(value.col(0));
+            return true;
+        }
+        if (name == "x0" && value.cols() > 1)
+        {
+            x0_lanes_ = value;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::string> Block::GetWorkspaceNames()
+    {
+        return std::vector<std::string>();
+    }
+
+    void Block::InferSizes()
     {
         /**
-         * @brief Implement Compute() in each sub-block to get different I/O
+         * @brief Implement this in sub-blocks whose output width depends on
+         * their inputs or parameters.
          */
-        this->Broadcast();
     }
 
-    void Block::Render()
+    bool Block::IsFoldable() { return false; }
+
+    bool Block::IsDiscrete() { return false; }
+
+    void Block::SetSampleTime(double period, double offset)
+    {
+        sample_time_.period = period;
+        sample_time_.offset = offset;
+    }
+
+    SampleTime Block::GetSampleTime() { return sample_time_; }
+
+    bool Block::HasDirectFeedthrough() { return true; }
+
+    void Block::Update(double t, double dt)
     {
         /**
-         * @brief Implement Render() in each sub-block to get different behavior
+         * @brief Implement this in sub-blocks with discrete states.
          */
     }
 
-    void Block::Settings()
+    bool Block::ComputeJacobian(int state_offset,
+                                Eigen::Ref<Eigen::MatrixXd> dfdx)
     {
         /**
-         * @brief Implement this in sub-blocks to provide a settings menu.
+         * @brief Implement this in sub-blocks that know their derivatives.
          */
+        return false;
     }
 
-    bool Block::GetDx(Eigen::VectorXd *dx)
+    bool Block::GetLinearSystem(ControlUtils::StateSpace *ss)
     {
-        // Don't mess with nullptr, and don't set dx for non-dynamical systems
-        if (dx == nullptr || !dynamic_sys_)
+        /**
+         * @brief Implement this in sub-blocks that are linear.
+         */
+        return false;
+    }
+
+    void Block::Compute(double t)
+    {
+        /**
+         * @brief Implement Compute() in each sub-block to get different I/O
+         */
+        this->Broadcast();
+    }
+
+    void Block::ComputeOutput(double t)
+    {
+        // Without direct feedthrough the outputs come out right whatever the
+        // inputs are, and the derivative is written again by Compute()
+        this->Compute(t);
+    }
+
+    Eigen::VectorXd Block::GetState() { return this->StateView(); }
+    int Block::NumStates() { return x_.size(); }
+
+    void Block::BindState(const double *x, double *dx)
+    {
+        x_view_ = x;
+        dx_view_ = dx;
+    }
+
+    Eigen::Map<const Eigen::VectorXd> Block::StateView()
+    {
+        // Before the simulation starts the block only has its initial state
+        if (x_view_ == nullptr)
         {
-            return false;
+            return Eigen::Map<const Eigen::VectorXd>(x_.data(), x_.size());
         }
+        return Eigen::Map<const Eigen::VectorXd>(x_view_, x_.size());
+    }
 
-        // Otherwise, set the pointer to dx_ and return true
-        *dx = dx_;
-        return true;
+    Eigen::Map<Eigen::VectorXd> Block::DerivativeView()
+    {
+        return Eigen::Map<Eigen::VectorXd>(dx_view_, x_.size());
     }
 
-    void Block::SetState(Eigen::VectorXd x) { x_ = x; }
-    int Block::NumStates() { return x_.size(); }
+    bool Block::ComputeLanes(double t) { return false; }
+
+    bool Block::ComputeOutputLanes(double t) { return this->ComputeLanes(t); }
+
+    bool Block::GenerateCode(CodeGenerator &gen) { return false; }
+
+    void Block::BindLanes(const double *x, double *dx, int stride,
+                          int num_lanes)
+    {
+        x_lanes_view_ = x;
+        dx_lanes_view_ = dx;
+        lane_stride_ = stride;
+        num_lanes_ = num_lanes;
+    }
+
+    const Eigen::MatrixXd &Block::GetInitialLanes() { return x0_lanes_; }
+
+    Block::ConstLanesView Block::StateLanesView()
+    {
+        return ConstLanesView(x_lanes_view_, x_.size(), num_lanes_,
+                              Eigen::OuterStride<>(lane_stride_));
+    }
+
+    Block::LanesView Block::DerivativeLanesView()
+    {
+        return LanesView(dx_lanes_view_, x_.size(), num_lanes_,
+                         Eigen::OuterStride<>(lane_stride_));
+    }
 
     toml::table Block::Serialize()
     {
@@ -126,14 +223,14 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
-        toml::table tbl =
-            toml::table{{"type", "Block"},       {"name", this->name_},
-                        {"id", this->id_},       {"inputs", input_arr},
-                        {"outputs", output_arr}, {"x_pos", pos.x},
-                        {"y_pos", pos.y},        {"dynamic_sys", dynamic_sys_}};
+        toml::table tbl = toml::table{{"type", "Block"},
+                                      {"name", this->name_},
+                                      {"id", this->id_},
+                                      {"inputs", input_arr},
+                                      {"outputs", output_arr},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
+                                      {"dynamic_sys", dynamic_sys_}};
 
         return tbl;
     }
@@ -154,8 +251,8 @@ namespace ControlBlock
             std::runtime_error("No saved ID available for loaded block");
         }
 
-        std::cout << name_ << " loaded!\n";
-        std::cout << "INPUTS:\n";
+        diagram_.Log() << name_ << " loaded!\n";
+        diagram_.Log() << "INPUTS:\n";
 
         // Load the ports
         auto input_ports = data["inputs"].as_array();
@@ -173,7 +270,7 @@ namespace ControlBlock
             }
         }
 
-        std::cout << "OUTPUTS:\n";
+        diagram_.Log() << "OUTPUTS:\n";
         // If the output ports exist, go through them and create new ports
         if (output_ports != nullptr)
         {
@@ -185,11 +282,14 @@ namespace ControlBlock
             }
         }
 
+        // Blocks saved without a sample time inherit one
+        sample_time_.period = data["sample_time"].value_or(-1.0);
+        sample_time_.offset = data["sample_offset"].value_or(0.0);
+
         // Set the block's position
-        int x_pos = data["x_pos"].value_or(0);
-        int y_pos = data["y_pos"].value_or(0);
-        ImVec2 pos(x_pos, y_pos);
-        this->SetPosition(pos);
+        float x_pos = data["x_pos"].value_or(0.0);
+        float y_pos = data["y_pos"].value_or(0.0);
+        this->SetPosition(x_pos, y_pos);
     }
 
     bool Block::IsReady()
@@ -209,18 +309,25 @@ namespace ControlBlock
 
     std::string Block::GetName() { return this->name_; }
 
+    void Block::SetName(const std::string &name) { this->name_ = name; }
+
     bool Block::IsDynamicalSystem() { return this->dynamic_sys_; }
 
-    void Block::SetPosition(ImVec2 pos)
+    void Block::SetPosition(float x, float y)
     {
-        ImNodes::SetNodeScreenSpacePos(this->id_, pos);
+        x_pos_ = x;
+        y_pos_ = y;
     }
 
+    float Block::GetX() { return x_pos_; }
+
+    float Block::GetY() { return y_pos_; }
+
     int Block::NumInputPorts() { return inputs_.size(); }
 
     std::shared_ptr<Port> Block::GetInputPort(int index)
     {
-        if (index < 0 || index > inputs_.size())
+        if (index < 0 || index >= inputs_.size())
         {
             throw std::out_of_range("Input port index " +
                                     std::to_string(index) +
@@ -232,7 +339,7 @@ namespace ControlBlock
 
     int Block::GetInputPortId(int index)
     {
-        if (index < 0 || index > inputs_.size())
+        if (index < 0 || index >= inputs_.size())
         {
             throw std::out_of_range("Input port index " +
                                     std::to_string(index) +
@@ -261,7 +368,7 @@ namespace ControlBlock
 
     std::shared_ptr<Port> Block::GetOutputPort(int index)
     {
-        if (index < 0 || index > outputs_.size())
+        if (index < 0 || index >= outputs_.size())
         {
             throw std::out_of_range("Output port index " +
                                     std::to_string(index) +
@@ -273,7 +380,7 @@ namespace ControlBlock
 
     int Block::GetOutputPortId(int index)
     {
-        if (index < 0 || index > outputs_.size())
+        if (index < 0 || index >= outputs_.size())
         {
             throw std::out_of_range("Output port index " +
                                     std::to_string(index) +
@@ -331,37 +438,42 @@ namespace ControlBlock
         }
     }
 
-    Eigen::VectorXd Block::GetInput(int port_id)
+    const Eigen::VectorXd &Block::GetInput(int index)
     {
-        // Collect the input from the correct port.
-        // Note: This does not check for duplicate port names. The first port
-        // with that name will be chosen. Any duplicates will be ignored.
-        for (size_t i = 0; i < inputs_.size(); ++i)
-        {
-            if (inputs_[i]->GetId() == port_id)
-            {
-                return inputs_[i]->GetValue();
-            }
-        }
+        // Ports are addressed by their position in the block, so this is a
+        // direct lookup. The index is not range checked since this is called
+        // on every evaluation.
+        return inputs_[index]->GetValue();
+    }
 
-        throw std::runtime_error(
-            "No input port with ID: " + std::to_string(port_id) +
-            " for block: " + this->name_);
+    void Block::SetOutput(int index, const Eigen::VectorXd &val)
+    {
+        outputs_[index]->SetValue(val);
     }
 
-    void Block::SetOutput(int port_id, Eigen::VectorXd val)
+    Eigen::VectorXd &Block::GetOutputBuffer(int index)
     {
-        // Output the value to the correct port.
-        // Note: This does not check for duplicate port names. The first port
-        // with that name will be chosen. Any duplicates will be ignored.
-        for (size_t i = 0; i < outputs_.size(); ++i)
-        {
-            if (outputs_[i]->GetId() == port_id)
-            {
-                outputs_[i]->SetValue(val);
-                break;
-            }
-        }
+        return outputs_[index]->GetBuffer();
+    }
+
+    const Eigen::MatrixXd &Block::GetInputJacobian(int index)
+    {
+        return inputs_[index]->GetJacobian();
+    }
+
+    Eigen::MatrixXd &Block::GetOutputJacobian(int index)
+    {
+        return outputs_[index]->GetJacobianBuffer();
+    }
+
+    const Eigen::MatrixXd &Block::GetInputLanes(int index)
+    {
+        return inputs_[index]->GetLanes();
+    }
+
+    Eigen::MatrixXd &Block::GetOutputLanes(int index)
+    {
+        return outputs_[index]->GetLanesBuffer();
     }
 
     void Block::LoadPort(toml::table tbl)
@@ -404,7 +516,7 @@ namespace ControlBlock
             output_ids_.push_back(port_id);
         }
 
-        std::cout << "- " << name << std::endl;
+        diagram_.Log() << "- " << name << std::endl;
     }
 
 } // namespace ControlBlock
@@ -0,0 +1,601 @@
+#include "controlblocks/code_generator.h"
+
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+// Indentation of the statements in the generated functions
+static const std::string kBodyIndent = "        ";
+
+CodeGenerator::CodeGenerator()
+    : state_offset_(-1), discrete_(false), dt_(0.0), sample_dt_(0.0)
+{
+}
+
+bool CodeGenerator::Generate(Diagram &diagram, GuiData &gui_data,
+                             const std::string &name, std::string *code,
+                             std::string *errors)
+{
+    // Starting the diagram compiles the schedule, reads the workspace and
+    // works out the width of every signal. It runs interpreted, since
+    // compiling it would generate it again.
+    GuiData run_data = gui_data;
+    run_data.native = false;
+    diagram.Start(run_data);
+    if (!diagram.IsRunning())
+    {
+        *errors += "The diagram could not start\n";
+        return false;
+    }
+
+    bool is_success = this->GenerateStarted(diagram, name, code, errors);
+    diagram.Stop();
+    return is_success;
+}
+
+bool CodeGenerator::GenerateStarted(Diagram &diagram, const std::string &name,
+                                    std::string *code, std::string *errors)
+{
+    this->Reset();
+    dt_ = diagram.tick_;
+
+    bool is_success = this->GenerateBlocks(diagram, errors);
+    if (is_success)
+    {
+        *code = this->Assemble(Identifier(name), diagram.diagram_x_,
+                               !diagram.discrete_blocks_.empty());
+    }
+
+    block_.reset();
+    return is_success;
+}
+
+std::string CodeGenerator::ExportFunctions(const std::string &name)
+{
+    std::string ns = Identifier(name);
+    int num_signals = 0;
+    std::ostringstream get_signals, set_signals;
+    for (size_t i = 0; i < layout_.size(); ++i)
+    {
+        std::string type = MatrixType(layout_[i].size, 1);
+        std::string offset = std::to_string(layout_[i].offset);
+        get_signals << "        Eigen::Map<" << type << ">(values + "
+                    << offset << ") = y." << layout_members_[i] << ";\n";
+        set_signals << "        y." << layout_members_[i]
+                    << " = Eigen::Map<const " << type << ">(values + "
+                    << offset << ");\n";
+        num_signals = layout_[i].offset + layout_[i].size;
+    }
+
+    std::ostringstream code;
+    code << "\n"
+         << "// Entry points for loading the model as a shared library. The "
+            "signals are\n"
+         << "// packed one after another in the order they are declared.\n"
+         << "extern \"C\"\n"
+         << "{\n"
+         << "    int cb_num_states() { return " << ns << "::kNumStates; }\n"
+         << "\n"
+         << "    int cb_num_signals() { return " << num_signals << "; }\n"
+         << "\n"
+         << "    void *cb_create()\n"
+         << "    {\n"
+         << "        " << ns << "::State *s = new " << ns << "::State();\n"
+         << "        " << ns << "::Initialize(*s);\n"
+         << "        return s;\n"
+         << "    }\n"
+         << "\n"
+         << "    void cb_destroy(void *s) { delete static_cast<" << ns
+         << "::State *>(s); }\n"
+         << "\n"
+         << "    void cb_evaluate(void *s, const double *x, double *dx, "
+            "double t)\n"
+         << "    {\n"
+         << "        " << ns << "::StateVector x_vec, dx_vec;\n"
+         << "        x_vec = Eigen::Map<const " << ns
+         << "::StateVector>(x);\n"
+         << "        " << ns << "::Evaluate(*static_cast<" << ns
+         << "::State *>(s), x_vec, dx_vec, t,\n"
+         << "                 false);\n"
+         << "        Eigen::Map<" << ns << "::StateVector> dx_map(dx);\n"
+         << "        dx_map = dx_vec;\n"
+         << "    }\n"
+         << "\n"
+         << "    void cb_get_signals(void *s, double *values)\n"
+         << "    {\n"
+         << "        " << ns << "::Signals &y = static_cast<" << ns
+         << "::State *>(s)->signals;\n"
+         << get_signals.str() << "    }\n"
+         << "\n"
+         << "    void cb_set_signals(void *s, const double *values)\n"
+         << "    {\n"
+         << "        " << ns << "::Signals &y = static_cast<" << ns
+         << "::State *>(s)->signals;\n"
+         << set_signals.str() << "    }\n"
+         << "}\n";
+    return code.str();
+}
+
+const std::vector<SignalSlot> &CodeGenerator::GetSignalLayout()
+{
+    return layout_;
+}
+
+bool CodeGenerator::WriteFile(Diagram &diagram, GuiData &gui_data,
+                              const std::string &filename,
+                              std::string *errors)
+{
+    std::string code = "";
+    std::string name = std::filesystem::path(filename).stem().string();
+    if (!this->Generate(diagram, gui_data, name, &code, errors))
+    {
+        return false;
+    }
+
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        *errors += "Could not write " + filename + "\n";
+        return false;
+    }
+    file << code;
+    return true;
+}
+
+std::string CodeGenerator::Input(int index)
+{
+    std::shared_ptr<ControlBlock::Port> port = block_->GetInputPort(index);
+    if (!port->ConnectedInput())
+    {
+        return MatrixType(port->GetSize(), 1) + "::Zero()";
+    }
+    return "y." + signals_[port->GetConnection()->GetId()];
+}
+
+int CodeGenerator::InputSize(int index)
+{
+    return block_->GetInputPort(index)->GetSize();
+}
+
+std::string CodeGenerator::Output(int index)
+{
+    return "y." + signals_[block_->GetOutputPort(index)->GetId()];
+}
+
+int CodeGenerator::OutputSize(int index)
+{
+    return block_->GetOutputPort(index)->GetSize();
+}
+
+std::string CodeGenerator::State()
+{
+    if (discrete_)
+    {
+        return discrete_state_;
+    }
+    return "x.segment<" + std::to_string(block_->NumStates()) + ">(" +
+           std::to_string(state_offset_) + ")";
+}
+
+std::string CodeGenerator::Derivative()
+{
+    return "dx.segment<" + std::to_string(block_->NumStates()) + ">(" +
+           std::to_string(state_offset_) + ")";
+}
+
+std::string CodeGenerator::Signal(const std::string &name, int size)
+{
+    std::string member = this->BlockPrefix() + "_" + Identifier(name);
+    signal_members_ << kBodyIndent << MatrixType(size, 1) << " " << member
+                    << ";\n";
+    initialize_ << kBodyIndent << "s.signals." << member << ".setZero();\n";
+    return "y." + member;
+}
+
+std::string CodeGenerator::Parameter(const std::string &name,
+                                     const Eigen::MatrixXd &value)
+{
+    std::string member = this->BlockPrefix() + "_" + Identifier(name);
+    parameters_ << "    const " << MatrixType(value.rows(), value.cols())
+                << " " << member << " =\n        " << Literal(value)
+                << ";\n";
+    return member;
+}
+
+std::string CodeGenerator::Number(double value)
+{
+    if (std::isnan(value))
+    {
+        return "std::numeric_limits<double>::quiet_NaN()";
+    }
+    if (std::isinf(value))
+    {
+        return std::string(value < 0.0 ? "-" : "") +
+               "std::numeric_limits<double>::infinity()";
+    }
+
+    // Use the shortest form that reads back exactly
+    std::string literal = "";
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        std::ostringstream out;
+        out << std::setprecision(precision) << value;
+        literal = out.str();
+        if (std::stod(literal) == value)
+        {
+            break;
+        }
+    }
+
+    // Keep integers from being read as ints
+    if (literal.find_first_of(".e") == std::string::npos)
+    {
+        literal += ".0";
+    }
+    return literal;
+}
+
+std::string CodeGenerator::Time() { return "t"; }
+
+double CodeGenerator::GetDt() { return discrete_ ? sample_dt_ : dt_; }
+
+void CodeGenerator::Compute(const std::string &statement)
+{
+    evaluate_ << kBodyIndent << (discrete_ ? "    " : "") << statement
+              << "\n";
+}
+
+void CodeGenerator::Update(const std::string &statement)
+{
+    update_ << kBodyIndent << statement << "\n";
+}
+
+std::string CodeGenerator::MatrixType(int rows, int cols)
+{
+    return "Eigen::Matrix<double, " + std::to_string(rows) + ", " +
+           std::to_string(cols) + ">";
+}
+
+void CodeGenerator::Reset()
+{
+    block_.reset();
+    state_offset_ = -1;
+    discrete_ = false;
+    discrete_state_ = "";
+    signals_.clear();
+    layout_.clear();
+    layout_members_.clear();
+
+    parameters_.str("");
+    signal_members_.str("");
+    state_members_.str("");
+    initialize_.str("");
+    evaluate_.str("");
+    update_.str("");
+}
+
+bool CodeGenerator::GenerateBlocks(Diagram &diagram, std::string *errors)
+{
+    // Name every output up front, since blocks can read the outputs of
+    // dynamical systems that come after them in the order. Each starts from
+    // the value it has before the first step.
+    for (std::shared_ptr<ControlBlock::Block> blk : diagram.GetBlocks())
+    {
+        for (int i = 0; i < blk->NumOutputPorts(); ++i)
+        {
+            std::shared_ptr<ControlBlock::Port> port = blk->GetOutputPort(i);
+            std::string member = Identifier(blk->GetName()) + "_" +
+                                 std::to_string(blk->GetId()) + "_" +
+                                 Identifier(port->GetName());
+            signals_[port->GetId()] = member;
+
+            int size = port->GetSize();
+            SignalSlot slot;
+            slot.port_id = port->GetId();
+            slot.offset = 0;
+            if (!layout_.empty())
+            {
+                slot.offset = layout_.back().offset + layout_.back().size;
+            }
+            slot.size = size;
+            layout_.push_back(slot);
+            layout_members_.push_back(member);
+
+            Eigen::VectorXd value = port->GetValue();
+            if (value.size() != size)
+            {
+                value = Eigen::VectorXd::Zero(size);
+            }
+            signal_members_ << kBodyIndent << MatrixType(size, 1) << " "
+                            << member << ";\n";
+            initialize_ << kBodyIndent << "s.signals." << member << " = "
+                        << Literal(value) << ";\n";
+        }
+    }
+
+    // Then let each block write its part of the evaluation, in order. The
+    // compiler folds the constant blocks itself, so they go first.
+    std::vector<ControlBlock::ScheduledBlock> entries =
+        diagram.block_schedule_.GetFolded();
+    entries.insert(entries.end(), diagram.block_schedule_.GetOrder().begin(),
+                   diagram.block_schedule_.GetOrder().end());
+    bool is_success = true;
+    for (const ControlBlock::ScheduledBlock &entry : entries)
+    {
+        block_ = entry.block;
+        discrete_ = entry.discrete;
+        state_offset_ = -1;
+        if (entry.dyn_idx >= 0)
+        {
+            state_offset_ = diagram.state_offsets_[entry.dyn_idx];
+        }
+
+        // The outputs of a system without direct feedthrough go ahead of the
+        // blocks that read them. Only its statements are kept here, since
+        // the whole block is written again once its inputs are ready, which
+        // declares everything it uses and writes the right derivative.
+        std::ostringstream held[5];
+        if (entry.output_only)
+        {
+            parameters_.swap(held[0]);
+            signal_members_.swap(held[1]);
+            state_members_.swap(held[2]);
+            initialize_.swap(held[3]);
+            update_.swap(held[4]);
+        }
+
+        // Discrete states are kept apart from the integrated ones
+        discrete_state_ = "";
+        if (discrete_ && block_->NumStates() > 0)
+        {
+            std::string member = this->BlockPrefix() + "_x";
+            discrete_state_ = "s." + member;
+            state_members_ << kBodyIndent
+                           << MatrixType(block_->NumStates(), 1) << " "
+                           << member << ";\n";
+            initialize_ << kBodyIndent << discrete_state_ << " = "
+                        << Literal(block_->GetState()) << ";\n";
+        }
+
+        // Blocks slower than the base rate are sampled on some ticks only
+        std::string hit = "";
+        sample_dt_ = entry.sample_time.period;
+        if (discrete_)
+        {
+            long long period = std::llround(sample_dt_ / dt_);
+            long long offset = std::llround(entry.sample_time.offset / dt_);
+            if (offset > 0)
+            {
+                hit = "s.tick >= " + std::to_string(offset) + " && (s.tick - " +
+                      std::to_string(offset) + ") % " +
+                      std::to_string(period) + " == 0";
+            }
+            else if (period > 1)
+            {
+                hit = "s.tick % " + std::to_string(period) + " == 0";
+            }
+        }
+
+        evaluate_ << "\n"
+                  << kBodyIndent << "// " << block_->GetName()
+                  << (entry.output_only ? " (outputs)" : "") << "\n";
+        std::ostringstream block_update;
+        if (discrete_)
+        {
+            evaluate_ << kBodyIndent << "if (sample"
+                      << (hit.empty() ? "" : " && " + hit) << ")\n"
+                      << kBodyIndent << "{\n";
+            update_.swap(block_update);
+        }
+
+        if (!block_->GenerateCode(*this) && !entry.output_only)
+        {
+            *errors += "Error: block '" + block_->GetName() +
+                       "' doesn't support code generation\n";
+            is_success = false;
+        }
+
+        if (discrete_)
+        {
+            evaluate_ << kBodyIndent << "}\n";
+            update_.swap(block_update);
+            std::string statements = block_update.str();
+            if (!statements.empty())
+            {
+                update_ << kBodyIndent << "// " << block_->GetName() << "\n";
+            }
+            if (!statements.empty() && hit.empty())
+            {
+                update_ << statements;
+            }
+            else if (!statements.empty())
+            {
+                update_ << kBodyIndent << "if (" << hit << ")\n"
+                        << kBodyIndent << "{\n";
+                std::istringstream lines(statements);
+                std::string line;
+                while (std::getline(lines, line))
+                {
+                    update_ << "    " << line << "\n";
+                }
+                update_ << kBodyIndent << "}\n";
+            }
+        }
+
+        if (entry.output_only)
+        {
+            parameters_.swap(held[0]);
+            signal_members_.swap(held[1]);
+            state_members_.swap(held[2]);
+            initialize_.swap(held[3]);
+            update_.swap(held[4]);
+        }
+    }
+
+    return is_success;
+}
+
+std::string CodeGenerator::Assemble(const std::string &name,
+                                    const Eigen::VectorXd &x0,
+                                    bool has_discrete)
+{
+    std::ostringstream code;
+    code << "// Generated by controlblocks. Do not edit.\n"
+         << "//\n"
+         << "// Call Initialize() once, then Step() every kDt seconds. The "
+            "signals at the\n"
+         << "// latest step are in State::signals.\n"
+         << "\n"
+         << "#pragma once\n"
+         << "\n"
+         << "#include <limits>\n"
+         << "\n"
+         << "#include <Eigen/Dense>\n"
+         << "\n"
+         << "namespace " << name << "\n"
+         << "{\n"
+         << "    // Timestep of Step(), in seconds\n"
+         << "    constexpr double kDt = " << Number(dt_) << ";\n"
+         << "\n"
+         << "    constexpr int kNumStates = " << x0.size() << ";\n"
+         << "    typedef Eigen::Matrix<double, kNumStates, 1> StateVector;\n";
+
+    std::string parameters = parameters_.str();
+    if (!parameters.empty())
+    {
+        code << "\n    // Parameters\n" << parameters;
+    }
+
+    code << "\n"
+         << "    struct Signals\n"
+         << "    {\n"
+         << signal_members_.str() << "\n"
+         << "        EIGEN_MAKE_ALIGNED_OPERATOR_NEW\n"
+         << "    };\n"
+         << "\n"
+         << "    struct State\n"
+         << "    {\n"
+         << "        double t;\n"
+         << (has_discrete ? "        long long tick;\n" : "") << "\n"
+         << "        // Integrated states, then the states of discrete "
+            "blocks\n"
+         << "        StateVector x;\n"
+         << state_members_.str() << "\n"
+         << "        Signals signals;\n"
+         << "\n"
+         << "        EIGEN_MAKE_ALIGNED_OPERATOR_NEW\n"
+         << "    };\n"
+         << "\n"
+         << "    // Compute every block at time t with the integrated states "
+            "x, and write\n"
+         << "    // their derivatives to dx. Discrete blocks are only "
+            "computed when sample\n"
+         << "    // is set, on the ticks they are sampled.\n"
+         << "    inline void Evaluate(State &s, const StateVector &x, "
+            "StateVector &dx,\n"
+         << "                         [[maybe_unused]] double t,\n"
+         << "                         [[maybe_unused]] bool sample)\n"
+         << "    {\n"
+         << "        Signals &y = s.signals;\n"
+         << "        dx.setZero();\n"
+         << evaluate_.str() << "    }\n"
+         << "\n"
+         << "    inline void Initialize(State &s)\n"
+         << "    {\n"
+         << "        s.t = 0.0;\n"
+         << (has_discrete ? "        s.tick = 0;\n" : "")
+         << "        s.x = " << Literal(x0) << ";\n"
+         << initialize_.str() << "    }\n"
+         << "\n"
+         << "    inline void Step(State &s)\n"
+         << "    {\n"
+         << "        StateVector k1, k2, k3, k4;\n";
+
+    if (has_discrete)
+    {
+        code << "\n"
+             << "        // Sample the discrete blocks, then advance their "
+                "states\n"
+             << "        Evaluate(s, s.x, k1, s.t, true);\n"
+             << "        {\n"
+             << "            Signals &y = s.signals;\n"
+             << "            [[maybe_unused]] double t = s.t;\n"
+             << update_.str() << "        }\n";
+    }
+
+    if (x0.size() > 0)
+    {
+        code << "\n"
+             << "        // Advance the integrated states with RK4\n"
+             << "        Evaluate(s, s.x, k1, s.t, false);\n"
+             << "        Evaluate(s, s.x + 0.5 * kDt * k1, k2, s.t + 0.5 * "
+                "kDt, false);\n"
+             << "        Evaluate(s, s.x + 0.5 * kDt * k2, k3, s.t + 0.5 * "
+                "kDt, false);\n"
+             << "        Evaluate(s, s.x + kDt * k3, k4, s.t + kDt, false);\n"
+             << "        s.x += kDt / 6.0 * (k1 + 2.0 * k2 + 2.0 * k3 + "
+                "k4);\n";
+    }
+    else
+    {
+        code << "\n"
+             << "        // Nothing to integrate, so only the signals change\n"
+             << "        Evaluate(s, s.x, k1, s.t + kDt, false);\n";
+    }
+
+    code << "        s.t += kDt;\n"
+         << (has_discrete ? "        s.tick += 1;\n" : "")
+         << "    }\n"
+         << "} // namespace " << name << "\n";
+
+    return code.str();
+}
+
+std::string CodeGenerator::BlockPrefix()
+{
+    return Identifier(block_->GetName()) + "_" +
+           std::to_string(block_->GetId());
+}
+
+std::string CodeGenerator::Identifier(const std::string &name)
+{
+    std::string identifier = name;
+    for (char &c : identifier)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+        {
+            c = '_';
+        }
+    }
+
+    // Identifiers can't start with a digit
+    if (identifier.empty() ||
+        std::isdigit(static_cast<unsigned char>(identifier[0])))
+    {
+        identifier = "b" + identifier;
+    }
+    return identifier;
+}
+
+std::string CodeGenerator::Literal(const Eigen::MatrixXd &value)
+{
+    std::string type = MatrixType(value.rows(), value.cols());
+    if (value.size() == 0 || value.isZero(0.0))
+    {
+        return type + "::Zero()";
+    }
+
+    // Eigen's comma initializer takes the elements row by row
+    std::string literal = "(" + type + "() <<";
+    for (int i = 0; i < value.rows(); ++i)
+    {
+        for (int j = 0; j < value.cols(); ++j)
+        {
+            literal += (i == 0 && j == 0) ? " " : ", ";
+            literal += Number(value(i, j));
+        }
+    }
+    return literal + ").finished()";
+}
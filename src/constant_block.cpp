@@ -1,4 +1,5 @@
 #include "controlblocks/constant_block.h"
+#include "controlblocks/code_generator.h"
 
 namespace ControlBlock
 {
@@ -17,47 +18,64 @@ namespace ControlBlock
 
     void ConstantBlock::Compute(double t)
     {
-        Eigen::VectorXd output = Eigen::VectorXd::Zero(1);
-        output(0) = val_;
-        Block::SetOutput(output_ids_[0], output);
+        // Write the value straight into the output buffer
+        Block::GetOutputBuffer(0)(0) = val_;
         Block::Broadcast();
     }
 
-    void ConstantBlock::Render()
+    void ConstantBlock::InferSizes() { outputs_[0]->SetSize(1); }
+
+    bool ConstantBlock::IsFoldable() { return true; }
+
+    bool ConstantBlock::ComputeLanes(double t)
     {
-        ImNodes::BeginNode(this->id_);
+        Eigen::MatrixXd &output = Block::GetOutputLanes(0);
+        if (lane_vals_.size() == output.cols())
+        {
+            output.row(0) = lane_vals_;
+        }
+        else
+        {
+            output.setConstant(val_);
+        }
 
-        ImGui::Spacing();
+        Block::Broadcast();
+        return true;
+    }
 
-        // Ensure the node is just as wide as the title or the minimum width.
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
+    bool ConstantBlock::GenerateCode(CodeGenerator &gen)
+    {
+        gen.Compute(gen.Output(0) + "(0) = " + CodeGenerator::Number(val_) +
+                    ";");
+        return true;
+    }
 
-        ImNodes::BeginNodeTitleBar();
+    bool ConstantBlock::ComputeJacobian(int state_offset,
+                                        Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // The value doesn't depend on the state
+        Block::GetOutputJacobian(0).setZero();
+        return true;
+    }
 
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
+    double ConstantBlock::GetValue() { return val_; }
 
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
+    void ConstantBlock::SetValue(double val) { val_ = val; }
 
-        for (size_t i = 0; i < outputs_.size(); ++i)
+    bool ConstantBlock::SetParameter(const std::string &name,
+                                     const Eigen::MatrixXd &value)
+    {
+        if (name == "value" && value.size() == 1)
         {
-            int idx = static_cast<int>(i);
-
-            ImNodes::BeginOutputAttribute(output_ids_[i]);
-            ImGui::TextUnformatted(" ");
-            ImGui::SameLine();
-            ImGui::InputScalar("", ImGuiDataType_Double, &val_, NULL);
-            ImNodes::EndOutputAttribute();
+            val_ = value(0, 0);
+            return true;
         }
-
-        // Reset item width for the next block.
-        ImGui::PopItemWidth();
-
-        ImNodes::EndNode();
+        if (name == "value" && value.rows() == 1)
+        {
+            lane_vals_ = value.row(0);
+            return true;
+        }
+        return Block::SetParameter(name, value);
     }
 
     toml::table ConstantBlock::Serialize()
@@ -75,15 +93,12 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{{"type", "ConstantBlock"},
                                       {"name", this->name_},
                                       {"id", this->id_},
                                       {"outputs", output_arr},
-                                      {"x_pos", pos.x},
-                                      {"y_pos", pos.y},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
                                       {"value", val_}};
 
         return tbl;
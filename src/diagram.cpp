@@ -1,4 +1,6 @@
 #include "controlblocks/diagram.h"
+#include "controlblocks/code_generator.h"
+#include "controlblocks/python_utils.h"
 
 #include <pybind11/embed.h>
 #include <pybind11/pybind11.h>
@@ -12,100 +14,199 @@ void Diagram::Init()
      */
 }
 
-void Diagram::Update(GuiData &gui_data)
+void Diagram::Start(GuiData &gui_data)
 {
-    // Handle GUI events
-    if (gui_data.start && !sim_running_)
-    {
-        // Set the simulation to running.
-        sim_paused_ = false;
-        sim_running_ = true;
+    // Use the latest simulation parameters
+    dt_ = gui_data.dt;
+    tf_ = gui_data.sim_time;
+    abs_tol_ = gui_data.abs_tol;
+    rel_tol_ = gui_data.rel_tol;
+    profiler_.SetEnabled(gui_data.profile);
+    num_threads_ = std::max(1, gui_data.sim_threads);
+    fuse_linear_ = gui_data.fuse_linear;
+    fold_constants_ = gui_data.fold_constants;
+    solve_loops_ = gui_data.solve_loops;
+
+    // Profiles time the blocks, so they need the interpreter
+    native_ = gui_data.native && !gui_data.profile;
+
+    // Set the simulation to running and initialize it.
+    sim_paused_ = false;
+    sim_running_ = true;
+    this->InitSim();
+}
 
-        // Reset the simulation if the simulator wasn't previously paused.
-        if (!sim_paused_)
-        {
-            this->InitSim();
-        }
+void Diagram::Step(GuiData &gui_data)
+{
+    if (sim_running_)
+    {
+        this->Compute(gui_data);
     }
-    if (gui_data.pause && sim_running_)
+}
+
+void Diagram::Pause()
+{
+    if (sim_running_)
     {
-        // Set the sim to be paused
         sim_paused_ = true;
         sim_running_ = false;
     }
-    if (gui_data.stop)
+}
+
+void Diagram::Resume()
+{
+    if (sim_paused_)
     {
-        // Stop the simulator.
-        // The next start will re-initialize the diagram.
-        sim_running_ = false;
         sim_paused_ = false;
+        sim_running_ = true;
     }
+}
 
-    // Run the simulation if it is active
-    if (sim_running_)
+void Diagram::Stop()
+{
+    // The next start will re-initialize the diagram.
+    sim_running_ = false;
+    sim_paused_ = false;
+}
+
+bool Diagram::StartEnsemble(GuiData &gui_data, int num_lanes)
+{
+    if (gui_data.solver != "RK4" && gui_data.solver != "Cash-Karp54" &&
+        gui_data.solver != "dopri5")
     {
-        // TODO: run this in separate thread with integration of dynamics
-        this->Compute(gui_data);
+        std::cout << "Ensembles need RK4, Cash-Karp54 or dopri5\n";
+        return false;
+    }
+
+    num_lanes_ = std::max(1, num_lanes);
+    this->Start(gui_data);
+    if (!sim_running_)
+    {
+        return false;
     }
-    else if (!sim_running_ && !sim_paused_)
+
+    // Every lane starts from the diagram's initial state unless a block was
+    // given an initial state for each lane
+    int num_states = diagram_x_.size();
+    ensemble_x_ = diagram_x_.replicate(1, num_lanes_);
+    ensemble_dx_ = ensemble_state_type::Zero(num_states, num_lanes_);
+    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
     {
-        // Allow simulation parameters to be changed when the simulation is
-        // stopped.
-        dt_ = gui_data.dt;
-        tf_ = gui_data.sim_time;
+        const Eigen::MatrixXd &x0 = dyn_blocks_[i]->GetInitialLanes();
+        if (state_offsets_[i] >= 0 &&
+            x0.rows() == dyn_blocks_[i]->NumStates() &&
+            x0.cols() == num_lanes_)
+        {
+            ensemble_x_.middleRows(state_offsets_[i], x0.rows()) = x0;
+        }
     }
 
-    // Show the diagram
-    auto flags = ImGuiWindowFlags_MenuBar;
-    ImGui::Begin("Block Diagram", NULL, flags);
+    // Size the lanes of every signal
+    for (std::shared_ptr<ControlBlock::Block> blk : this->GetBlocks())
+    {
+        for (int i = 0; i < blk->NumInputPorts(); ++i)
+        {
+            blk->GetInputPort(i)->ResetLanes(num_lanes_);
+        }
+        for (int i = 0; i < blk->NumOutputPorts(); ++i)
+        {
+            blk->GetOutputPort(i)->ResetLanes(num_lanes_);
+        }
+    }
 
-    this->MenuBar();
+    // Compute the lanes once so outputs that break loops start from the
+    // initial states, and folded blocks have their only update. This also
+    // checks that every block supports lanes.
+    this->BindLanes(ensemble_x_.data(), ensemble_dx_.data(), num_states);
+    bool has_lanes = true;
+    for (const ControlBlock::ScheduledBlock &entry : schedule_.GetFolded())
+    {
+        has_lanes = has_lanes && entry.block->ComputeLanes(0.0);
+    }
+    if (!has_lanes || !this->ComputeGraphLanes(0.0))
+    {
+        std::cout << "A block in the diagram doesn't support ensembles\n";
+        sim_running_ = false;
+        return false;
+    }
 
-    // Begin the diagram editor
-    ImNodes::BeginNodeEditor();
+    return true;
+}
 
-    // Allow blocks to be added to the diagram when the simulation isn't
-    // running.
+void Diagram::StepEnsemble(GuiData &gui_data)
+{
     if (!sim_running_)
     {
-        this->AddBlockPopup();
+        return;
     }
 
-    // Render the blocks in the diagram
-    this->Render();
+    if (gui_data.solver == "RK4")
+    {
+        ensemble_rk4_stepper.do_step(
+            std::bind(&Diagram::EnsembleDynamics, this, _1, _2, _3),
+            ensemble_x_, clk_.GetTime(), dt_);
+    }
+    else if (gui_data.solver == "Cash-Karp54")
+    {
+        ensemble_rkck54_stepper.do_step(
+            std::bind(&Diagram::EnsembleDynamics, this, _1, _2, _3),
+            ensemble_x_, clk_.GetTime(), dt_);
+    }
+    else if (gui_data.solver == "dopri5")
+    {
+        ensemble_rkd5_stepper.do_step(
+            std::bind(&Diagram::EnsembleDynamics, this, _1, _2, _3),
+            ensemble_x_, clk_.GetTime(), dt_);
+    }
 
-    // Determine if the window has focus
-    focus_ = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
+    clk_.Increment();
+    if (clk_.GetTime() >= tf_)
+    {
+        sim_paused_ = false;
+        sim_running_ = false;
+    }
 
-    // End the diagram editor
-    ImNodes::EndNodeEditor();
-    ImGui::End();
+    // Point the blocks back at the state they were advanced to
+    this->BindLanes(ensemble_x_.data(), ensemble_dx_.data(),
+                    ensemble_x_.rows());
+}
 
-    // Enable edits outside of the ImNodes context
-    if (!sim_running_ && !sim_paused_)
-    {
-        // Add / Remove new wires to the diagram if the simulation is not active
-        this->EditWires();
+const ensemble_state_type &Diagram::GetEnsembleState() { return ensemble_x_; }
 
-        // Remove any blocks set for deletion
-        this->DetectBlockRemoval();
+int Diagram::NumLanes() { return num_lanes_; }
 
-        // Allow blocks to have settings edited when the simulation isn't
-        // running
-        this->EditSettings();
+bool Diagram::IsRunning() { return sim_running_; }
 
-        // Allow shortcuts when sim isn't running and this is focused
-        if (focus_)
-        {
-            this->Shortcuts();
-        }
-    }
+bool Diagram::IsPaused() { return sim_paused_; }
+
+std::vector<std::shared_ptr<ControlBlock::Block>> Diagram::GetBlocks()
+{
+    std::vector<std::shared_ptr<ControlBlock::Block>> all_blocks = blocks_;
+    all_blocks.insert(all_blocks.end(), dyn_blocks_.begin(), dyn_blocks_.end());
+    return all_blocks;
+}
+
+std::vector<std::shared_ptr<ControlBlock::Wire>> Diagram::GetWires()
+{
+    return wires_;
 }
 
 double Diagram::GetTime() { return clk_.GetTime(); }
 
 double Diagram::GetDt() { return clk_.GetDt(); }
 
+Profiler &Diagram::GetProfiler() { return profiler_; }
+
+void Diagram::SetQuiet(bool quiet) { quiet_ = quiet; }
+
+std::ostream &Diagram::Log() { return quiet_ ? null_log_ : std::cout; }
+
+void Diagram::PrintError(const std::string &msg)
+{
+    py::gil_scoped_acquire acquire;
+    py::print(msg);
+}
+
 int Diagram::AddItem()
 {
     // Default behavior is to use the next available number, counting up from 0.
@@ -147,11 +248,17 @@ void Diagram::RemoveItem(int id)
     available_ids_.push_back(id);
 }
 
+void Diagram::AddPort(std::shared_ptr<ControlBlock::Port> port)
+{
+    port_index_[port->GetId()] = port;
+}
+
 void Diagram::RemovePort(int imnode_id,
                          std::shared_ptr<ControlBlock::Port> port)
 {
     // Free the ID for future use.
     RemoveItem(imnode_id);
+    port_index_.erase(imnode_id);
 
     // Go through each wire and remove if it is connected to this port ID
     for (int i = 0; i < wires_.size(); ++i)
@@ -165,20 +272,95 @@ void Diagram::RemovePort(int imnode_id,
         }
     }
 
-    // Go through each block and remove the port connection if it has one.
-    for (int i = 0; i < blocks_.size(); ++i)
+    // Remove the port from the ports on the other end of its wires.
+    if (port->GetType() == ControlBlock::PortType::INPUT_PORT)
+    {
+        std::shared_ptr<ControlBlock::Port> source = port->GetConnection();
+        if (source != nullptr)
+        {
+            source->RemoveConnection(port);
+        }
+    }
+    else
+    {
+        for (std::shared_ptr<ControlBlock::Port> dest :
+             port->GetOutputConnections())
+        {
+            dest->RemoveConnection(port);
+        }
+    }
+}
+
+void Diagram::SetWorkspaceVariable(const std::string &name,
+                                   const Eigen::MatrixXd &value)
+{
+    workspace_[name] = value;
+}
+
+void Diagram::ClearWorkspaceVariables() { workspace_.clear(); }
+
+bool Diagram::GetWorkspaceVariable(const std::string &name, std::string *msg,
+                                   Eigen::MatrixXd *var)
+{
+    auto iter = workspace_.find(name);
+    if (iter != workspace_.end())
+    {
+        *var = iter->second;
+        return true;
+    }
+
+    // Only Python needs the GIL, so diagrams with their own values can
+    // start on many threads at once
+    py::gil_scoped_acquire acquire;
+    return PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(name, msg, var);
+}
+
+bool Diagram::CaptureWorkspace(std::string *errors)
+{
+    bool is_success = true;
+    for (std::shared_ptr<ControlBlock::Block> blk : this->GetBlocks())
     {
-        blocks_[i]->RemoveConnectedPort(port);
+        for (const std::string &name : blk->GetWorkspaceNames())
+        {
+            if (workspace_.count(name) > 0)
+            {
+                continue;
+            }
+
+            Eigen::MatrixXd value;
+            std::string msg = "";
+            if (!PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(
+                    name, &msg, &value))
+            {
+                *errors += msg + "\n";
+                is_success = false;
+                continue;
+            }
+            workspace_[name] = value;
+        }
     }
+    return is_success;
+}
+
+const std::unordered_map<std::string, Eigen::MatrixXd> &
+Diagram::GetWorkspaceVariables()
+{
+    return workspace_;
 }
 
 void Diagram::AddWire(int from, int to)
 {
     // Find the ports that are connected
     std::shared_ptr<ControlBlock::Port> from_port = GetPortByImNodesId(from);
-    ControlBlock::PortType from_type = from_port->GetType();
-
     std::shared_ptr<ControlBlock::Port> to_port = GetPortByImNodesId(to);
+    if (from_port == nullptr || to_port == nullptr)
+    {
+        std::cout << "Cannot connect missing port: " << from << " -> " << to
+                  << std::endl;
+        return;
+    }
+
+    ControlBlock::PortType from_type = from_port->GetType();
     ControlBlock::PortType to_type = to_port->GetType();
 
     // Ensure the ports are different types.
@@ -200,8 +382,8 @@ void Diagram::AddWire(int from, int to)
             from_port->AddConnection(to_port);
             to_port->AddConnection(from_port);
 
-            std::cout << "Connection added: " << from_port->GetName() << " -> "
-                      << to_port->GetName() << std::endl;
+            this->Log() << "Connection added: " << from_port->GetName()
+                        << " -> " << to_port->GetName() << std::endl;
 
             // Create and initialize wire.
             std::shared_ptr<ControlBlock::Wire> wire =
@@ -245,88 +427,37 @@ void Diagram::RemoveWire(int id)
     }
 }
 
-void Diagram::DetectBlockRemoval()
-{
-    // If any blocks are selected and the user wants to delete them, then delete
-    // all selected.
-    int num_blocks_selected = ImNodes::NumSelectedNodes();
-    if (num_blocks_selected > 0 && ImGui::IsKeyReleased(SDL_SCANCODE_DELETE))
-    {
-        std::vector<int> selected_block_ids(num_blocks_selected);
-        ImNodes::GetSelectedNodes(selected_block_ids.data());
-
-        // Go through each block to delete and delete it
-        for (int i = 0; i < num_blocks_selected; ++i)
-        {
-            this->RemoveBlock(selected_block_ids[i]);
-        }
-    }
-}
-
 void Diagram::RemoveBlock(int id)
 {
     // Find the block to remove
-    for (size_t i = 0; i < blocks_.size(); ++i)
+    auto iter = block_index_.find(id);
+    if (iter == block_index_.end())
     {
-        if (blocks_[i]->GetId() == id)
-        {
-            // Disconnect all the input ports
-            for (int j = 0; j < blocks_[i]->NumInputPorts(); ++j)
-            {
-                std::shared_ptr<ControlBlock::Port> port =
-                    blocks_[i]->GetInputPort(j);
-                this->RemovePort(port->GetId(), port);
-            }
-            // Disconnect all the output ports
-            for (int j = 0; j < blocks_[i]->NumOutputPorts(); ++j)
-            {
-                std::shared_ptr<ControlBlock::Port> port =
-                    blocks_[i]->GetOutputPort(j);
-                this->RemovePort(port->GetId(), port);
-            }
-
-            // Remove the block from the blocks list
-            blocks_.erase(blocks_.begin() + i);
-
-            // Free the ID
-            this->RemoveItem(id);
-
-            // Block successfully removed, no more searching required.
-            return;
-        }
+        return;
     }
+    std::shared_ptr<ControlBlock::Block> block = iter->second;
 
-    // The block might be a dynamical system
-    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
+    // Disconnect all the input ports
+    for (int j = 0; j < block->NumInputPorts(); ++j)
     {
-        if (dyn_blocks_[i]->GetId() == id)
-        {
-            // Disconnect all the input ports
-            for (int j = 0; j < dyn_blocks_[i]->NumInputPorts(); ++j)
-            {
-                std::shared_ptr<ControlBlock::Port> port =
-                    dyn_blocks_[i]->GetInputPort(j);
-                this->RemovePort(port->GetId(), port);
-            }
-            // Disconnect all the output ports
-            for (int j = 0; j < blocks_[i]->NumOutputPorts(); ++j)
-            {
-                std::shared_ptr<ControlBlock::Port> port =
-                    dyn_blocks_[i]->GetOutputPort(j);
-                this->RemovePort(port->GetId(), port);
-            }
-
-            // Remove the block from the blocks list
-            dyn_blocks_.erase(blocks_.begin() + i);
-            dyn_block_states_.erase(dyn_block_states_.begin() + i);
+        std::shared_ptr<ControlBlock::Port> port = block->GetInputPort(j);
+        this->RemovePort(port->GetId(), port);
+    }
+    // Disconnect all the output ports
+    for (int j = 0; j < block->NumOutputPorts(); ++j)
+    {
+        std::shared_ptr<ControlBlock::Port> port = block->GetOutputPort(j);
+        this->RemovePort(port->GetId(), port);
+    }
 
-            // Free the ID
-            this->RemoveItem(id);
+    // Remove the block from its list. Dynamical systems are kept separately.
+    std::vector<std::shared_ptr<ControlBlock::Block>> &block_list =
+        block->IsDynamicalSystem() ? dyn_blocks_ : blocks_;
+    block_list.erase(std::find(block_list.begin(), block_list.end(), block));
+    this->UnindexBlock(block);
 
-            // Block successfully removed, no more searching required.
-            return;
-        }
-    }
+    // Free the ID
+    this->RemoveItem(id);
 }
 
 void Diagram::SaveDiagram(std::string filename)
@@ -336,19 +467,21 @@ void Diagram::SaveDiagram(std::string filename)
 
     // Go through each block and create a TOML array.
     toml::array blocks_array;
-    for (int i = 0; i < blocks_.size(); ++i)
+    std::vector<std::shared_ptr<ControlBlock::Block>> all_blocks =
+        this->GetBlocks();
+    for (int i = 0; i < all_blocks.size(); ++i)
     {
         // Save the ID if it is the minimum
-        if (min_id > blocks_[i]->GetId())
+        if (min_id > all_blocks[i]->GetId())
         {
-            min_id = blocks_[i]->GetId();
+            min_id = all_blocks[i]->GetId();
         }
 
-        toml::table tbl_i = blocks_[i]->Serialize();
+        toml::table tbl_i = all_blocks[i]->Serialize();
         blocks_array.push_back(tbl_i);
     }
 
-    std::cout << "Diagram serialization done\n";
+    this->Log() << "Diagram serialization done\n";
 
     toml::table diagram_table =
         toml::table{{"blocks", blocks_array}, {"min_id", min_id}};
@@ -423,6 +556,29 @@ void Diagram::LoadDiagram(std::string filename)
                 {
                     this->LoadBlock<ControlBlock::SumBlock>(*block_tbl);
                 }
+                else if (block_type == "StateSpaceBlock")
+                {
+                    this->LoadBlock<ControlBlock::StateSpaceBlock>(*block_tbl);
+                }
+                else if (block_type == "DiscreteStateSpaceBlock")
+                {
+                    this->LoadBlock<ControlBlock::DiscreteStateSpaceBlock>(
+                        *block_tbl);
+                }
+                else if (block_type == "UnitDelayBlock")
+                {
+                    this->LoadBlock<ControlBlock::UnitDelayBlock>(*block_tbl);
+                }
+                else if (block_type == "ZeroOrderHoldBlock")
+                {
+                    this->LoadBlock<ControlBlock::ZeroOrderHoldBlock>(
+                        *block_tbl);
+                }
+                else if (block_type == "RateTransitionBlock")
+                {
+                    this->LoadBlock<ControlBlock::RateTransitionBlock>(
+                        *block_tbl);
+                }
             }
         }
 
@@ -557,14 +713,17 @@ void Diagram::ClearDiagram()
 {
     // Clear everything
     this->blocks_.clear();
+    this->dyn_blocks_.clear();
+    this->state_offsets_.clear();
     this->wires_.clear();
+    this->schedule_.Clear();
+    this->block_schedule_.Clear();
+    this->fused_blocks_.clear();
+    this->fused_groups_.clear();
     this->available_ids_.clear();
+    this->block_index_.clear();
+    this->port_index_.clear();
     this->num_items_ = 0;
-
-    // Reset ImNodes
-    ImNodes::DestroyContext();
-    ImNodes::CreateContext();
-    ImNodes::StyleColorsDark();
 }
 
 void Diagram::InitSim()
@@ -581,6 +740,9 @@ void Diagram::InitSim()
     // Initialize all dynamical systems
     for (std::shared_ptr<ControlBlock::Block> dblk : dyn_blocks_)
     {
+        // Forget the state from any previous run
+        dblk->BindState(nullptr, nullptr);
+
         try
         {
             dblk->ApplyInitial();
@@ -589,455 +751,1242 @@ void Diagram::InitSim()
         {
             // Don't let the sim proceed with running.
             sim_running_ = false;
-            py::print(e.what());
+            this->PrintError(e.what());
         }
     }
-}
-
-void Diagram::Compute(GuiData &gui_data)
-{
-    // Convert the block-by-block states into one big state for integration.
-    // This is where the integration is stored when the stepper is applied as
-    // well.
-    Eigen::VectorXd diagram_x =
-        ControlUtils::StackVectors(this->dyn_block_states_);
 
-    // TODO: there's probably a nice way to do this with a map<String, odeint
-    // stepper>
-    if (gui_data.solver == "RK4")
+    // Compile the execution order now that the diagram is fixed for the run.
+    fused_blocks_.clear();
+    fused_groups_.clear();
+    schedule_.Compile(blocks_, dyn_blocks_, dt_, fold_constants_);
+    this->SolveAlgebraicLoops();
+
+    // Work out the width of every signal. Going in execution order means each
+    // block's inputs have been sized before it is reached. Folded blocks only
+    // read each other, and pruned blocks can read anything. Systems sized
+    // their outputs when they were initialized, so they are sized where
+    // their inputs are ready.
+    std::vector<ControlBlock::ScheduledBlock> sized = schedule_.GetFolded();
+    sized.insert(sized.end(), schedule_.GetOrder().begin(),
+                 schedule_.GetOrder().end());
+    sized.insert(sized.end(), schedule_.GetPruned().begin(),
+                 schedule_.GetPruned().end());
+    for (const ControlBlock::ScheduledBlock &entry : sized)
     {
-        this->rk4_stepper.do_step(
-            [this](state_type &x, state_type &dxdt, double t)
-            { return Dynamics(x, dxdt, t); },
-            diagram_x, clk_.GetTime(), dt_);
+        if (entry.output_only)
+        {
+            continue;
+        }
+        try
+        {
+            entry.block->InferSizes();
+        }
+        catch (std::exception &e)
+        {
+            // Don't let the sim proceed with running.
+            sim_running_ = false;
+            this->PrintError(e.what());
+            return;
+        }
     }
-    else if (gui_data.solver == "Cash-Karp54")
+
+    // With the sizes known, linear blocks can be fused
+    block_schedule_ = schedule_;
+    this->FuseLinearBlocks();
+    for (std::shared_ptr<ControlBlock::Block> blk : schedule_.GetUnscheduled())
     {
-        this->rkck54_stepper.do_step(
-            std::bind(&Diagram::Dynamics, this, _1, _2, _3), diagram_x,
-            clk_.GetTime(), dt_);
+        this->Log() << "Block not scheduled: " << blk->GetName() << "\n";
     }
-    else if (gui_data.solver == "dopri5")
+    discrete_blocks_.clear();
+    for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
     {
-        this->rkd5_stepper.do_step(
-            std::bind(&Diagram::Dynamics, this, _1, _2, _3), diagram_x,
-            clk_.GetTime(), dt_);
+        if (entry.discrete && !entry.output_only)
+        {
+            discrete_blocks_.push_back(entry.block);
+        }
     }
-    else
+    if (sim_running_ && !this->PlanSampleTimes())
     {
-        // If an unsupported solver is called, then do nothing.
         sim_running_ = false;
-        sim_paused_ = false;
-        std::cout << "Solver not supported\n";
     }
+    profiler_.Init(schedule_.GetOrder());
+    eval_valid_ = false;
 
-    // Time management
-    if (sim_running_ && !sim_paused_)
+    // Folded blocks only need computing once
+    if (sim_running_)
     {
-        // Increment clock for this cycle
-        clk_.Increment();
-
-        // Stop the simulation if the time limit is exceeded.
-        if (clk_.GetTime() >= tf_)
+        for (const ControlBlock::ScheduledBlock &entry : schedule_.GetFolded())
         {
-            sim_paused_ = false;
-            sim_running_ = false;
+            entry.block->Compute(0.0);
         }
     }
 
-    // Sort out the states
-    int idx = 0;
-    this->dyn_block_states_.clear();
-    for (int i = 0; i < dyn_blocks_.size(); ++i)
+    // Lay out the diagram state so each system has a fixed segment, and start
+    // the integration from each system's initial state. Discrete systems keep
+    // their own states, so they are left out with an offset of -1. The
+    // members of a fused group go next to each other.
+    state_offsets_.assign(dyn_blocks_.size(), -1);
+    fused_offsets_.assign(fused_blocks_.size(), 0);
+    int num_states = 0;
+    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
     {
-        // Get the number of states
-        int num_states_i = dyn_blocks_[i]->NumStates();
+        if (dyn_blocks_[i]->IsDiscrete() || state_offsets_[i] >= 0)
+        {
+            continue;
+        }
 
-        // Get the segment of interest from the full system state.
-        Eigen::VectorXd sub_state = diagram_x.segment(idx, num_states_i);
+        auto group = fused_groups_.find(dyn_blocks_[i]->GetId());
+        if (group == fused_groups_.end())
+        {
+            state_offsets_[i] = num_states;
+            num_states += dyn_blocks_[i]->NumStates();
+            continue;
+        }
 
-        // Increment the tracking pointer for the full state to the next unused
-        // element.
-        idx += num_states_i;
+        fused_offsets_[group->second] = num_states;
+        for (size_t j = i; j < dyn_blocks_.size(); ++j)
+        {
+            auto member = fused_groups_.find(dyn_blocks_[j]->GetId());
+            if (member != fused_groups_.end() &&
+                member->second == group->second)
+            {
+                state_offsets_[j] = num_states;
+                num_states += dyn_blocks_[j]->NumStates();
+            }
+        }
+    }
 
-        // Save the block's state
-        this->dyn_block_states_.push_back(sub_state);
+    diagram_x_.resize(num_states);
+    diagram_dx_ = state_type::Zero(num_states);
+    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
+    {
+        if (state_offsets_[i] >= 0)
+        {
+            diagram_x_.segment(state_offsets_[i],
+                               dyn_blocks_[i]->NumStates()) =
+                dyn_blocks_[i]->GetState();
+        }
     }
+    this->BindStates(diagram_x_.data(), diagram_dx_.data());
+
+    // Reset the adaptive solvers with the latest tolerances. Their first step
+    // is a guess that they will adjust to meet the tolerances.
+    rkck54_controlled_stepper = make_controlled(
+        abs_tol_, rel_tol_, runge_kutta_cash_karp54<state_type>());
+    ck54_step_ = dt_;
+    rkd5_dense_stepper = make_dense_output(abs_tol_, rel_tol_,
+                                           runge_kutta_dopri5<state_type>());
+    rkd5_dense_stepper.initialize(diagram_x_, 0.0, dt_);
+
+    stiff_x_.resize(num_states);
+    std::copy(diagram_x_.data(), diagram_x_.data() + num_states,
+              stiff_x_.begin());
+    rosenbrock4_dense_stepper = std::make_unique<dense_rosenbrock4_type>(
+        controlled_rosenbrock4_type(abs_tol_, rel_tol_));
+    rosenbrock4_dense_stepper->initialize(stiff_x_, 0.0, dt_);
+    analytic_jacobian_ = true;
+
+    this->PlanParallelLevels();
+    this->BuildNative();
 }
 
-void Diagram::ComputeGraph(double t)
+void Diagram::FuseLinearBlocks()
 {
-    // Track if no blocks are ready at all.
-    bool no_blocks_ready = false;
-
-    // Track blocks that need to be called
-    std::vector<std::shared_ptr<ControlBlock::Block>> blocks_to_call = blocks_;
+    fused_blocks_.clear();
+    fused_groups_.clear();
+    if (!fuse_linear_ || !sim_running_)
+    {
+        return;
+    }
 
-    // Add dynamical system blocks if there are any.
-    if (dyn_blocks_.size() > 0)
+    // Find the blocks that will be computed and are linear. Discrete blocks
+    // are only computed at samples, so they stay apart. A loop of linear
+    // blocks is solved exactly by fusing it rather than by iterating.
+    std::vector<std::shared_ptr<ControlBlock::Block>> linear;
+    std::unordered_map<int, size_t> linear_idx;
+    std::unordered_map<const ControlBlock::Block *, size_t> loop_idx;
+    for (size_t i = 0; i < loop_blocks_.size(); ++i)
     {
-        blocks_to_call.insert(blocks_to_call.end(), dyn_blocks_.begin(),
-                              dyn_blocks_.end());
+        loop_idx[loop_blocks_[i].get()] = i;
     }
+    ControlUtils::StateSpace ss;
+    for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
+    {
+        if (entry.discrete || entry.output_only)
+        {
+            continue;
+        }
 
-    // Empty list of blocks already called
-    std::vector<std::shared_ptr<ControlBlock::Block>> called_blocks;
+        std::vector<std::shared_ptr<ControlBlock::Block>> candidates = {
+            entry.block};
+        auto loop = loop_idx.find(entry.block.get());
+        if (loop != loop_idx.end())
+        {
+            candidates = loop_blocks_[loop->second]->GetMembers();
+        }
+        bool is_linear = true;
+        for (std::shared_ptr<ControlBlock::Block> blk : candidates)
+        {
+            is_linear = is_linear && blk->GetLinearSystem(&ss);
+        }
+        if (!is_linear)
+        {
+            continue;
+        }
+        for (std::shared_ptr<ControlBlock::Block> blk : candidates)
+        {
+            linear_idx[blk->GetId()] = linear.size();
+            linear.push_back(blk);
+        }
+    }
 
-    // Run a cycle of computation by giving each block a chance to run.
-    while (blocks_to_call.size() > 0 && !no_blocks_ready)
+    // Group the linear blocks wired to each other, by the root of each
+    // block's tree
+    std::vector<size_t> root(linear.size());
+    for (size_t i = 0; i < linear.size(); ++i)
+    {
+        root[i] = i;
+    }
+    std::function<size_t(size_t)> find = [&root, &find](size_t i)
+    { return (root[i] == i) ? i : (root[i] = find(root[i])); };
+    for (size_t i = 0; i < linear.size(); ++i)
     {
-        // // Call Compute() for all blocks that are ready that haven't been
-        // called this time cycle.
-        int i = 0;
-        while (i < blocks_to_call.size())
+        for (int j = 0; j < linear[i]->NumInputPorts(); ++j)
         {
-            // Get the block
-            std::shared_ptr<ControlBlock::Block> blk = blocks_to_call[i];
-            // std::cout << "Checking " << blk->GetName() << std::endl;
-
-            // Call Compute() if the block is ready.
-            if (blk->IsReady())
+            std::shared_ptr<ControlBlock::Port> source =
+                linear[i]->GetInputPort(j)->GetConnection();
+            if (source == nullptr)
             {
-                // If the block is a dynamical system, we need to set the state
-                // from the integration
-                if (blk->IsDynamicalSystem())
-                {
-                    // Get the index in the dynamic blocks list
-                    int idx = GetDynamicBlockIndex(blk);
-                    if (idx >= 0 && idx < dyn_block_states_.size())
-                    {
-                        // Set the state from the vector of Eigen::VectorXds
-                        blk->SetState(dyn_block_states_[idx]);
-                    }
-                }
-
-                // std::cout << "-> Running\n";
-                blk->Compute(t);
-
-                // Move the block to the called list
-                called_blocks.push_back(blk);
-
-                // std::cout << "-> Removing from queue\n";
-                // Remove this block from the queue.
-                std::vector<std::shared_ptr<ControlBlock::Block>>::iterator
-                    iter = blocks_to_call.begin() + i;
-                blocks_to_call.erase(iter);
+                continue;
             }
-            else
+            auto iter = linear_idx.find(source->GetParentId());
+            if (iter != linear_idx.end())
             {
-                // Increment the index if the block wasn't ready
-                ++i;
+                root[find(i)] = find(iter->second);
             }
         }
-        // std::cout << "All blocks run!\n";
+    }
 
-        // Ensure at least one block is ready to run (if not, then all remaining
-        // blocks are disconnected)
-        no_blocks_ready = true;
-        for (size_t i = 0; i < blocks_to_call.size(); ++i)
+    // Gather each group's members, with the dynamical systems in the order
+    // their states will be laid out
+    typedef std::vector<std::shared_ptr<ControlBlock::Block>> BlockList;
+    std::unordered_map<size_t, BlockList> groups;
+    std::vector<size_t> group_order;
+    for (std::shared_ptr<ControlBlock::Block> blk : this->GetBlocks())
+    {
+        auto iter = linear_idx.find(blk->GetId());
+        if (iter == linear_idx.end())
         {
-            if (blocks_to_call[i]->IsReady())
-            {
-                no_blocks_ready = false;
-                break;
-            }
+            continue;
+        }
+        size_t r = find(iter->second);
+        if (groups[r].empty())
+        {
+            group_order.push_back(r);
         }
+        groups[r].push_back(blk);
     }
-}
 
-void Diagram::Dynamics(const state_type &x, state_type &dxdt, const double t)
-{
-    // Compute the graph
-    this->ComputeGraph(t);
-
-    // Go through and get the update for each dynamical system block
-    std::vector<Eigen::VectorXd> dx_;
-    for (int i = 0; i < dyn_blocks_.size(); ++i)
+    for (size_t r : group_order)
     {
-        Eigen::VectorXd blk_dx;
-        if (dyn_blocks_[i]->GetDx(&blk_dx))
+        const BlockList &members = groups[r];
+        if (members.size() < 2)
+        {
+            continue;
+        }
+
+        // A path from the group through other blocks back into it would
+        // have to be computed halfway through the fused block, unless the
+        // fused block has no direct feedthrough. Systems outside the group
+        // without direct feedthrough break such paths, since their outputs
+        // are computed first.
+        std::unordered_map<int, bool> visited;
+        BlockList stack = members;
+        bool feeds_back = false;
+        while (!stack.empty() && !feeds_back)
+        {
+            std::shared_ptr<ControlBlock::Block> blk = stack.back();
+            stack.pop_back();
+            bool from_group = linear_idx.count(blk->GetId()) > 0 &&
+                              find(linear_idx[blk->GetId()]) == r;
+            for (int i = 0; i < blk->NumOutputPorts() && !feeds_back; ++i)
+            {
+                for (std::shared_ptr<ControlBlock::Port> dest :
+                     blk->GetOutputPort(i)->GetOutputConnections())
+                {
+                    auto iter = block_index_.find(dest->GetParentId());
+                    if (iter == block_index_.end())
+                    {
+                        continue;
+                    }
+                    std::shared_ptr<ControlBlock::Block> next = iter->second;
+                    auto next_idx = linear_idx.find(next->GetId());
+                    if (next_idx != linear_idx.end() &&
+                        find(next_idx->second) == r)
+                    {
+                        feeds_back = feeds_back || !from_group;
+                        continue;
+                    }
+                    bool breaks_path = next->IsDynamicalSystem() &&
+                                       !next->HasDirectFeedthrough();
+                    if (!breaks_path && !visited[next->GetId()])
+                    {
+                        visited[next->GetId()] = true;
+                        stack.push_back(next);
+                    }
+                }
+            }
+        }
+
+        std::shared_ptr<ControlBlock::FusedLinearBlock> fused =
+            std::make_shared<ControlBlock::FusedLinearBlock>(*this);
+        if (!fused->Fuse(members) ||
+            (feeds_back && fused->HasDirectFeedthrough()))
+        {
+            continue;
+        }
+        for (std::shared_ptr<ControlBlock::Block> blk : members)
         {
-            dx_.push_back(blk_dx);
+            fused_groups_[blk->GetId()] = fused_blocks_.size();
         }
+        fused_blocks_.push_back(fused);
     }
 
-    // Stack up the dx/dt vectors
-    dxdt = ControlUtils::StackVectors(dx_);
+    if (!fused_blocks_.empty())
+    {
+        this->CompileSchedule();
+    }
 }
 
-void Diagram::MenuBar()
+void Diagram::SolveAlgebraicLoops()
 {
-
-    if (ImGui::BeginMenuBar())
+    loop_blocks_.clear();
+    loop_groups_.clear();
+    const std::vector<std::vector<std::shared_ptr<ControlBlock::Block>>>
+        &loops = schedule_.GetAlgebraicLoops();
+    for (const std::vector<std::shared_ptr<ControlBlock::Block>> &members :
+         loops)
     {
-        if (ImGui::BeginMenu("File"))
+        this->Log() << "Algebraic loop:";
+        for (size_t i = 0; i < members.size(); ++i)
         {
-            // TODO: on New/Open, prompt user to save unsaved work
-            if (ImGui::MenuItem("New", "Ctrl+N", nullptr, true))
-            {
-                this->NewDiagram();
-            }
-            else if (ImGui::MenuItem("Open", "Ctrl+O", nullptr, true))
-            {
-                this->Load();
-            }
-            else if (ImGui::MenuItem("Save", "Ctrl+S", nullptr, true))
-            {
-                this->Save();
-            }
-            else if (ImGui::MenuItem("Save As..."))
-            {
-                this->SaveAs();
-            }
-
-            ImGui::EndMenu();
+            this->Log() << (i == 0 ? " " : ", ") << members[i]->GetName();
         }
+        this->Log() << (solve_loops_ ? " (solved on every evaluation)\n"
+                                     : " (not computed)\n");
+    }
+    if (!solve_loops_ || loops.empty())
+    {
+        return;
+    }
 
-        ImGui::EndMenuBar();
+    for (const std::vector<std::shared_ptr<ControlBlock::Block>> &members :
+         loops)
+    {
+        std::shared_ptr<ControlBlock::AlgebraicLoopBlock> loop =
+            std::make_shared<ControlBlock::AlgebraicLoopBlock>(*this);
+        loop->SetMembers(members);
+        for (std::shared_ptr<ControlBlock::Block> blk : members)
+        {
+            loop_groups_[blk->GetId()] = loop_blocks_.size();
+        }
+        loop_blocks_.push_back(loop);
     }
+    this->CompileSchedule();
 }
 
-void Diagram::Render()
+void Diagram::CompileSchedule()
 {
-    // Render each block according to its Render() function
-    for (size_t i = 0; i < blocks_.size(); ++i)
+    // Loops whose members were fused are solved by the fused block. A fused
+    // block with states takes the slot of its first dynamical system, where
+    // its states will start.
+    std::vector<std::shared_ptr<ControlBlock::Block>> run_blocks;
+    std::vector<bool> loop_fused(loop_blocks_.size(), false);
+    for (std::shared_ptr<ControlBlock::Block> blk : blocks_)
     {
-        blocks_[i]->Render();
+        auto loop = loop_groups_.find(blk->GetId());
+        bool is_fused = fused_groups_.count(blk->GetId()) > 0;
+        if (loop != loop_groups_.end())
+        {
+            loop_fused[loop->second] = loop_fused[loop->second] || is_fused;
+        }
+        else if (!is_fused)
+        {
+            run_blocks.push_back(blk);
+        }
     }
-
-    // Render the dynamical system blocks.
+    for (size_t i = 0; i < loop_blocks_.size(); ++i)
+    {
+        if (!loop_fused[i])
+        {
+            run_blocks.push_back(loop_blocks_[i]);
+        }
+    }
+    std::vector<std::shared_ptr<ControlBlock::Block>> run_dyn_blocks(
+        dyn_blocks_.size());
+    std::vector<bool> placed(fused_blocks_.size(), false);
     for (size_t i = 0; i < dyn_blocks_.size(); ++i)
     {
-        dyn_blocks_[i]->Render();
+        auto group = fused_groups_.find(dyn_blocks_[i]->GetId());
+        if (group == fused_groups_.end())
+        {
+            run_dyn_blocks[i] = dyn_blocks_[i];
+        }
+        else if (!placed[group->second])
+        {
+            run_dyn_blocks[i] = fused_blocks_[group->second];
+            placed[group->second] = true;
+        }
+    }
+    for (size_t i = 0; i < fused_blocks_.size(); ++i)
+    {
+        if (!placed[i])
+        {
+            run_blocks.push_back(fused_blocks_[i]);
+        }
     }
+    schedule_.Compile(run_blocks, run_dyn_blocks, dt_, fold_constants_);
+}
 
-    // Render each wire
-    for (size_t i = 0; i < wires_.size(); ++i)
+// Largest tick that both a and b are whole multiples of, to within rounding,
+// by Euclid's algorithm
+static double CommonTick(double a, double b)
+{
+    a = std::abs(a);
+    b = std::abs(b);
+    const double tol = 1e-9 * std::max(a, b);
+    while (b > tol)
     {
-        wires_[i]->Render();
+        double r = std::fmod(a, b);
+        if (b - r <= tol)
+        {
+            r = 0.0;
+        }
+        a = b;
+        b = r;
     }
+    return a;
 }
 
-void Diagram::EditWires()
+bool Diagram::PlanSampleTimes()
 {
-    // Detect wire creations
-    int start_attr, end_attr;
-    if (ImNodes::IsLinkCreated(&start_attr, &end_attr))
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    tick_ = dt_;
+    for (const ControlBlock::ScheduledBlock &entry : order)
     {
-        // Register a new wire
-        this->AddWire(start_attr, end_attr);
+        if (entry.discrete)
+        {
+            tick_ = CommonTick(tick_, entry.sample_time.period);
+            tick_ = CommonTick(tick_, entry.sample_time.offset);
+        }
     }
 
-    // Detect wire deletion
-    int link_id;
-    if (ImNodes::IsLinkDestroyed(&link_id))
+    // Sample times that aren't multiples of a common tick would need
+    // impractically many ticks
+    const double max_ticks_per_step = 1e6;
+    if (!(dt_ / tick_ <= max_ticks_per_step))
+    {
+        std::cout << "Error: the sample times and the step of " << dt_
+                  << " s don't share a base rate\n";
+        return false;
+    }
+    ticks_per_step_ = static_cast<int>(std::llround(dt_ / tick_));
+    tick_ = dt_ / ticks_per_step_;
+    if (ticks_per_step_ > 1)
     {
-        this->RemoveWire(link_id);
+        this->Log() << "Base rate: " << tick_ << " s, " << ticks_per_step_
+                    << " ticks per step\n";
     }
 
-    // Detect multiple wire deletion by user.
-    int num_wires_selected = ImNodes::NumSelectedLinks();
-    if (num_wires_selected > 0 && ImGui::IsKeyReleased(SDL_SCANCODE_DELETE))
+    sample_periods_.assign(order.size(), 0);
+    sample_offsets_.assign(order.size(), 0);
+    sample_hits_.assign(order.size(), false);
+    for (size_t i = 0; i < order.size(); ++i)
     {
-        // Get the selected wires
-        std::vector<int> selected_wires(num_wires_selected);
-        ImNodes::GetSelectedLinks(selected_wires.data());
+        if (order[i].discrete)
+        {
+            sample_periods_[i] =
+                std::llround(order[i].sample_time.period / tick_);
+            sample_offsets_[i] =
+                std::llround(order[i].sample_time.offset / tick_);
+        }
 
-        // Remove each wire
-        for (const int wire_id : selected_wires)
+        // Stateless blocks sampled after the start output zero until then,
+        // not what they held at the end of the last run
+        if (order[i].discrete && order[i].dyn_idx < 0 &&
+            sample_offsets_[i] > 0)
         {
-            this->RemoveWire(wire_id);
+            for (int j = 0; j < order[i].block->NumOutputPorts(); ++j)
+            {
+                std::shared_ptr<ControlBlock::Port> port =
+                    order[i].block->GetOutputPort(j);
+                port->SetValue(Eigen::VectorXd::Zero(port->GetSize()));
+                port->Broadcast();
+            }
         }
     }
+    num_ticks_ = 0;
+    return true;
 }
 
-void Diagram::EditSettings()
+void Diagram::PlanParallelLevels()
 {
-    for (size_t i = 0; i < blocks_.size(); ++i)
+    parallel_levels_.clear();
+    if (num_threads_ <= 1)
     {
-        blocks_[i]->Settings();
+        thread_pool_.reset();
+        return;
+    }
+    if (thread_pool_ == nullptr ||
+        thread_pool_->NumThreads() != static_cast<size_t>(num_threads_))
+    {
+        thread_pool_ = std::make_unique<ControlUtils::ThreadPool>(num_threads_);
     }
 
-    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
+    // Handing a level to the pool costs a few microseconds, so only split
+    // levels with enough work to make up for it. A block's cost is estimated
+    // by the multiply-adds of a dense state update.
+    const double min_parallel_cost = 2e4;
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    const std::vector<size_t> &levels = schedule_.GetLevels();
+    for (size_t l = 0; l + 1 < levels.size(); ++l)
     {
-        dyn_blocks_[i]->Settings();
+        double cost = 0.0;
+        for (size_t i = levels[l]; i < levels[l + 1]; ++i)
+        {
+            double num_states = order[i].block->NumStates();
+            cost += 1.0 + num_states * num_states;
+        }
+        parallel_levels_.push_back(levels[l + 1] - levels[l] > 1 &&
+                                   cost >= min_parallel_cost);
     }
 }
 
-void Diagram::Shortcuts()
+void Diagram::BuildNative()
 {
-    // Do actions from menu selections or shortcuts
-    if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
-                         SDL_SCANCODE_N))
+    native_active_ = false;
+    native_model_.Reset();
+    native_ports_.clear();
+    native_sinks_.clear();
+
+    // Discrete blocks keep their states in the blocks, so diagrams with them
+    // stay interpreted
+    if (!native_ || !sim_running_ || !discrete_blocks_.empty())
     {
-        this->NewDiagram();
+        return;
     }
-    else if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
-                              SDL_SCANCODE_O))
+
+    CodeGenerator generator;
+    std::string code = "";
+    std::string errors = "";
+    if (!generator.GenerateStarted(*this, "native_model", &code, &errors))
     {
-        this->Load();
+        this->Log() << errors << "Running the diagram interpreted\n";
+        return;
     }
-    else if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
-                              SDL_SCANCODE_S))
+    code += generator.ExportFunctions("native_model");
+
+    int num_signals = 0;
+    for (const SignalSlot &slot : generator.GetSignalLayout())
     {
-        this->Save();
+        native_ports_.push_back(port_index_[slot.port_id]);
+        num_signals = slot.offset + slot.size;
+    }
+    native_signals_.resize(num_signals);
+    for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
+    {
+        if (entry.block->NumOutputPorts() == 0)
+        {
+            native_sinks_.push_back(entry.block);
+        }
     }
+
+    native_model_.Build(code, diagram_x_.size(), num_signals);
 }
 
-void Diagram::NewDiagram()
+void Diagram::ActivateNative()
 {
-    // Clear diagram
-    this->ClearDiagram();
+    // Blocks read the outputs of dynamical systems from the last
+    // evaluation, so the compiled diagram picks up where the blocks left off
+    int idx = 0;
+    for (std::shared_ptr<ControlBlock::Port> port : native_ports_)
+    {
+        int size = port->GetSize();
+        const Eigen::VectorXd &value = port->GetValue();
+        if (value.size() == size)
+        {
+            native_signals_.segment(idx, size) = value;
+        }
+        else
+        {
+            native_signals_.segment(idx, size).setZero();
+        }
+        idx += size;
+    }
+    native_model_.SetSignals(native_signals_.data());
+    native_active_ = true;
 }
 
-void Diagram::Load()
+void Diagram::PublishNative()
 {
-    // Get the diagram to open
-    bool result = OpenFileDialog(&filename_);
+    native_model_.GetSignals(native_signals_.data());
+    int idx = 0;
+    for (std::shared_ptr<ControlBlock::Port> port : native_ports_)
+    {
+        int size = port->GetSize();
+        port->GetBuffer() = native_signals_.segment(idx, size);
+        idx += size;
+    }
 
-    // If the diagram is legit, then open it
-    if (result)
+    // Nothing reads the blocks without outputs, so they are computed here
+    // from the latest signals
+    for (std::shared_ptr<ControlBlock::Block> blk : native_sinks_)
     {
-        this->ClearDiagram();
-        this->LoadDiagram(filename_);
+        blk->Compute(clk_.GetTime());
     }
 }
 
-void Diagram::Save()
+void Diagram::Compute(GuiData &gui_data)
 {
-    // Save diagram
-    bool result = true;
-    if (filename_.empty())
+    Profiler::clock::time_point step_start;
+    if (profiler_.IsEnabled())
+    {
+        step_start = Profiler::clock::now();
+    }
+
+    // The compiled diagram takes over between steps once it is built. If it
+    // can't be built, the blocks carry on.
+    if (native_ && !native_active_ && native_model_.IsReady())
+    {
+        this->ActivateNative();
+    }
+    else if (native_ && native_model_.IsFailed())
+    {
+        std::cout << native_model_.GetError() << "\n";
+        native_ = false;
+    }
+
+    // Discrete blocks can be sampled faster than the step, so the step is
+    // taken a tick of the base rate at a time
+    for (int k = 0; k < ticks_per_step_ && sim_running_ && !sim_paused_; ++k)
     {
-        result = SaveFileDialog(&filename_);
+        this->Tick(gui_data);
     }
 
-    // Save if the filename is loaded or it was already set.
-    if (result)
+    // The stepper evaluated the blocks at intermediate states, so point them
+    // back at the state they were advanced to.
+    this->BindStates(diagram_x_.data(), diagram_dx_.data());
+    if (native_active_)
     {
-        this->SaveDiagram(filename_);
+        this->PublishNative();
+    }
+
+    if (profiler_.IsEnabled())
+    {
+        profiler_.RecordStep(step_start, Profiler::clock::now());
     }
 }
 
-void Diagram::SaveAs()
+void Diagram::Tick(GuiData &gui_data)
 {
-    // Save diagram with new name
-    bool result = SaveFileDialog(&filename_);
+    // Blocks can be edited between steps and discrete outputs change at
+    // samples, so the first evaluation of each tick computes all of them
+    eval_valid_ = false;
+
+    // Sample the discrete blocks before the continuous states are advanced.
+    // The dense solvers may have stepped past this sample with the old held
+    // outputs, so they start again from here with the new ones.
+    if (this->UpdateDiscrete())
+    {
+        this->ResetDenseStepper(gui_data.solver);
+    }
+
+    // TODO: there's probably a nice way to do this with a map<String, odeint
+    // stepper>
+    if (gui_data.solver == "RK4")
+    {
+        this->rk4_stepper.do_step(
+            [this](state_type &x, state_type &dxdt, double t)
+            { return Dynamics(x, dxdt, t); },
+            diagram_x_, clk_.GetTime(), tick_);
+    }
+    else if (gui_data.solver == "Cash-Karp54")
+    {
+        this->rkck54_stepper.do_step(
+            std::bind(&Diagram::Dynamics, this, _1, _2, _3), diagram_x_,
+            clk_.GetTime(), tick_);
+    }
+    else if (gui_data.solver == "dopri5")
+    {
+        this->rkd5_stepper.do_step(
+            std::bind(&Diagram::Dynamics, this, _1, _2, _3), diagram_x_,
+            clk_.GetTime(), tick_);
+    }
+    else if (gui_data.solver == "Cash-Karp54 (adaptive)")
+    {
+        this->StepControlledCK54();
+    }
+    else if (gui_data.solver == "dopri5 (adaptive)")
+    {
+        this->StepDenseDopri5();
+    }
+    else if (gui_data.solver == "Rosenbrock4 (stiff)")
+    {
+        this->StepDenseRosenbrock4();
+    }
+    else
+    {
+        // If an unsupported solver is called, then do nothing.
+        sim_running_ = false;
+        sim_paused_ = false;
+        std::cout << "Solver not supported\n";
+    }
 
-    // Save if the filename is loaded or it was already set.
-    if (result)
+    // Time management
+    if (sim_running_ && !sim_paused_)
     {
-        this->SaveDiagram(filename_);
+        // Increment clock for this cycle
+        clk_.Increment(tick_);
+        ++num_ticks_;
+
+        // Stop the simulation if the time limit is exceeded.
+        if (clk_.GetTime() >= tf_)
+        {
+            sim_paused_ = false;
+            sim_running_ = false;
+        }
     }
 }
 
-void Diagram::AddBlockPopup()
+void Diagram::StepControlledCK54()
 {
-    // Open the block adder popup with a right click
-    const bool block_adder_open =
-        ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) &&
-        ImNodes::IsEditorHovered() &&
-        ImGui::IsMouseClicked(ImGuiMouseButton_Right);
+    double t = clk_.GetTime();
+    double t_end = t + tick_;
 
-    if (block_adder_open && !ImGui::IsAnyItemHovered())
+    // Take as many steps as the error controller needs to reach the next
+    // sample time.
+    while (t_end - t > 1e-12 * std::max(1.0, std::abs(t_end)))
     {
-        ImGui::OpenPopup("Add Block");
+        // Shorten the step if it would pass the sample time
+        double step = ck54_step_;
+        bool shortened = (step > t_end - t);
+        if (shortened)
+        {
+            step = t_end - t;
+        }
+
+        // On success this advances x and t. Either way, step becomes the
+        // size the controller would like to try next.
+        controlled_step_result result = rkck54_controlled_stepper.try_step(
+            std::bind(&Diagram::Dynamics, this, _1, _2, _3), diagram_x_, t,
+            step);
+
+        // Don't let a step shortened to hit the sample time shrink the steps
+        // after it.
+        if (result == fail || !shortened)
+        {
+            ck54_step_ = step;
+        }
     }
 
-    // Define the Add Block popup
-    if (ImGui::BeginPopup("Add Block"))
+    // Evaluate the diagram at the sample time so the outputs match the state
+    this->Dynamics(diagram_x_, diagram_dx_, t_end);
+}
+
+void Diagram::StepDenseDopri5()
+{
+    double t_end = clk_.GetTime() + tick_;
+
+    // Let the solver take steps as large as the tolerances allow until it has
+    // passed the sample time.
+    while (rkd5_dense_stepper.current_time() < t_end)
     {
+        rkd5_dense_stepper.do_step(
+            std::bind(&Diagram::Dynamics, this, _1, _2, _3));
+    }
 
-        // Get a mouse click location
-        const ImVec2 click_pos = ImGui::GetMousePosOnOpeningCurrentPopup();
+    // Interpolate the state at the sample time, then evaluate the diagram
+    // there so the outputs match the state
+    rkd5_dense_stepper.calc_state(t_end, diagram_x_);
+    this->Dynamics(diagram_x_, diagram_dx_, t_end);
+}
+
+void Diagram::StepDenseRosenbrock4()
+{
+    double t_end = clk_.GetTime() + tick_;
 
-        // Loop through available block types
-        if (ImGui::MenuItem("Constant"))
+    // Same sampling as dopri5, but each step solves a linear system with the
+    // diagram Jacobian so stiff systems don't limit the step size.
+    if (stiff_x_.size() > 0)
+    {
+        while (rosenbrock4_dense_stepper->current_time() < t_end)
+        {
+            rosenbrock4_dense_stepper->do_step(std::make_pair(
+                std::bind(&Diagram::StiffDynamics, this, _1, _2, _3),
+                std::bind(&Diagram::StiffJacobian, this, _1, _2, _3, _4)));
+        }
+        rosenbrock4_dense_stepper->calc_state(t_end, stiff_x_);
+        std::copy(stiff_x_.begin(), stiff_x_.end(), diagram_x_.data());
+    }
+
+    this->Dynamics(diagram_x_, diagram_dx_, t_end);
+}
+
+bool Diagram::UpdateDiscrete()
+{
+    if (discrete_blocks_.empty())
+    {
+        return false;
+    }
+
+    // Find the discrete blocks sampled at this tick
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    bool any_hit = false;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        long long since_first = num_ticks_ - sample_offsets_[i];
+        sample_hits_[i] = order[i].discrete && since_first >= 0 &&
+                          since_first % sample_periods_[i] == 0;
+        any_hit = any_hit || sample_hits_[i];
+    }
+    if (!any_hit)
+    {
+        return false;
+    }
+
+    // Compute every block at the sample time, including the discrete blocks
+    // whose outputs are then held until their next sample.
+    double t = clk_.GetTime();
+    diagram_dx_.setZero();
+    this->BindStates(diagram_x_.data(), diagram_dx_.data());
+    this->ComputeGraph(t, true);
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (sample_hits_[i] && !order[i].output_only)
         {
-            // Create a constant block
-            this->AddBlock<ControlBlock::ConstantBlock>(click_pos);
+            order[i].block->Update(t, order[i].sample_time.period);
         }
-        else if (ImGui::MenuItem("Gain"))
+    }
+
+    return true;
+}
+
+void Diagram::ResetDenseStepper(const std::string &solver)
+{
+    // The other solvers end every step at the sample time
+    double t = clk_.GetTime();
+    if (solver == "dopri5 (adaptive)")
+    {
+        rkd5_dense_stepper.initialize(diagram_x_, t, dt_);
+    }
+    else if (solver == "Rosenbrock4 (stiff)")
+    {
+        std::copy(diagram_x_.data(), diagram_x_.data() + diagram_x_.size(),
+                  stiff_x_.begin());
+        rosenbrock4_dense_stepper->initialize(stiff_x_, t, dt_);
+    }
+}
+
+void Diagram::ComputeGraph(double t, bool sample, bool changed_only)
+{
+    if (profiler_.IsEnabled())
+    {
+        this->ComputeGraphProfiled(t, sample, changed_only);
+        return;
+    }
+    if (thread_pool_ != nullptr)
+    {
+        this->ComputeGraphParallel(t, sample, changed_only);
+        return;
+    }
+
+    // Run the blocks in the order compiled by InitSim(). Every block's inputs
+    // have been computed by the time it is reached.
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        // Discrete blocks hold their outputs between samples
+        if ((order[i].discrete && !(sample && sample_hits_[i])) ||
+            (changed_only && !changed_[i]))
         {
-            // Create gain block
-            this->AddBlock<ControlBlock::GainBlock>(click_pos);
+            continue;
         }
-        else if (ImGui::MenuItem("Display"))
+        this->ComputeEntry(order[i], t);
+    }
+}
+
+void Diagram::ComputeGraphProfiled(double t, bool sample, bool changed_only)
+{
+    // Same as ComputeGraph(), timing each block
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    Profiler::clock::time_point graph_start = Profiler::clock::now();
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if ((order[i].discrete && !(sample && sample_hits_[i])) ||
+            (changed_only && !changed_[i]))
         {
-            // Register new display block
-            this->AddBlock<ControlBlock::DisplayBlock>(click_pos);
+            continue;
         }
-        else if (ImGui::MenuItem("Sum"))
+
+        Profiler::clock::time_point start = Profiler::clock::now();
+        this->ComputeEntry(order[i], t);
+        profiler_.RecordBlock(i, start, Profiler::clock::now());
+    }
+    profiler_.RecordGraph(graph_start, Profiler::clock::now());
+}
+
+void Diagram::ComputeGraphParallel(double t, bool sample, bool changed_only)
+{
+    // Same as ComputeGraph(), a level at a time. The blocks in a level only
+    // read outputs from earlier levels, so they can run on any thread.
+    const std::vector<ControlBlock::ScheduledBlock> &order =
+        schedule_.GetOrder();
+    const std::vector<bool> &changed = changed_;
+    const std::vector<bool> &hits = sample_hits_;
+    std::function<void(size_t)> compute =
+        [&order, &changed, &hits, t, sample, changed_only](size_t i)
+    {
+        if ((!order[i].discrete || (sample && hits[i])) &&
+            (!changed_only || changed[i]))
         {
-            this->AddBlock<ControlBlock::SumBlock>(click_pos);
+            ComputeEntry(order[i], t);
         }
-        else if (ImGui::MenuItem("Mux"))
+    };
+
+    const std::vector<size_t> &levels = schedule_.GetLevels();
+    for (size_t l = 0; l + 1 < levels.size(); ++l)
+    {
+        if (parallel_levels_[l])
         {
-            this->AddBlock<ControlBlock::MuxBlock>(click_pos);
+            thread_pool_->ParallelFor(levels[l], levels[l + 1], compute);
+            continue;
         }
-        else if (ImGui::MenuItem("State Space"))
+        for (size_t i = levels[l]; i < levels[l + 1]; ++i)
         {
-            this->AddBlock<ControlBlock::StateSpaceBlock>(click_pos);
+            compute(i);
         }
+    }
+}
 
-        ImGui::EndPopup(); // end "Add Block"
+void Diagram::ComputeEntry(const ControlBlock::ScheduledBlock &entry,
+                           double t)
+{
+    if (entry.output_only)
+    {
+        entry.block->ComputeOutput(t);
+    }
+    else
+    {
+        entry.block->Compute(t);
     }
 }
 
-std::shared_ptr<ControlBlock::Port> Diagram::GetPortByImNodesId(int id)
+void Diagram::Dynamics(const state_type &x, state_type &dxdt, const double t)
 {
-    std::shared_ptr<ControlBlock::Port> p;
+    dxdt.resize(x.size());
+    if (native_active_)
+    {
+        native_model_.Evaluate(x.data(), dxdt.data(), t);
+        return;
+    }
+    this->ComputeStates(x.data(), dxdt.data(), t);
+}
 
-    // Look through each block and find the port based on ID and type
-    for (size_t i = 0; i < blocks_.size(); ++i)
+void Diagram::ComputeStates(const double *x, double *dxdt, double t)
+{
+    // Let each dynamical system read and write its segment in place
+    const int n = diagram_x_.size();
+    this->BindStates(x, dxdt);
+
+    // Within a step, only the blocks that depend on states or a time that
+    // changed since the last evaluation are computed again. The rest keep
+    // their outputs and derivatives from then.
+    bool changed_only = eval_valid_ && !schedule_.BreaksLoops();
+    if (changed_only)
     {
-        // See if this block has an input port with this ID
-        p = blocks_[i]->FindInputPortByImNodesId(id);
-        if (p != nullptr)
+        changed_.assign(schedule_.Size(), false);
+        if (t != eval_t_)
         {
-            return p;
+            for (size_t i : schedule_.GetTimeDependents())
+            {
+                changed_[i] = true;
+            }
         }
 
-        // Otherwise check to see if this block has an output port with this ID
-        p = blocks_[i]->FindOutputPortByImNodesId(id);
-        if (p != nullptr)
+        for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
         {
-            return p;
+            if (entry.output_only || entry.dyn_idx < 0 ||
+                state_offsets_[entry.dyn_idx] < 0)
+            {
+                continue;
+            }
+            int offset = state_offsets_[entry.dyn_idx];
+            int size = entry.block->NumStates();
+            if (!std::equal(x + offset, x + offset + size,
+                            eval_x_.data() + offset))
+            {
+                for (size_t i : schedule_.GetStateDependents(entry.dyn_idx))
+                {
+                    changed_[i] = true;
+                }
+            }
         }
+        std::copy(eval_dx_.data(), eval_dx_.data() + n, dxdt);
     }
+    else
+    {
+        // Systems that are not scheduled never write their derivative
+        std::fill(dxdt, dxdt + n, 0.0);
+    }
+
+    this->ComputeGraph(t, false, changed_only);
+
+    eval_x_ = Eigen::Map<const state_type>(x, n);
+    eval_dx_ = Eigen::Map<const state_type>(dxdt, n);
+    eval_t_ = t;
+    eval_valid_ = true;
+}
 
-    // Look through each dynamics block and find the port based on ID and type
+void Diagram::BindStates(const double *x, double *dxdt)
+{
     for (size_t i = 0; i < dyn_blocks_.size(); ++i)
     {
-        // See if this block has an input port with this ID
-        p = dyn_blocks_[i]->FindInputPortByImNodesId(id);
-        if (p != nullptr)
+        if (state_offsets_[i] >= 0)
         {
-            return p;
+            dyn_blocks_[i]->BindState(x + state_offsets_[i],
+                                      dxdt + state_offsets_[i]);
+        }
+    }
+    for (size_t i = 0; i < fused_blocks_.size(); ++i)
+    {
+        fused_blocks_[i]->BindState(x + fused_offsets_[i],
+                                    dxdt + fused_offsets_[i]);
+    }
+}
+
+void Diagram::EnsembleDynamics(const ensemble_state_type &x,
+                               ensemble_state_type &dxdt, const double t)
+{
+    // Same as Dynamics(), with one column per lane
+    dxdt.setZero(x.rows(), x.cols());
+    this->BindLanes(x.data(), dxdt.data(), x.rows());
+    this->ComputeGraphLanes(t);
+}
+
+void Diagram::BindLanes(const double *x, double *dxdt, int num_states)
+{
+    for (size_t i = 0; i < dyn_blocks_.size(); ++i)
+    {
+        if (state_offsets_[i] >= 0)
+        {
+            dyn_blocks_[i]->BindLanes(x + state_offsets_[i],
+                                      dxdt + state_offsets_[i], num_states,
+                                      num_lanes_);
+        }
+    }
+    for (size_t i = 0; i < fused_blocks_.size(); ++i)
+    {
+        fused_blocks_[i]->BindLanes(x + fused_offsets_[i],
+                                    dxdt + fused_offsets_[i], num_states,
+                                    num_lanes_);
+    }
+}
+
+bool Diagram::ComputeGraphLanes(double t)
+{
+    // Discrete blocks aren't sampled per lane. Systems without feedthrough
+    // only compute their outputs ahead of the blocks reading them.
+    for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
+    {
+        if (entry.discrete)
+        {
+            return false;
         }
 
-        // Otherwise check to see if this block has an output port with this ID
-        p = dyn_blocks_[i]->FindOutputPortByImNodesId(id);
-        if (p != nullptr)
+        bool has_lanes = entry.output_only
+                             ? entry.block->ComputeOutputLanes(t)
+                             : entry.block->ComputeLanes(t);
+        if (!has_lanes)
         {
-            return p;
+            return false;
         }
     }
+    return true;
+}
+
+void Diagram::StiffDynamics(const stiff_state_type &x, stiff_state_type &dxdt,
+                            const double t)
+{
+    // Evaluate in place on the ublas storage, like Dynamics()
+    dxdt.resize(x.size(), false);
+    if (native_active_)
+    {
+        native_model_.Evaluate(x.data().begin(), dxdt.data().begin(), t);
+        return;
+    }
+    this->ComputeStates(x.data().begin(), dxdt.data().begin(), t);
+}
+
+void Diagram::StiffJacobian(const stiff_state_type &x, stiff_matrix_type &J,
+                            const double &t, stiff_state_type &dfdt)
+{
+    const int n = x.size();
+    jac_x_ = Eigen::Map<const state_type>(x.data().begin(), n);
+
+    // Evaluate the diagram at x first so every signal matches the state the
+    // Jacobian is taken at.
+    this->Dynamics(jac_x_, jac_f0_, t);
+
+    // Use the blocks' own Jacobians when all of them have one. The compiled
+    // diagram doesn't update the blocks' signals, so it is differenced.
+    if (native_active_ || !analytic_jacobian_ || !this->AnalyticJacobian())
+    {
+        analytic_jacobian_ = false;
+        this->FiniteDifferenceJacobian(t);
+    }
 
-    // No port found.
-    return nullptr;
+    // ublas matrices are row major
+    J.resize(n, n, false);
+    Eigen::Map<
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(
+        J.data().begin(), n, n) = jac_;
+
+    // Blocks can depend on time directly, so always difference in time
+    const double ht = std::sqrt(std::numeric_limits<double>::epsilon()) *
+                      std::max(1.0, std::abs(t));
+    this->Dynamics(jac_x_, jac_f1_, t + ht);
+    dfdt.resize(n, false);
+    Eigen::Map<state_type>(dfdt.data().begin(), n) = (jac_f1_ - jac_f0_) / ht;
 }
 
-int Diagram::GetDynamicBlockIndex(std::shared_ptr<ControlBlock::Block> blk)
+bool Diagram::AnalyticJacobian()
 {
-    for (int i = 0; i < dyn_blocks_.size(); ++i)
+    const int n = diagram_x_.size();
+    jac_.setZero(n, n);
+
+    // Every signal starts with a zero Jacobian, which is also what an
+    // unconnected input keeps. Folded blocks' outputs stay that way.
+    std::vector<ControlBlock::ScheduledBlock> entries = schedule_.GetFolded();
+    entries.insert(entries.end(), schedule_.GetOrder().begin(),
+                   schedule_.GetOrder().end());
+    for (const ControlBlock::ScheduledBlock &entry : entries)
+    {
+        std::shared_ptr<ControlBlock::Block> block = entry.block;
+        for (int i = 0; i < block->NumInputPorts(); ++i)
+        {
+            std::shared_ptr<ControlBlock::Port> port = block->GetInputPort(i);
+            port->GetJacobianBuffer().setZero(port->GetSize(), n);
+        }
+        for (int i = 0; i < block->NumOutputPorts(); ++i)
+        {
+            std::shared_ptr<ControlBlock::Port> port = block->GetOutputPort(i);
+            port->GetJacobianBuffer().setZero(port->GetSize(), n);
+        }
+    }
+
+    // Blocks stuck in a loop that isn't solved hold their outputs
+    for (std::shared_ptr<ControlBlock::Block> block :
+         schedule_.GetUnscheduled())
     {
-        if (dyn_blocks_[i] == blk)
+        for (int i = 0; i < block->NumOutputPorts(); ++i)
         {
-            return i;
+            std::shared_ptr<ControlBlock::Port> port = block->GetOutputPort(i);
+            port->GetJacobianBuffer().setZero(port->GetSize(), n);
         }
     }
 
-    // Block not found
-    return -1;
-}
\ No newline at end of file
+    // Blocks scheduled ahead of a system with direct feedthrough that breaks
+    // a feedback loop read its output Jacobian before it is written. That
+    // output only depends on the system's own states, so a second pass makes
+    // every Jacobian exact.
+    int num_passes = schedule_.BreaksLoops() ? 2 : 1;
+    for (int pass = 0; pass < num_passes; ++pass)
+    {
+        for (const ControlBlock::ScheduledBlock &entry : schedule_.GetOrder())
+        {
+            // Discrete outputs are held, so their Jacobians stay zero
+            if (entry.discrete)
+            {
+                continue;
+            }
+
+            int offset = 0;
+            int rows = 0;
+            if (entry.dyn_idx >= 0 && state_offsets_[entry.dyn_idx] >= 0)
+            {
+                offset = state_offsets_[entry.dyn_idx];
+                rows = entry.block->NumStates();
+            }
+
+            if (!entry.block->ComputeJacobian(offset,
+                                              jac_.middleRows(offset, rows)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void Diagram::FiniteDifferenceJacobian(double t)
+{
+    const int n = jac_x_.size();
+    jac_.resize(n, n);
+
+    // Forward differences, with the step scaled to each state
+    const double eps = std::sqrt(std::numeric_limits<double>::epsilon());
+    for (int j = 0; j < n; ++j)
+    {
+        const double xj = jac_x_(j);
+        const double h = eps * std::max(1.0, std::abs(xj));
+
+        jac_x_(j) = xj + h;
+        this->Dynamics(jac_x_, jac_f1_, t);
+        jac_.col(j) = (jac_f1_ - jac_f0_) / h;
+        jac_x_(j) = xj;
+    }
+}
+
+std::shared_ptr<ControlBlock::Port> Diagram::GetPortByImNodesId(int id)
+{
+    auto iter = port_index_.find(id);
+    if (iter == port_index_.end())
+    {
+        // No port found.
+        return nullptr;
+    }
+    return iter->second;
+}
+
+void Diagram::IndexBlock(std::shared_ptr<ControlBlock::Block> block)
+{
+    block_index_[block->GetId()] = block;
+    for (int i = 0; i < block->NumInputPorts(); ++i)
+    {
+        this->AddPort(block->GetInputPort(i));
+    }
+    for (int i = 0; i < block->NumOutputPorts(); ++i)
+    {
+        this->AddPort(block->GetOutputPort(i));
+    }
+}
+
+void Diagram::UnindexBlock(std::shared_ptr<ControlBlock::Block> block)
+{
+    block_index_.erase(block->GetId());
+    for (int i = 0; i < block->NumInputPorts(); ++i)
+    {
+        port_index_.erase(block->GetInputPort(i)->GetId());
+    }
+    for (int i = 0; i < block->NumOutputPorts(); ++i)
+    {
+        port_index_.erase(block->GetOutputPort(i)->GetId());
+    }
+}
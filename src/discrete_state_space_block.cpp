@@ -0,0 +1,64 @@
+#include "controlblocks/discrete_state_space_block.h"
+#include "controlblocks/code_generator.h"
+
+namespace ControlBlock
+{
+
+    void DiscreteStateSpaceBlock::Init(std::string block_name)
+    {
+        StateSpaceBlock::Init(block_name);
+    }
+
+    void DiscreteStateSpaceBlock::Compute(double t)
+    {
+        // The states are only read here, and advanced in Update()
+        ss.GetOutput(x_, Block::GetInput(0), Block::GetOutputBuffer(0));
+        Block::Broadcast();
+    }
+
+    bool DiscreteStateSpaceBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        // The matrices are in discrete time, so it can't join the integrated
+        // systems
+        return false;
+    }
+
+    bool DiscreteStateSpaceBlock::IsDiscrete() { return true; }
+
+    void DiscreteStateSpaceBlock::Update(double t, double dt)
+    {
+        // x[k + 1] = A x[k] + B u[k] is the derivative of the continuous
+        // form, so the same product gives the next state
+        x_next_.resize(x_.size());
+        ss.UpdateDynamics(x_, Block::GetInput(0), x_next_);
+        x_.swap(x_next_);
+    }
+
+    bool DiscreteStateSpaceBlock::GenerateCode(CodeGenerator &gen)
+    {
+        // Without direct feedthrough the input is left out, since the
+        // outputs are computed before it
+        std::string x = gen.State();
+        std::string u = gen.Input(0);
+        std::string output =
+            gen.Output(0) + " = " + gen.Parameter("C", C_) + " * " + x;
+        if (!D_.isZero(0.0))
+        {
+            output += " + " + gen.Parameter("D", D_) + " * " + u;
+        }
+        gen.Compute(output + ";");
+        gen.Update(x + " = (" + gen.Parameter("A", A_) + " * " + x + " + " +
+                   gen.Parameter("B", B_) + " * " + u + ").eval();");
+        return true;
+    }
+
+    toml::table DiscreteStateSpaceBlock::Serialize()
+    {
+        // Saved like a state space block, without the hold mode
+        toml::table tbl = StateSpaceBlock::Serialize();
+        tbl.insert_or_assign("type", "DiscreteStateSpaceBlock");
+        tbl.erase("zoh");
+        return tbl;
+    }
+
+} // namespace ControlBlock
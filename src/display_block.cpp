@@ -1,4 +1,5 @@
 #include "controlblocks/display_block.h"
+#include "controlblocks/code_generator.h"
 
 namespace ControlBlock
 {
@@ -18,52 +19,40 @@ namespace ControlBlock
     void DisplayBlock::Compute(double t)
     {
         // Get the input
-        val_ = Block::GetInput(input_ids_[0]);
+        val_ = Block::GetInput(0);
     }
 
-    void DisplayBlock::Render()
-    {
-        ImNodes::BeginNode(this->id_);
-
-        ImGui::Spacing();
-
-        // Ensure the node is just as wide as the title or the minimum width.
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
-
-        ImNodes::BeginNodeTitleBar();
-
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
+    bool DisplayBlock::IsFoldable() { return true; }
 
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
-
-        // Input
-        ImGui::BeginGroup();
-        ImNodes::BeginInputAttribute(input_ids_[0]);
-        ImNodes::EndInputAttribute();
-        ImGui::SameLine();
+    bool DisplayBlock::ComputeLanes(double t)
+    {
+        lane_vals_ = Block::GetInputLanes(0);
+        return true;
+    }
 
-        // Print each value in a new line.
-        ImGui::BeginGroup();
-        for (int i = 0; i < val_.size(); ++i)
-        {
-            ImGui::Text(std::to_string(val_(i)).c_str());
-        }
-        ImGui::EndGroup();
+    bool DisplayBlock::GenerateCode(CodeGenerator &gen)
+    {
+        // The displayed value becomes a signal of its own
+        std::string value = gen.Signal("value", gen.InputSize(0));
+        gen.Compute(value + " = " + gen.Input(0) + ";");
+        return true;
+    }
 
-        ImGui::EndGroup();
+    void DisplayBlock::InferSizes()
+    {
+        val_ = Eigen::VectorXd::Zero(inputs_[0]->GetSize());
+    }
 
-        ImGui::Spacing();
+    bool DisplayBlock::ComputeJacobian(int state_offset,
+                                       Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // Displays have no outputs or states
+        return true;
+    }
 
-        // Reset item width for the next block.
-        ImGui::PopItemWidth();
+    const Eigen::VectorXd &DisplayBlock::GetValue() { return val_; }
 
-        ImNodes::EndNode();
-    }
+    const Eigen::MatrixXd &DisplayBlock::GetLaneValues() { return lane_vals_; }
 
     toml::table DisplayBlock::Serialize()
     {
@@ -77,12 +66,9 @@ namespace ControlBlock
             input_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{
             {"type", "DisplayBlock"}, {"name", this->name_}, {"id", this->id_},
-            {"inputs", input_arr},    {"x_pos", pos.x},      {"y_pos", pos.y}};
+            {"inputs", input_arr},    {"x_pos", x_pos_},     {"y_pos", y_pos_}};
 
         return tbl;
     }
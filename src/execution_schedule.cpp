@@ -0,0 +1,648 @@
+#include "controlblocks/execution_schedule.h"
+
+namespace ControlBlock
+{
+    void ExecutionSchedule::Compile(
+        const std::vector<std::shared_ptr<Block>> &blocks,
+        const std::vector<std::shared_ptr<Block>> &dyn_blocks, double step,
+        bool fold)
+    {
+        this->Clear();
+
+        // Every block is a node in the graph. The non-dynamical blocks come
+        // first so the dynamical system index is offset by blocks.size().
+        std::vector<std::shared_ptr<Block>> nodes = blocks;
+        nodes.insert(nodes.end(), dyn_blocks.begin(), dyn_blocks.end());
+        size_t num_blocks = nodes.size();
+
+        // A dynamical system without direct feedthrough gets a second node
+        // after the others that computes its outputs from its states. That
+        // node reads nothing, so it goes ahead of the blocks reading the
+        // outputs, and the system's own node only waits for its inputs.
+        std::vector<int> dyn_idx(num_blocks, -1);
+        std::vector<int> output_node(num_blocks, -1);
+        for (size_t i = 0; i < dyn_blocks.size(); ++i)
+        {
+            size_t n = blocks.size() + i;
+            dyn_idx[n] = static_cast<int>(i);
+            if (nodes[n] != nullptr && !nodes[n]->HasDirectFeedthrough())
+            {
+                output_node[n] = static_cast<int>(nodes.size());
+                nodes.push_back(nodes[n]);
+                dyn_idx.push_back(static_cast<int>(i));
+            }
+        }
+        size_t num_nodes = nodes.size();
+        output_node.resize(num_nodes, -1);
+
+        // Map each output port to the node that computes it. Going by port
+        // rather than by block lets a fused block stand in for the blocks
+        // whose ports it computes.
+        std::unordered_map<int, size_t> node_idx;
+        for (size_t i = 0; i < num_blocks; ++i)
+        {
+            if (nodes[i] == nullptr)
+            {
+                continue;
+            }
+            size_t source = (output_node[i] >= 0) ? output_node[i] : i;
+            for (int j = 0; j < nodes[i]->NumOutputPorts(); ++j)
+            {
+                node_idx[nodes[i]->GetOutputPort(j)->GetId()] = source;
+            }
+        }
+
+        // Build the edges from the port connections. A block is inactive if
+        // it has a required input that is not connected. Empty slots are
+        // never scheduled.
+        std::vector<std::vector<size_t>> consumers(num_nodes);
+        std::vector<std::vector<size_t>> producers(num_nodes);
+        std::vector<bool> active(num_nodes, true);
+        for (size_t i = 0; i < num_blocks; ++i)
+        {
+            if (nodes[i] == nullptr)
+            {
+                active[i] = false;
+                continue;
+            }
+            for (int j = 0; j < nodes[i]->NumInputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = nodes[i]->GetInputPort(j);
+                std::shared_ptr<Port> source = port->GetConnection();
+
+                if (source == nullptr)
+                {
+                    active[i] = active[i] && port->IsOptional();
+                    continue;
+                }
+
+                auto iter = node_idx.find(source->GetId());
+                if (iter != node_idx.end())
+                {
+                    consumers[iter->second].push_back(i);
+                    producers[i].push_back(iter->second);
+                }
+            }
+        }
+        for (size_t i = num_blocks; i < num_nodes; ++i)
+        {
+            active[i] = active[blocks.size() + dyn_idx[i]];
+        }
+
+        // Anything downstream of an inactive block never receives an input,
+        // so it is inactive as well, along with its outputs.
+        std::deque<size_t> queue;
+        for (size_t i = 0; i < num_nodes; ++i)
+        {
+            if (!active[i])
+            {
+                queue.push_back(i);
+            }
+        }
+        while (!queue.empty())
+        {
+            size_t n = queue.front();
+            queue.pop_front();
+            for (size_t c : consumers[n])
+            {
+                if (active[c])
+                {
+                    active[c] = false;
+                    queue.push_back(c);
+                }
+            }
+            if (output_node[n] >= 0 && active[output_node[n]])
+            {
+                active[output_node[n]] = false;
+                queue.push_back(output_node[n]);
+            }
+        }
+
+        // Count the dependencies of each active block.
+        std::vector<int> num_deps(num_nodes, 0);
+        for (size_t i = 0; i < num_nodes; ++i)
+        {
+            if (!active[i])
+            {
+                continue;
+            }
+            for (size_t c : consumers[i])
+            {
+                num_deps[c]++;
+            }
+        }
+
+        // Kahn's algorithm. Blocks without dependencies are ready to go.
+        for (size_t i = 0; i < num_nodes; ++i)
+        {
+            if (active[i] && num_deps[i] == 0)
+            {
+                queue.push_back(i);
+            }
+        }
+
+        // Sample times are resolved as the blocks are ordered, since blocks
+        // inherit theirs from the blocks they read. Dynamical systems only go
+        // by their own, so they are resolved up front for the blocks that
+        // read a system released to break a loop.
+        std::vector<SampleTime> rates(num_nodes, SampleTime{0.0, 0.0});
+        std::vector<bool> constant_rate(num_nodes, false);
+        for (size_t n = blocks.size(); n < num_nodes; ++n)
+        {
+            if (nodes[n] != nullptr)
+            {
+                this->ResolveSampleTime(n, true, nodes, producers, step, rates,
+                                        constant_rate);
+            }
+        }
+
+        // Dynamical systems whose outputs have been released to break a loop
+        std::vector<bool> released(num_nodes, false);
+        std::vector<bool> scheduled(num_nodes, false);
+        std::vector<size_t> order_nodes;
+        size_t num_active = std::count(active.begin(), active.end(), true);
+
+        while (order_.size() < num_active)
+        {
+            // If nothing is ready, a loop is blocking progress. Break it at
+            // the first dynamical system that hasn't been released yet. Its
+            // output is still valid from the previous evaluation.
+            if (queue.empty())
+            {
+                for (size_t i = blocks.size(); i < num_blocks; ++i)
+                {
+                    if (active[i] && !scheduled[i] && !released[i])
+                    {
+                        released[i] = true;
+                        breaks_loops_ =
+                            breaks_loops_ || !consumers[i].empty();
+                        for (size_t c : consumers[i])
+                        {
+                            if (--num_deps[c] == 0)
+                            {
+                                queue.push_back(c);
+                            }
+                        }
+
+                        if (!queue.empty())
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                // The remaining blocks form a loop with no state in it.
+                if (queue.empty())
+                {
+                    break;
+                }
+            }
+
+            size_t n = queue.front();
+            queue.pop_front();
+
+            if (n < blocks.size())
+            {
+                this->ResolveSampleTime(n, false, nodes, producers, step,
+                                        rates, constant_rate);
+            }
+
+            ScheduledBlock entry;
+            entry.block = nodes[n];
+            entry.dyn_idx = dyn_idx[n];
+            entry.discrete = (rates[n].period > 0.0);
+            entry.sample_time = rates[n];
+            entry.output_only = (n >= num_blocks);
+            order_.push_back(entry);
+            order_nodes.push_back(n);
+            scheduled[n] = true;
+
+            // Released systems have already satisfied their consumers.
+            if (released[n])
+            {
+                continue;
+            }
+            for (size_t c : consumers[n])
+            {
+                if (--num_deps[c] == 0)
+                {
+                    queue.push_back(c);
+                }
+            }
+        }
+
+        // Whatever is active but couldn't be ordered is in or downstream of
+        // a loop without state
+        std::vector<bool> stuck(num_nodes, false);
+        for (size_t i = 0; i < num_nodes; ++i)
+        {
+            stuck[i] = active[i] && !scheduled[i];
+        }
+        this->FindLoops(nodes, blocks.size(), stuck, producers, consumers);
+
+        if (fold)
+        {
+            // A block is constant if it only depends on its inputs and they
+            // are all constant. The order puts each block after the blocks
+            // it reads from, apart from dynamical systems, which are never
+            // constant.
+            std::vector<bool> constant(num_nodes, false);
+            for (size_t n : order_nodes)
+            {
+                if (n >= blocks.size() || !nodes[n]->IsFoldable())
+                {
+                    continue;
+                }
+                bool is_constant = true;
+                for (size_t p : producers[n])
+                {
+                    is_constant = is_constant && constant[p];
+                }
+                constant[n] = is_constant;
+            }
+
+            // Outputs are observed by blocks without outputs and by
+            // dynamical systems, and by anything upstream of them. The
+            // outputs of dynamical systems are always kept up to date.
+            std::vector<bool> observed(num_nodes, false);
+            queue.clear();
+            for (size_t n : order_nodes)
+            {
+                if (n >= blocks.size() || nodes[n]->NumOutputPorts() == 0)
+                {
+                    observed[n] = true;
+                    queue.push_back(n);
+                }
+            }
+            while (!queue.empty())
+            {
+                size_t n = queue.front();
+                queue.pop_front();
+                for (size_t p : producers[n])
+                {
+                    if (!observed[p])
+                    {
+                        observed[p] = true;
+                        queue.push_back(p);
+                    }
+                }
+            }
+
+            std::vector<ScheduledBlock> order;
+            std::vector<size_t> nodes_left;
+            for (size_t k = 0; k < order_.size(); ++k)
+            {
+                size_t n = order_nodes[k];
+                if (!observed[n])
+                {
+                    pruned_.push_back(order_[k]);
+                }
+                else if (constant[n])
+                {
+                    folded_.push_back(order_[k]);
+                }
+                else
+                {
+                    order.push_back(order_[k]);
+                    nodes_left.push_back(n);
+                }
+            }
+            order_.swap(order);
+            order_nodes.swap(nodes_left);
+        }
+
+        this->GroupLevels(order_nodes, producers, consumers);
+
+        // Find what each system's states reach: its own entries and
+        // everything downstream of its outputs
+        std::vector<int> position(num_nodes, -1);
+        for (size_t k = 0; k < order_nodes.size(); ++k)
+        {
+            position[order_nodes[k]] = static_cast<int>(k);
+        }
+        state_dependents_.resize(dyn_blocks.size());
+        for (size_t i = 0; i < dyn_blocks.size(); ++i)
+        {
+            size_t n = blocks.size() + i;
+            std::vector<size_t> seeds = {n};
+            if (output_node[n] >= 0)
+            {
+                seeds.push_back(output_node[n]);
+            }
+            state_dependents_[i] = this->Downstream(seeds, consumers, position);
+        }
+
+        // Blocks that aren't foldable and dynamical systems that aren't
+        // linear time invariant are taken to depend on time as well
+        std::vector<size_t> seeds;
+        ControlUtils::StateSpace ss;
+        for (size_t n : order_nodes)
+        {
+            bool is_dynamic = (n >= blocks.size());
+            if ((!is_dynamic && !nodes[n]->IsFoldable()) ||
+                (is_dynamic && !nodes[n]->GetLinearSystem(&ss)))
+            {
+                seeds.push_back(n);
+            }
+        }
+        time_dependents_ = this->Downstream(seeds, consumers, position);
+
+        // Track the blocks that will not be computed.
+        for (size_t i = 0; i < num_blocks; ++i)
+        {
+            if (!scheduled[i] && nodes[i] != nullptr)
+            {
+                unscheduled_.push_back(nodes[i]);
+            }
+        }
+    }
+
+    void ExecutionSchedule::ResolveSampleTime(
+        size_t n, bool is_dynamic,
+        const std::vector<std::shared_ptr<Block>> &nodes,
+        const std::vector<std::vector<size_t>> &producers, double step,
+        std::vector<SampleTime> &rates, std::vector<bool> &constant_rate) const
+    {
+        SampleTime own = nodes[n]->GetSampleTime();
+        const SampleTime continuous = {0.0, 0.0};
+        if (nodes[n]->IsDiscrete())
+        {
+            rates[n] = own;
+            if (own.period <= 0.0)
+            {
+                rates[n].period = step;
+            }
+            return;
+        }
+        if (is_dynamic || own.period >= 0.0)
+        {
+            rates[n] = is_dynamic ? continuous : own;
+            return;
+        }
+
+        // Take the rate of the inputs if they all have the same one. Constant
+        // inputs fit any rate, and blocks that only read them are constant.
+        bool found = false;
+        bool same = true;
+        for (size_t p : producers[n])
+        {
+            if (constant_rate[p])
+            {
+                continue;
+            }
+            same = same && (!found || (rates[p].period == rates[n].period &&
+                                       rates[p].offset == rates[n].offset));
+            rates[n] = found ? rates[n] : rates[p];
+            found = true;
+        }
+        if (!found)
+        {
+            rates[n] = continuous;
+            constant_rate[n] = nodes[n]->IsFoldable();
+        }
+        else if (!same)
+        {
+            rates[n] = continuous;
+        }
+    }
+
+    void ExecutionSchedule::FindLoops(
+        const std::vector<std::shared_ptr<Block>> &nodes,
+        size_t num_stateless, const std::vector<bool> &stuck,
+        const std::vector<std::vector<size_t>> &producers,
+        const std::vector<std::vector<size_t>> &consumers)
+    {
+        // Loops are the strongly connected components, found with two depth
+        // first searches (Kosaraju). Only the outputs of blocks without
+        // state count as edges, since loops through a dynamical system are
+        // broken at it.
+        size_t num_nodes = nodes.size();
+        std::vector<bool> visited(num_nodes, false);
+        std::vector<size_t> finished;
+        for (size_t s = 0; s < num_stateless; ++s)
+        {
+            if (!stuck[s] || visited[s])
+            {
+                continue;
+            }
+
+            // Each frame is a node and the next of its consumers to visit
+            std::vector<std::pair<size_t, size_t>> stack = {{s, 0}};
+            visited[s] = true;
+            while (!stack.empty())
+            {
+                size_t n = stack.back().first;
+                size_t &next = stack.back().second;
+                if (next < consumers[n].size())
+                {
+                    size_t c = consumers[n][next++];
+                    if (c < num_stateless && stuck[c] && !visited[c])
+                    {
+                        visited[c] = true;
+                        stack.push_back({c, 0});
+                    }
+                    continue;
+                }
+                finished.push_back(n);
+                stack.pop_back();
+            }
+        }
+
+        // Going back along the edges from the last node to finish collects
+        // one component at a time
+        std::vector<bool> assigned(num_nodes, false);
+        for (auto iter = finished.rbegin(); iter != finished.rend(); ++iter)
+        {
+            if (assigned[*iter])
+            {
+                continue;
+            }
+
+            std::vector<size_t> component;
+            std::vector<size_t> stack = {*iter};
+            assigned[*iter] = true;
+            while (!stack.empty())
+            {
+                size_t n = stack.back();
+                stack.pop_back();
+                component.push_back(n);
+                for (size_t p : producers[n])
+                {
+                    if (p < num_stateless && stuck[p] && !assigned[p])
+                    {
+                        assigned[p] = true;
+                        stack.push_back(p);
+                    }
+                }
+            }
+
+            // A single block is only a loop if it reads its own output
+            size_t first = component[0];
+            bool is_loop = component.size() > 1 ||
+                           std::count(consumers[first].begin(),
+                                      consumers[first].end(), first) > 0;
+            if (!is_loop)
+            {
+                continue;
+            }
+
+            std::sort(component.begin(), component.end());
+            std::vector<std::shared_ptr<Block>> loop;
+            for (size_t n : component)
+            {
+                loop.push_back(nodes[n]);
+            }
+            loops_.push_back(loop);
+        }
+    }
+
+    void ExecutionSchedule::GroupLevels(
+        std::vector<size_t> &order_nodes,
+        const std::vector<std::vector<size_t>> &producers,
+        const std::vector<std::vector<size_t>> &consumers)
+    {
+        // A block goes one level after every block it reads from. A block
+        // read before it is computed, which breaks a loop, goes one level
+        // after its readers so they still see its previous output.
+        size_t num_nodes = producers.size();
+        std::vector<int> level(num_nodes, -1);
+        std::vector<size_t> order_level(order_nodes.size(), 0);
+        size_t num_levels = 0;
+        for (size_t k = 0; k < order_nodes.size(); ++k)
+        {
+            size_t n = order_nodes[k];
+            int lvl = 0;
+            for (size_t p : producers[n])
+            {
+                lvl = std::max(lvl, level[p] + 1);
+            }
+            for (size_t c : consumers[n])
+            {
+                lvl = std::max(lvl, level[c] + 1);
+            }
+            level[n] = lvl;
+            order_level[k] = static_cast<size_t>(lvl);
+            num_levels = std::max(num_levels, order_level[k] + 1);
+        }
+
+        // Sort the order by level. This still satisfies every dependency, so
+        // a serial pass over it gives the same results as before.
+        std::vector<std::vector<ScheduledBlock>> grouped(num_levels);
+        std::vector<std::vector<size_t>> grouped_nodes(num_levels);
+        for (size_t k = 0; k < order_.size(); ++k)
+        {
+            grouped[order_level[k]].push_back(order_[k]);
+            grouped_nodes[order_level[k]].push_back(order_nodes[k]);
+        }
+        order_.clear();
+        order_nodes.clear();
+        for (size_t l = 0; l < num_levels; ++l)
+        {
+            levels_.push_back(order_.size());
+            order_.insert(order_.end(), grouped[l].begin(), grouped[l].end());
+            order_nodes.insert(order_nodes.end(), grouped_nodes[l].begin(),
+                               grouped_nodes[l].end());
+        }
+        levels_.push_back(order_.size());
+    }
+
+    std::vector<size_t> ExecutionSchedule::Downstream(
+        const std::vector<size_t> &seeds,
+        const std::vector<std::vector<size_t>> &consumers,
+        const std::vector<int> &position) const
+    {
+        std::vector<bool> visited(consumers.size(), false);
+        std::deque<size_t> queue;
+        for (size_t n : seeds)
+        {
+            if (!visited[n])
+            {
+                visited[n] = true;
+                queue.push_back(n);
+            }
+        }
+
+        // Folded and pruned blocks have no position, and are left out
+        std::vector<size_t> positions;
+        while (!queue.empty())
+        {
+            size_t n = queue.front();
+            queue.pop_front();
+            if (position[n] >= 0)
+            {
+                positions.push_back(static_cast<size_t>(position[n]));
+            }
+            for (size_t c : consumers[n])
+            {
+                if (!visited[c])
+                {
+                    visited[c] = true;
+                    queue.push_back(c);
+                }
+            }
+        }
+        std::sort(positions.begin(), positions.end());
+        return positions;
+    }
+
+    void ExecutionSchedule::Clear()
+    {
+        order_.clear();
+        levels_.clear();
+        unscheduled_.clear();
+        folded_.clear();
+        pruned_.clear();
+        state_dependents_.clear();
+        time_dependents_.clear();
+        loops_.clear();
+        breaks_loops_ = false;
+    }
+
+    const std::vector<ScheduledBlock> &ExecutionSchedule::GetOrder() const
+    {
+        return order_;
+    }
+
+    const std::vector<size_t> &ExecutionSchedule::GetLevels() const
+    {
+        return levels_;
+    }
+
+    const std::vector<std::shared_ptr<Block>> &
+    ExecutionSchedule::GetUnscheduled() const
+    {
+        return unscheduled_;
+    }
+
+    const std::vector<ScheduledBlock> &ExecutionSchedule::GetFolded() const
+    {
+        return folded_;
+    }
+
+    const std::vector<ScheduledBlock> &ExecutionSchedule::GetPruned() const
+    {
+        return pruned_;
+    }
+
+    const std::vector<size_t> &
+    ExecutionSchedule::GetStateDependents(int dyn_idx) const
+    {
+        return state_dependents_[dyn_idx];
+    }
+
+    const std::vector<size_t> &ExecutionSchedule::GetTimeDependents() const
+    {
+        return time_dependents_;
+    }
+
+    bool ExecutionSchedule::BreaksLoops() const { return breaks_loops_; }
+
+    const std::vector<std::vector<std::shared_ptr<Block>>> &
+    ExecutionSchedule::GetAlgebraicLoops() const
+    {
+        return loops_;
+    }
+
+    size_t ExecutionSchedule::Size() const { return order_.size(); }
+
+} // namespace ControlBlock
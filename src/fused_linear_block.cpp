@@ -0,0 +1,304 @@
+#include "controlblocks/fused_linear_block.h"
+
+#include <unordered_map>
+
+namespace ControlBlock
+{
+
+    bool
+    FusedLinearBlock::Fuse(const std::vector<std::shared_ptr<Block>> &members)
+    {
+        members_ = members;
+        inputs_.clear();
+        outputs_.clear();
+        id_ = -1;
+        name_ = "Fused";
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            name_ += (i == 0 ? ": " : ", ") + members[i]->GetName();
+        }
+
+        // Every output of a member is a signal s, and the members' states
+        // are stacked into x
+        std::vector<ControlUtils::StateSpace> systems(members.size());
+        std::vector<int> signal_start(members.size());
+        std::vector<int> state_start(members.size());
+        std::unordered_map<int, int> signal_offset;
+        int num_signals = 0;
+        int num_states = 0;
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (!members[i]->GetLinearSystem(&systems[i]) ||
+                systems[i].NumStates() != members[i]->NumStates())
+            {
+                return false;
+            }
+
+            signal_start[i] = num_signals;
+            for (int j = 0; j < members[i]->NumOutputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = members[i]->GetOutputPort(j);
+                signal_offset[port->GetId()] = num_signals;
+                num_signals += port->GetSize();
+                outputs_.push_back(port);
+            }
+            if (num_signals - signal_start[i] != systems[i].NumOutputs())
+            {
+                return false;
+            }
+
+            state_start[i] = num_states;
+            num_states += systems[i].NumStates();
+        }
+
+        // Inputs from outside the group become the inputs u, once for each
+        // output driving them. Unconnected inputs read zeros, so they drop
+        // out.
+        std::unordered_map<int, int> input_offset;
+        int num_inputs = 0;
+        for (std::shared_ptr<Block> member : members)
+        {
+            for (int j = 0; j < member->NumInputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = member->GetInputPort(j);
+                std::shared_ptr<Port> source = port->GetConnection();
+                if (source == nullptr ||
+                    signal_offset.count(source->GetId()) > 0 ||
+                    input_offset.count(source->GetId()) > 0)
+                {
+                    continue;
+                }
+                input_offset[source->GetId()] = num_inputs;
+                num_inputs += port->GetSize();
+                inputs_.push_back(port);
+            }
+        }
+
+        // Each member gives s_i = C_i x_i + D_i u_i and dx_i = A_i x_i +
+        // B_i u_i, where the columns of u_i pick out other signals or inputs
+        Eigen::MatrixXd Sx = Eigen::MatrixXd::Zero(num_signals, num_states);
+        Eigen::MatrixXd Ss = Eigen::MatrixXd::Zero(num_signals, num_signals);
+        Eigen::MatrixXd Su = Eigen::MatrixXd::Zero(num_signals, num_inputs);
+        Eigen::MatrixXd Ax = Eigen::MatrixXd::Zero(num_states, num_states);
+        Eigen::MatrixXd Bs = Eigen::MatrixXd::Zero(num_states, num_signals);
+        Eigen::MatrixXd Bu = Eigen::MatrixXd::Zero(num_states, num_inputs);
+        x_ = Eigen::VectorXd::Zero(num_states);
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            ControlUtils::StateSpace &sys = systems[i];
+            int ys = signal_start[i];
+            int xs = state_start[i];
+            int ny = sys.NumOutputs();
+            int nx = sys.NumStates();
+
+            Ax.block(xs, xs, nx, nx) = sys.GetA();
+            Sx.block(ys, xs, ny, nx) = sys.GetC();
+            x_.segment(xs, nx) = members[i]->GetState();
+
+            int col = 0;
+            for (int j = 0; j < members[i]->NumInputPorts(); ++j)
+            {
+                std::shared_ptr<Port> port = members[i]->GetInputPort(j);
+                std::shared_ptr<Port> source = port->GetConnection();
+                int size = port->GetSize();
+                if (col + size > sys.NumInputs())
+                {
+                    return false;
+                }
+
+                if (source != nullptr)
+                {
+                    auto signal = signal_offset.find(source->GetId());
+                    if (signal != signal_offset.end())
+                    {
+                        Ss.block(ys, signal->second, ny, size) +=
+                            sys.GetD().middleCols(col, size);
+                        Bs.block(xs, signal->second, nx, size) +=
+                            sys.GetB().middleCols(col, size);
+                    }
+                    else
+                    {
+                        int k = input_offset[source->GetId()];
+                        Su.block(ys, k, ny, size) +=
+                            sys.GetD().middleCols(col, size);
+                        Bu.block(xs, k, nx, size) +=
+                            sys.GetB().middleCols(col, size);
+                    }
+                }
+                col += size;
+            }
+            if (col != sys.NumInputs())
+            {
+                return false;
+            }
+        }
+
+        // Solve for the signals, s = (I - Ss)^-1 (Sx x + Su u). Without a
+        // loop Ss is nilpotent and this always works, while a loop through
+        // the D matrices alone has to be well posed.
+        Eigen::FullPivLU<Eigen::MatrixXd> lu(
+            Eigen::MatrixXd::Identity(num_signals, num_signals) - Ss);
+        if (!lu.isInvertible())
+        {
+            return false;
+        }
+        Eigen::MatrixXd C = lu.solve(Sx);
+        Eigen::MatrixXd D = lu.solve(Su);
+        ss_.SetABCD(Ax + Bs * C, Bu + Bs * D, C, D);
+
+        dynamic_sys_ = num_states > 0;
+        u_ = Eigen::VectorXd::Zero(num_inputs);
+        y_ = Eigen::VectorXd::Zero(num_signals);
+        return true;
+    }
+
+    const std::vector<std::shared_ptr<Block>> &FusedLinearBlock::GetMembers()
+    {
+        return members_;
+    }
+
+    void FusedLinearBlock::Compute(double t)
+    {
+        // Stack the inputs
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            const Eigen::VectorXd &val_i = Block::GetInput(i);
+            u_.segment(idx, val_i.size()) = val_i;
+            idx += val_i.size();
+        }
+
+        Eigen::Map<const Eigen::VectorXd> x = this->StateView();
+        if (x_.size() > 0)
+        {
+            Eigen::Map<Eigen::VectorXd> dx = this->DerivativeView();
+            ss_.UpdateDynamics(x, u_, dx);
+        }
+        ss_.GetOutput(x, u_, y_);
+
+        // Hand each signal back to the port it came from
+        idx = 0;
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            int size = outputs_[i]->GetSize();
+            Block::GetOutputBuffer(i) = y_.segment(idx, size);
+            idx += size;
+        }
+
+        Block::Broadcast();
+    }
+
+    void FusedLinearBlock::ComputeOutput(double t)
+    {
+        // Only called when D is zero, so the signals are C x
+        y_.noalias() = ss_.GetC() * this->StateView();
+        int idx = 0;
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            int size = outputs_[i]->GetSize();
+            Block::GetOutputBuffer(i) = y_.segment(idx, size);
+            idx += size;
+        }
+
+        Block::Broadcast();
+    }
+
+    bool FusedLinearBlock::ComputeLanes(double t)
+    {
+        int num_lanes = Block::GetOutputLanes(0).cols();
+        u_lanes_.resize(u_.size(), num_lanes);
+        y_lanes_.resize(y_.size(), num_lanes);
+
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            const Eigen::MatrixXd &val_i = Block::GetInputLanes(i);
+            u_lanes_.middleRows(idx, val_i.rows()) = val_i;
+            idx += val_i.rows();
+        }
+
+        if (x_.size() > 0)
+        {
+            ConstLanesView X = this->StateLanesView();
+            ss_.UpdateDynamicsLanes(X, u_lanes_, this->DerivativeLanesView());
+            ss_.GetOutputLanes(X, u_lanes_, y_lanes_);
+        }
+        else
+        {
+            y_lanes_.noalias() = ss_.GetD() * u_lanes_;
+        }
+
+        idx = 0;
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            int size = outputs_[i]->GetSize();
+            Block::GetOutputLanes(i) = y_lanes_.middleRows(idx, size);
+            idx += size;
+        }
+
+        Block::Broadcast();
+        return true;
+    }
+
+    bool FusedLinearBlock::ComputeOutputLanes(double t)
+    {
+        // Only called when D is zero, so the signals are C x
+        int num_lanes = Block::GetOutputLanes(0).cols();
+        y_lanes_.resize(y_.size(), num_lanes);
+        y_lanes_.noalias() = ss_.GetC() * this->StateLanesView();
+
+        int idx = 0;
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            int size = outputs_[i]->GetSize();
+            Block::GetOutputLanes(i) = y_lanes_.middleRows(idx, size);
+            idx += size;
+        }
+
+        Block::Broadcast();
+        return true;
+    }
+
+    bool FusedLinearBlock::ComputeJacobian(int state_offset,
+                                           Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // Stack the input Jacobians the same way as the values
+        int num_cols = Block::GetOutputJacobian(0).cols();
+        du_.resize(u_.size(), num_cols);
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            const Eigen::MatrixXd &jac_i = Block::GetInputJacobian(i);
+            du_.middleRows(idx, jac_i.rows()) = jac_i;
+            idx += jac_i.rows();
+        }
+
+        int num_states = x_.size();
+        dfdx.noalias() = ss_.GetB() * du_;
+        dfdx.middleCols(state_offset, num_states) += ss_.GetA();
+
+        dy_.noalias() = ss_.GetD() * du_;
+        dy_.middleCols(state_offset, num_states) += ss_.GetC();
+
+        idx = 0;
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            int size = outputs_[i]->GetSize();
+            Block::GetOutputJacobian(i) = dy_.middleRows(idx, size);
+            idx += size;
+        }
+        return true;
+    }
+
+    bool FusedLinearBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        *ss = ss_;
+        return true;
+    }
+
+    bool FusedLinearBlock::HasDirectFeedthrough()
+    {
+        return !ss_.GetD().isZero(0.0);
+    }
+
+} // namespace ControlBlock
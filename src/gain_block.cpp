@@ -1,4 +1,5 @@
 #include "controlblocks/gain_block.h"
+#include "controlblocks/code_generator.h"
 
 namespace ControlBlock
 {
@@ -21,7 +22,7 @@ namespace ControlBlock
 
     bool GainBlock::ApplyInitial()
     {
-        Block::SetOutput(output_ids_[0], x0_);
+        Block::SetOutput(0, x0_);
         Block::Broadcast();
 
         return true;
@@ -32,55 +33,87 @@ namespace ControlBlock
     void GainBlock::Compute(double t)
     {
         // Get the input
-        Eigen::VectorXd input = Block::GetInput(input_ids_[0]);
+        const Eigen::VectorXd &input = Block::GetInput(0);
 
-        // Multiply
-        Eigen::VectorXd output = val_ * input;
+        // Multiply into the output buffer
+        Block::GetOutputBuffer(0) = val_ * input;
 
         // Send the output
-        Block::SetOutput(output_ids_[0], output);
         Block::Broadcast();
     }
 
-    void GainBlock::Render()
-    {
-        ImNodes::BeginNode(this->id_);
+    bool GainBlock::IsFoldable() { return true; }
 
-        ImGui::Spacing();
+    bool GainBlock::ComputeLanes(double t)
+    {
+        const Eigen::MatrixXd &input = Block::GetInputLanes(0);
+        Eigen::MatrixXd &output = Block::GetOutputLanes(0);
+        if (lane_vals_.size() == input.cols())
+        {
+            output.noalias() = input * lane_vals_.asDiagonal();
+        }
+        else
+        {
+            output = val_ * input;
+        }
 
-        // Ensure the node is just as wide as the title or the minimum width.
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
+        Block::Broadcast();
+        return true;
+    }
 
-        ImNodes::BeginNodeTitleBar();
+    bool GainBlock::GenerateCode(CodeGenerator &gen)
+    {
+        gen.Compute(gen.Output(0) + " = " + CodeGenerator::Number(val_) +
+                    " * " + gen.Input(0) + ";");
+        return true;
+    }
 
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
+    void GainBlock::InferSizes()
+    {
+        // Scalar gains keep the width of the input
+        outputs_[0]->SetSize(inputs_[0]->GetSize());
+    }
 
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
+    bool GainBlock::ComputeJacobian(int state_offset,
+                                    Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        Block::GetOutputJacobian(0) = val_ * Block::GetInputJacobian(0);
+        return true;
+    }
 
-        // Input
-        ImGui::BeginGroup();
-        ImNodes::BeginInputAttribute(input_ids_[0]);
-        ImNodes::EndInputAttribute();
-        ImGui::EndGroup();
+    bool GainBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        // Gains that differ between lanes aren't one system
+        if (lane_vals_.size() > 0)
+        {
+            return false;
+        }
 
-        ImGui::SameLine();
+        int n = inputs_[0]->GetSize();
+        ss->SetABCD(Eigen::MatrixXd::Zero(0, 0), Eigen::MatrixXd::Zero(0, n),
+                    Eigen::MatrixXd::Zero(n, 0),
+                    val_ * Eigen::MatrixXd::Identity(n, n));
+        return true;
+    }
 
-        // Output
-        ImGui::BeginGroup();
-        ImNodes::BeginOutputAttribute(output_ids_[0]);
-        ImGui::InputScalar("", ImGuiDataType_Double, &val_, NULL);
-        ImNodes::EndOutputAttribute();
-        ImGui::EndGroup();
+    double GainBlock::GetGain() { return val_; }
 
-        // Reset item width for the next block.
-        ImGui::PopItemWidth();
+    void GainBlock::SetGain(double gain) { val_ = gain; }
 
-        ImNodes::EndNode();
+    bool GainBlock::SetParameter(const std::string &name,
+                                 const Eigen::MatrixXd &value)
+    {
+        if (name == "gain" && value.size() == 1)
+        {
+            val_ = value(0, 0);
+            return true;
+        }
+        if (name == "gain" && value.rows() == 1)
+        {
+            lane_vals_ = value.row(0);
+            return true;
+        }
+        return Block::SetParameter(name, value);
     }
 
     toml::table GainBlock::Serialize()
@@ -102,13 +135,10 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{
             {"type", "GainBlock"}, {"name", this->name_},   {"id", this->id_},
-            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", pos.x},
-            {"y_pos", pos.y},      {"gain", val_}};
+            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", x_pos_},
+            {"y_pos", y_pos_},     {"gain", val_}};
 
         return tbl;
     }
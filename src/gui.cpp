@@ -1,232 +0,0 @@
-#include "controlblocks/gui.h"
-
-void Gui::Init()
-{
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) !=
-        0)
-    {
-        std::string sdl_error = SDL_GetError();
-        throw std::runtime_error("Error: " + sdl_error);
-    }
-
-    // Decide GL+GLSL versions
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-    // GL ES 2.0 + GLSL 100
-    const char *glsl_version = "#version 100";
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
-#elif defined(__APPLE__)
-    // GL 3.2 Core + GLSL 150
-    const char *glsl_version = "#version 150";
-    SDL_GL_SetAttribute(
-        SDL_GL_CONTEXT_FLAGS,
-        SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG); // Always required on Mac
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
-                        SDL_GL_CONTEXT_PROFILE_CORE);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
-#else
-    // GL 3.0 + GLSL 130
-    const char *glsl_version = "#version 130";
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
-                        SDL_GL_CONTEXT_PROFILE_CORE);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
-#endif
-
-    // Create window with graphics context
-    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-    SDL_WindowFlags window_flags =
-        (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE |
-                          SDL_WINDOW_ALLOW_HIGHDPI);
-    window = SDL_CreateWindow("Control Simulation", SDL_WINDOWPOS_CENTERED,
-                              SDL_WINDOWPOS_CENTERED, 1280, 720, window_flags);
-    gl_context = SDL_GL_CreateContext(window);
-    SDL_GL_MakeCurrent(window, gl_context);
-    SDL_GL_SetSwapInterval(1); // Enable vsync
-
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-
-    ImNodes::CreateContext();
-    // NodeEditorInitialize();
-
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-    // ImGui::StyleColorsClassic();
-
-    // ImNodes style
-    ImNodes::StyleColorsDark();
-
-    // Setup Platform/Renderer backends
-    ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
-    ImGui_ImplOpenGL3_Init(glsl_version);
-
-    // Setup ImPlot context
-    ImPlot::CreateContext();
-
-    // Initialize the workspace
-    workspace_.Init();
-
-    // Initialize the diagram
-    diagram_.Init();
-}
-
-bool Gui::Update()
-{
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
-    {
-        ImGui_ImplSDL2_ProcessEvent(&event);
-        if (event.type == SDL_QUIT)
-            throw std::runtime_error("Program Closed");
-        if (event.type == SDL_WINDOWEVENT &&
-            event.window.event == SDL_WINDOWEVENT_CLOSE &&
-            event.window.windowID == SDL_GetWindowID(window))
-            throw std::runtime_error("Program Closed");
-    }
-
-    // Start the Dear ImGui frame
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL2_NewFrame();
-    ImGui::NewFrame();
-
-    // Show menubar and toolbar
-    this->Menubar();
-    this->Toolbar();
-
-    // Update the workspace
-    workspace_.Update();
-
-    // Show the diagram
-    diagram_.Update(gui_data_);
-
-    return true;
-}
-
-void Gui::Render()
-{
-    ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
-
-    // Get I/O
-    ImGuiIO &io = ImGui::GetIO();
-
-    // Rendering
-    ImGui::Render();
-    glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-    glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w,
-                 clear_color.z * clear_color.w, clear_color.w);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    SDL_GL_SwapWindow(window);
-}
-
-void Gui::Stop()
-{
-    // Shutdown the workspace
-    workspace_.Stop();
-
-    // Cleanup
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
-
-    ImNodes::DestroyContext();
-    ImGui::DestroyContext();
-
-    SDL_GL_DeleteContext(gl_context);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-}
-
-void Gui::Menubar()
-{
-    if (ImGui::BeginMainMenuBar())
-    {
-        if (ImGui::BeginMenu("Options"))
-        {
-            if (ImGui::MenuItem("Settings"))
-            {
-                // TODO
-            }
-            ImGui::EndMenu();
-        }
-
-        ImGui::EndMainMenuBar();
-    }
-}
-
-void Gui::Toolbar()
-{
-    float height = ImGui::GetFrameHeight();
-
-    ImGuiViewport *viewport = ImGui::GetMainViewport();
-    ImGui::SetNextWindowPos(ImVec2(viewport->Pos.x, viewport->Pos.y + height));
-    ImGui::SetNextWindowSize(ImVec2(viewport->Size.x, 50));
-    ImGuiWindowFlags window_flags =
-        0 | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
-        ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar |
-        ImGuiWindowFlags_NoSavedSettings;
-    ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
-
-    // Begin the toolbar
-    ImGui::Begin("TOOLBAR", NULL, window_flags);
-    ImGui::PopStyleVar();
-
-    gui_data_.start = ImGui::Button("Run", ImVec2(0, 37));
-    ImGui::SameLine();
-    gui_data_.pause = ImGui::Button("Pause", ImVec2(0, 37));
-    ImGui::SameLine();
-    gui_data_.stop = ImGui::Button("Stop", ImVec2(0, 37));
-
-    // Timing
-    ImGui::SameLine();
-    ImGui::BeginGroup();
-    ImGui::TextUnformatted("tf:");
-    ImGui::SameLine();
-    ImGui::PushItemWidth(75.0);
-    ImGui::InputScalar("tf", ImGuiDataType_Double, &gui_data_.sim_time, NULL);
-
-    ImGui::TextUnformatted("dt:");
-    ImGui::SameLine();
-    ImGui::PushItemWidth(75.0);
-    ImGui::InputScalar("dt", ImGuiDataType_Double, &gui_data_.dt, NULL);
-    ImGui::EndGroup();
-
-    // ODE Solver
-    ImGui::SameLine();
-    if (ImGui::BeginCombo("ODE Solver", gui_data_.solver.data()))
-    {
-        for (int i = 0; i < ode_solvers.size(); i++)
-        {
-            bool is_selected =
-                (gui_data_.solver.c_str() ==
-                 ode_solvers[i]
-                     .c_str()); // You can store your selection however you
-                                // want, outside or inside your objects
-            if (ImGui::Selectable(ode_solvers[i].c_str(), is_selected))
-            {
-                gui_data_.solver = ode_solvers[i];
-            }
-            if (is_selected)
-            {
-                ImGui::SetItemDefaultFocus(); // You may set the initial focus
-                                              // when opening the combo
-                                              // (scrolling + for keyboard
-                                              // navigation support)
-            }
-        }
-        ImGui::EndCombo();
-    }
-
-    // Show simulation time
-    ImGui::SameLine();
-    ImGui::Text("%s: %f", "Simulation Time", diagram_.GetTime());
-
-    ImGui::End();
-}
@@ -0,0 +1,434 @@
+#include "controlblocks/gui/block_renderer.h"
+
+using namespace ControlBlock;
+
+void BlockRenderer::Render(std::shared_ptr<Block> block)
+{
+    // Draw the block according to its type
+    if (auto constant = std::dynamic_pointer_cast<ConstantBlock>(block))
+    {
+        this->RenderConstant(constant);
+    }
+    else if (auto gain = std::dynamic_pointer_cast<GainBlock>(block))
+    {
+        this->RenderGain(gain);
+    }
+    else if (auto sum = std::dynamic_pointer_cast<SumBlock>(block))
+    {
+        this->RenderSum(sum);
+    }
+    else if (auto display = std::dynamic_pointer_cast<DisplayBlock>(block))
+    {
+        this->RenderDisplay(display);
+    }
+    else if (auto mux = std::dynamic_pointer_cast<MuxBlock>(block))
+    {
+        this->RenderMux(mux);
+    }
+    else if (auto ss = std::dynamic_pointer_cast<StateSpaceBlock>(block))
+    {
+        this->RenderStateSpace(ss);
+    }
+    else if (std::dynamic_pointer_cast<UnitDelayBlock>(block) ||
+             std::dynamic_pointer_cast<ZeroOrderHoldBlock>(block) ||
+             std::dynamic_pointer_cast<RateTransitionBlock>(block))
+    {
+        this->RenderSampled(block);
+    }
+}
+
+void BlockRenderer::Settings(std::shared_ptr<Block> block)
+{
+    // Only some blocks have settings
+    auto mux = std::dynamic_pointer_cast<MuxBlock>(block);
+    auto ss = std::dynamic_pointer_cast<StateSpaceBlock>(block);
+    auto rate = std::dynamic_pointer_cast<RateTransitionBlock>(block);
+    auto delay = std::dynamic_pointer_cast<UnitDelayBlock>(block);
+    bool sampled = delay != nullptr ||
+                   std::dynamic_pointer_cast<ZeroOrderHoldBlock>(block) ||
+                   rate != nullptr;
+    if (mux == nullptr && ss == nullptr && !sampled)
+    {
+        return;
+    }
+
+    // State space blocks are not useful until their matrices are set, so their
+    // settings are shown as soon as they are added.
+    int id = block->GetId();
+    if (settings_open_.find(id) == settings_open_.end())
+    {
+        settings_open_[id] = (ss != nullptr);
+    }
+
+    // If node is double clicked, show the settings
+    int hover_id = -1;
+    ImNodes::IsNodeHovered(&hover_id);
+    if ((hover_id == id && ImGui::IsMouseDoubleClicked(0)) ||
+        settings_open_[id])
+    {
+        settings_open_[id] = true;
+        std::string setting_name = block->GetName() + " settings";
+        bool is_open = true;
+        ImGui::Begin(setting_name.c_str(), &is_open);
+
+        // Set the focus to the settings so the window isn't hidden.
+        ImGui::SetWindowFocus();
+        if (mux != nullptr)
+        {
+            this->SettingsMux(mux);
+        }
+        else if (ss != nullptr)
+        {
+            this->SettingsStateSpace(ss);
+        }
+        else if (rate != nullptr)
+        {
+            this->SettingsRateTransition(rate);
+        }
+        else if (delay != nullptr)
+        {
+            this->SettingsInitialValue(delay, delay->GetInitial());
+        }
+
+        // Sampled blocks also take their sample time
+        if (block->IsDiscrete())
+        {
+            this->SettingsSampleTime(block);
+        }
+        ImGui::End();
+
+        settings_open_[id] = is_open;
+    }
+}
+
+void BlockRenderer::Clear() { settings_open_.clear(); }
+
+void BlockRenderer::SetSimWorker(SimWorker *worker) { worker_ = worker; }
+
+float BlockRenderer::BeginBlockNode(std::shared_ptr<Block> block)
+{
+    ImNodes::BeginNode(block->GetId());
+
+    ImGui::Spacing();
+
+    // Ensure the node is just as wide as the title or the minimum width.
+    std::string name = block->GetName();
+    float node_width =
+        std::max(min_node_width_, ImGui::CalcTextSize(name.c_str()).x);
+    ImGui::PushItemWidth(node_width);
+
+    // Allow the block name to be changed
+    ImNodes::BeginNodeTitleBar();
+    char name_str[128];
+    strncpy(name_str, name.c_str(), IM_ARRAYSIZE(name_str) - 1);
+    name_str[IM_ARRAYSIZE(name_str) - 1] = '\0';
+    ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
+    block->SetName(name_str);
+    ImNodes::EndNodeTitleBar();
+
+    return node_width;
+}
+
+void BlockRenderer::EndBlockNode()
+{
+    // Reset item width for the next block.
+    ImGui::PopItemWidth();
+
+    ImNodes::EndNode();
+}
+
+void BlockRenderer::RenderConstant(std::shared_ptr<ConstantBlock> block)
+{
+    this->BeginBlockNode(block);
+
+    for (int i = 0; i < block->NumOutputPorts(); ++i)
+    {
+        double val = block->GetValue();
+        ImNodes::BeginOutputAttribute(block->GetOutputPortId(i));
+        ImGui::TextUnformatted(" ");
+        ImGui::SameLine();
+        if (ImGui::InputScalar("", ImGuiDataType_Double, &val, NULL))
+        {
+            block->SetValue(val);
+        }
+        ImNodes::EndOutputAttribute();
+    }
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderGain(std::shared_ptr<GainBlock> block)
+{
+    this->BeginBlockNode(block);
+
+    // Input
+    ImGui::BeginGroup();
+    ImNodes::BeginInputAttribute(block->GetInputPortId(0));
+    ImNodes::EndInputAttribute();
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    // Output
+    double gain = block->GetGain();
+    ImGui::BeginGroup();
+    ImNodes::BeginOutputAttribute(block->GetOutputPortId(0));
+    if (ImGui::InputScalar("", ImGuiDataType_Double, &gain, NULL))
+    {
+        block->SetGain(gain);
+    }
+    ImNodes::EndOutputAttribute();
+    ImGui::EndGroup();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderSum(std::shared_ptr<SumBlock> block)
+{
+    float node_width = this->BeginBlockNode(block);
+
+    // Input group
+    ImGui::BeginGroup();
+    for (int i = 0; i < block->NumInputPorts(); ++i)
+    {
+        ImNodes::BeginInputAttribute(block->GetInputPortId(i));
+        ImGui::TextUnformatted("+");
+        ImNodes::EndInputAttribute();
+    }
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    // Output group
+    ImGui::BeginGroup();
+    ImNodes::BeginOutputAttribute(block->GetOutputPortId(0));
+    const float label_width = ImGui::CalcTextSize("Sum").x;
+    ImGui::Indent(node_width - label_width);
+    ImGui::TextUnformatted("Sum");
+    ImNodes::EndOutputAttribute();
+    ImGui::EndGroup();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderDisplay(std::shared_ptr<DisplayBlock> block)
+{
+    this->BeginBlockNode(block);
+
+    // Input
+    ImGui::BeginGroup();
+    ImNodes::BeginInputAttribute(block->GetInputPortId(0));
+    ImNodes::EndInputAttribute();
+    ImGui::SameLine();
+
+    // Print each value in a new line.
+    const Eigen::VectorXd *published = nullptr;
+    if (worker_ != nullptr)
+    {
+        published = worker_->GetDisplayValue(block->GetId());
+    }
+    const Eigen::VectorXd &val =
+        (published != nullptr) ? *published : block->GetValue();
+    ImGui::BeginGroup();
+    for (int i = 0; i < val.size(); ++i)
+    {
+        ImGui::TextUnformatted(std::to_string(val(i)).c_str());
+    }
+    ImGui::EndGroup();
+
+    ImGui::EndGroup();
+
+    ImGui::Spacing();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderMux(std::shared_ptr<MuxBlock> block)
+{
+    float node_width = this->BeginBlockNode(block);
+
+    // Input group
+    ImGui::BeginGroup();
+    for (int i = 0; i < block->NumInputPorts(); ++i)
+    {
+        std::string pin_name = "in" + std::to_string(i);
+        ImNodes::BeginInputAttribute(block->GetInputPortId(i));
+        ImGui::TextUnformatted(pin_name.c_str());
+        ImNodes::EndInputAttribute();
+    }
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    // Output group
+    ImGui::BeginGroup();
+    ImNodes::BeginOutputAttribute(block->GetOutputPortId(0));
+    const float label_width = ImGui::CalcTextSize(">").x;
+    ImGui::Indent(node_width - label_width);
+    ImGui::TextUnformatted(">");
+    ImNodes::EndOutputAttribute();
+    ImGui::EndGroup();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderStateSpace(std::shared_ptr<StateSpaceBlock> block)
+{
+    float node_width = this->BeginBlockNode(block);
+
+    // Input
+    ImGui::BeginGroup();
+    ImNodes::BeginInputAttribute(block->GetInputPortId(0));
+    ImGui::TextUnformatted("u");
+    ImNodes::EndInputAttribute();
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    // Output
+    ImGui::BeginGroup();
+    ImNodes::BeginOutputAttribute(block->GetOutputPortId(0));
+    const float label_width = ImGui::CalcTextSize("y").x;
+    ImGui::Indent(node_width - label_width);
+    ImGui::TextUnformatted("y");
+    ImNodes::EndOutputAttribute();
+    ImGui::EndGroup();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::RenderSampled(std::shared_ptr<Block> block)
+{
+    float node_width = this->BeginBlockNode(block);
+
+    // Input
+    ImGui::BeginGroup();
+    ImNodes::BeginInputAttribute(block->GetInputPortId(0));
+    ImGui::TextUnformatted("u");
+    ImNodes::EndInputAttribute();
+    ImGui::EndGroup();
+
+    ImGui::SameLine();
+
+    // Output
+    ImGui::BeginGroup();
+    ImNodes::BeginOutputAttribute(block->GetOutputPortId(0));
+    const float label_width = ImGui::CalcTextSize("y").x;
+    ImGui::Indent(node_width - label_width);
+    ImGui::TextUnformatted("y");
+    ImNodes::EndOutputAttribute();
+    ImGui::EndGroup();
+
+    this->EndBlockNode();
+}
+
+void BlockRenderer::SettingsMux(std::shared_ptr<MuxBlock> block)
+{
+    // Modify number of inputs
+    int num_inputs = block->GetNumInputs();
+    if (ImGui::InputInt("# inputs", &num_inputs))
+    {
+        block->SetNumInputs(num_inputs);
+    }
+}
+
+void BlockRenderer::SettingsStateSpace(std::shared_ptr<StateSpaceBlock> block)
+{
+    // Modify matrices
+    std::vector<std::string> names = block->GetMatrixNames();
+    const char *labels[] = {"A:", "B:", "C:", "D:"};
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        char mat_str[128];
+        strncpy(mat_str, names[i].c_str(), IM_ARRAYSIZE(mat_str) - 1);
+        mat_str[IM_ARRAYSIZE(mat_str) - 1] = '\0';
+        ImGui::InputText(labels[i], mat_str, IM_ARRAYSIZE(mat_str));
+        names[i] = mat_str;
+    }
+    block->SetMatrixNames(names);
+
+    // Discrete state space blocks are always sampled
+    if (std::dynamic_pointer_cast<DiscreteStateSpaceBlock>(block))
+    {
+        return;
+    }
+
+    // Advance the states exactly once per sample instead of with the solver
+    bool zoh = block->GetZeroOrderHold();
+    ImGui::Checkbox("Exact ZOH", &zoh);
+    block->SetZeroOrderHold(zoh);
+}
+
+void BlockRenderer::SettingsRateTransition(
+    std::shared_ptr<RateTransitionBlock> block)
+{
+    // Hold the previous sample rather than passing the input through
+    bool delay = block->GetDelay();
+    ImGui::Checkbox("Delay", &delay);
+    block->SetDelay(delay);
+
+    // Without the delay the output follows the input from the start
+    if (delay)
+    {
+        this->SettingsInitialValue(block, block->GetInitial());
+    }
+}
+
+void BlockRenderer::SettingsInitialValue(std::shared_ptr<Block> block,
+                                         const Eigen::VectorXd &x0)
+{
+    // The output before the first sample, which sets the width of the
+    // signal, as a list of numbers separated by commas
+    std::ostringstream x0_stream;
+    for (int i = 0; i < x0.size(); ++i)
+    {
+        x0_stream << (i > 0 ? ", " : "") << x0(i);
+    }
+    char x0_str[256];
+    strncpy(x0_str, x0_stream.str().c_str(), IM_ARRAYSIZE(x0_str) - 1);
+    x0_str[IM_ARRAYSIZE(x0_str) - 1] = '\0';
+
+    // Only apply the list once it is entered, and ignore it unless every
+    // element is a number
+    if (!ImGui::InputText("Initial value", x0_str, IM_ARRAYSIZE(x0_str),
+                          ImGuiInputTextFlags_EnterReturnsTrue))
+    {
+        return;
+    }
+    std::vector<double> values;
+    std::istringstream x0_input(x0_str);
+    std::string element;
+    while (std::getline(x0_input, element, ','))
+    {
+        try
+        {
+            size_t end = 0;
+            values.push_back(std::stod(element, &end));
+            if (element.find_first_not_of(" \t", end) != std::string::npos)
+            {
+                return;
+            }
+        }
+        catch (std::exception &e)
+        {
+            return;
+        }
+    }
+    if (!values.empty())
+    {
+        block->SetInitial(
+            Eigen::Map<Eigen::VectorXd>(values.data(), values.size()));
+    }
+}
+
+void BlockRenderer::SettingsSampleTime(std::shared_ptr<Block> block)
+{
+    // A period of zero or less samples the block once per step
+    SampleTime sample_time = block->GetSampleTime();
+    bool changed = ImGui::InputDouble("Sample time", &sample_time.period);
+    changed |= ImGui::InputDouble("Offset", &sample_time.offset);
+    if (changed)
+    {
+        block->SetSampleTime(sample_time.period, sample_time.offset);
+    }
+}
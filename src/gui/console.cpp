@@ -1,4 +1,4 @@
-#include "controlblocks/console.h"
+#include "controlblocks/gui/console.h"
 
 std::vector<std::string> Console::output_;
 
@@ -0,0 +1,412 @@
+#include "controlblocks/gui/diagram_editor.h"
+
+void DiagramEditor::Update(GuiData &gui_data)
+{
+    // Post the GUI events to the simulation thread
+    worker_.SetPacing(gui_data);
+    if (gui_data.start && !worker_.IsRunning())
+    {
+        // Reset the simulation if the simulator wasn't previously paused.
+        if (!worker_.IsPaused())
+        {
+            worker_.Start(gui_data);
+        }
+        else
+        {
+            worker_.Resume();
+        }
+    }
+    if (gui_data.pause)
+    {
+        worker_.Pause();
+    }
+    if (gui_data.stop)
+    {
+        worker_.Stop();
+    }
+
+    // Show the latest values from the simulation thread
+    worker_.Refresh();
+
+    bool sim_active = worker_.IsRunning() || worker_.IsPaused();
+
+    // Show the diagram
+    auto flags = ImGuiWindowFlags_MenuBar;
+    ImGui::Begin("Block Diagram", NULL, flags);
+
+    this->MenuBar();
+
+    // Begin the diagram editor
+    ImNodes::BeginNodeEditor();
+
+    // Allow blocks to be added to the diagram when the simulation isn't
+    // active. A paused run keeps the state layout it was started with.
+    if (!sim_active)
+    {
+        this->AddBlockPopup();
+    }
+
+    // Render the blocks in the diagram
+    this->Render();
+
+    // Determine if the window has focus
+    focus_ = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
+
+    // End the diagram editor
+    ImNodes::EndNodeEditor();
+    ImGui::End();
+
+    // Enable edits outside of the ImNodes context
+    if (!sim_active)
+    {
+        // Add / Remove new wires to the diagram if the simulation is not active
+        this->EditWires();
+
+        // Remove any blocks set for deletion
+        this->DetectBlockRemoval();
+
+        // Allow blocks to have settings edited when the simulation isn't
+        // running
+        this->EditSettings();
+
+        // Allow shortcuts when sim isn't running and this is focused
+        if (focus_)
+        {
+            this->Shortcuts();
+        }
+    }
+}
+
+void DiagramEditor::DetectBlockRemoval()
+{
+    // If any blocks are selected and the user wants to delete them, then delete
+    // all selected.
+    int num_blocks_selected = ImNodes::NumSelectedNodes();
+    if (num_blocks_selected > 0 && ImGui::IsKeyReleased(SDL_SCANCODE_DELETE))
+    {
+        std::vector<int> selected_block_ids(num_blocks_selected);
+        ImNodes::GetSelectedNodes(selected_block_ids.data());
+
+        // Go through each block to delete and delete it
+        for (int i = 0; i < num_blocks_selected; ++i)
+        {
+            diagram_.RemoveBlock(selected_block_ids[i]);
+            placed_blocks_.erase(selected_block_ids[i]);
+        }
+    }
+}
+
+void DiagramEditor::MenuBar()
+{
+
+    if (ImGui::BeginMenuBar())
+    {
+        if (ImGui::BeginMenu("File"))
+        {
+            // TODO: on New/Open, prompt user to save unsaved work
+            if (ImGui::MenuItem("New", "Ctrl+N", nullptr, true))
+            {
+                this->NewDiagram();
+            }
+            else if (ImGui::MenuItem("Open", "Ctrl+O", nullptr, true))
+            {
+                this->Load();
+            }
+            else if (ImGui::MenuItem("Save", "Ctrl+S", nullptr, true))
+            {
+                this->Save();
+            }
+            else if (ImGui::MenuItem("Save As..."))
+            {
+                this->SaveAs();
+            }
+
+            ImGui::EndMenu();
+        }
+
+        ImGui::EndMenuBar();
+    }
+}
+
+void DiagramEditor::Render()
+{
+    std::vector<std::shared_ptr<ControlBlock::Block>> blocks =
+        diagram_.GetBlocks();
+
+    // When profiling, tint each node by its share of the time spent in blocks
+    std::map<int, float> heat;
+    if (diagram_.GetProfiler().IsEnabled())
+    {
+        heat = this->BlockHeat();
+    }
+
+    // Render each block
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        // Blocks loaded from a file are placed at their saved position the
+        // first time they are drawn.
+        int id = blocks[i]->GetId();
+        if (placed_blocks_.find(id) == placed_blocks_.end())
+        {
+            ImNodes::SetNodeGridSpacePos(
+                id, ImVec2(blocks[i]->GetX(), blocks[i]->GetY()));
+            placed_blocks_.insert(id);
+        }
+
+        auto block_heat = heat.find(id);
+        if (block_heat != heat.end())
+        {
+            // Dark grey for the cheapest blocks up to red for the most
+            // expensive
+            float h = block_heat->second;
+            ImNodes::PushColorStyle(
+                ImNodesCol_TitleBar,
+                IM_COL32(60 + static_cast<int>(180 * h),
+                         60 - static_cast<int>(30 * h),
+                         60 - static_cast<int>(30 * h), 255));
+            renderer_.Render(blocks[i]);
+            ImNodes::PopColorStyle();
+        }
+        else
+        {
+            renderer_.Render(blocks[i]);
+        }
+    }
+
+    // Render each wire
+    std::vector<std::shared_ptr<ControlBlock::Wire>> wires =
+        diagram_.GetWires();
+    for (size_t i = 0; i < wires.size(); ++i)
+    {
+        ImNodes::Link(wires[i]->GetId(), wires[i]->GetFromId(),
+                      wires[i]->GetToId());
+    }
+}
+
+std::map<int, float> DiagramEditor::BlockHeat()
+{
+    std::vector<BlockProfile> profiles =
+        diagram_.GetProfiler().GetBlockProfiles();
+
+    double max_total = 0.0;
+    for (const BlockProfile &profile : profiles)
+    {
+        max_total = std::max(max_total, profile.total);
+    }
+
+    // Scale by the slowest block so hot spots stand out on big diagrams
+    std::map<int, float> heat;
+    for (const BlockProfile &profile : profiles)
+    {
+        heat[profile.id] =
+            (max_total > 0.0) ? static_cast<float>(profile.total / max_total)
+                              : 0.0f;
+    }
+    return heat;
+}
+
+void DiagramEditor::EditWires()
+{
+    // Detect wire creations
+    int start_attr, end_attr;
+    if (ImNodes::IsLinkCreated(&start_attr, &end_attr))
+    {
+        // Register a new wire
+        diagram_.AddWire(start_attr, end_attr);
+    }
+
+    // Detect wire deletion
+    int link_id;
+    if (ImNodes::IsLinkDestroyed(&link_id))
+    {
+        diagram_.RemoveWire(link_id);
+    }
+
+    // Detect multiple wire deletion by user.
+    int num_wires_selected = ImNodes::NumSelectedLinks();
+    if (num_wires_selected > 0 && ImGui::IsKeyReleased(SDL_SCANCODE_DELETE))
+    {
+        // Get the selected wires
+        std::vector<int> selected_wires(num_wires_selected);
+        ImNodes::GetSelectedLinks(selected_wires.data());
+
+        // Remove each wire
+        for (const int wire_id : selected_wires)
+        {
+            diagram_.RemoveWire(wire_id);
+        }
+    }
+}
+
+void DiagramEditor::EditSettings()
+{
+    std::vector<std::shared_ptr<ControlBlock::Block>> blocks =
+        diagram_.GetBlocks();
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        renderer_.Settings(blocks[i]);
+    }
+}
+
+void DiagramEditor::Shortcuts()
+{
+    // Do actions from menu selections or shortcuts
+    if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
+                         SDL_SCANCODE_N))
+    {
+        this->NewDiagram();
+    }
+    else if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
+                              SDL_SCANCODE_O))
+    {
+        this->Load();
+    }
+    else if (DetectLRShortcut(SDL_SCANCODE_LCTRL, SDL_SCANCODE_RCTRL,
+                              SDL_SCANCODE_S))
+    {
+        this->Save();
+    }
+}
+
+void DiagramEditor::NewDiagram()
+{
+    // Clear diagram
+    this->ClearDiagram();
+}
+
+void DiagramEditor::Load()
+{
+    // Get the diagram to open
+    bool result = OpenFileDialog(&filename_);
+
+    // If the diagram is legit, then open it
+    if (result)
+    {
+        this->ClearDiagram();
+        diagram_.LoadDiagram(filename_);
+    }
+}
+
+void DiagramEditor::Save()
+{
+    // Save diagram
+    bool result = true;
+    if (filename_.empty())
+    {
+        result = SaveFileDialog(&filename_);
+    }
+
+    // Save if the filename is loaded or it was already set.
+    if (result)
+    {
+        this->StorePositions();
+        diagram_.SaveDiagram(filename_);
+    }
+}
+
+void DiagramEditor::SaveAs()
+{
+    // Save diagram with new name
+    bool result = SaveFileDialog(&filename_);
+
+    // Save if the filename is loaded or it was already set.
+    if (result)
+    {
+        this->StorePositions();
+        diagram_.SaveDiagram(filename_);
+    }
+}
+
+void DiagramEditor::ClearDiagram()
+{
+    // Take the diagram back from the simulation thread before clearing it
+    worker_.ClearPublished();
+    diagram_.ClearDiagram();
+    renderer_.Clear();
+    placed_blocks_.clear();
+
+    // Reset ImNodes
+    ImNodes::DestroyContext();
+    ImNodes::CreateContext();
+    ImNodes::StyleColorsDark();
+}
+
+void DiagramEditor::StorePositions()
+{
+    std::vector<std::shared_ptr<ControlBlock::Block>> blocks =
+        diagram_.GetBlocks();
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        ImVec2 pos = ImNodes::GetNodeGridSpacePos(blocks[i]->GetId());
+        blocks[i]->SetPosition(pos.x, pos.y);
+    }
+}
+
+void DiagramEditor::AddBlockPopup()
+{
+    // Open the block adder popup with a right click
+    const bool block_adder_open =
+        ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) &&
+        ImNodes::IsEditorHovered() &&
+        ImGui::IsMouseClicked(ImGuiMouseButton_Right);
+
+    if (block_adder_open && !ImGui::IsAnyItemHovered())
+    {
+        ImGui::OpenPopup("Add Block");
+    }
+
+    // Define the Add Block popup
+    if (ImGui::BeginPopup("Add Block"))
+    {
+
+        // Get a mouse click location
+        const ImVec2 click_pos = ImGui::GetMousePosOnOpeningCurrentPopup();
+
+        // Loop through available block types
+        if (ImGui::MenuItem("Constant"))
+        {
+            // Create a constant block
+            this->AddBlock<ControlBlock::ConstantBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Gain"))
+        {
+            // Create gain block
+            this->AddBlock<ControlBlock::GainBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Display"))
+        {
+            // Register new display block
+            this->AddBlock<ControlBlock::DisplayBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Sum"))
+        {
+            this->AddBlock<ControlBlock::SumBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Mux"))
+        {
+            this->AddBlock<ControlBlock::MuxBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("State Space"))
+        {
+            this->AddBlock<ControlBlock::StateSpaceBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Discrete State Space"))
+        {
+            this->AddBlock<ControlBlock::DiscreteStateSpaceBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Unit Delay"))
+        {
+            this->AddBlock<ControlBlock::UnitDelayBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Zero-Order Hold"))
+        {
+            this->AddBlock<ControlBlock::ZeroOrderHoldBlock>(click_pos);
+        }
+        else if (ImGui::MenuItem("Rate Transition"))
+        {
+            this->AddBlock<ControlBlock::RateTransitionBlock>(click_pos);
+        }
+
+        ImGui::EndPopup(); // end "Add Block"
+    }
+}
@@ -1,4 +1,4 @@
-#include "controlblocks/file_utils.h"
+#include "controlblocks/gui/file_utils.h"
 
 bool OpenFileDialog(std::string *path)
 {
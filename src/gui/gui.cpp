@@ -0,0 +1,435 @@
+#include "controlblocks/gui/gui.h"
+
+void Gui::Init()
+{
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) !=
+        0)
+    {
+        std::string sdl_error = SDL_GetError();
+        throw std::runtime_error("Error: " + sdl_error);
+    }
+
+    // Decide GL+GLSL versions
+#if defined(IMGUI_IMPL_OPENGL_ES2)
+    // GL ES 2.0 + GLSL 100
+    const char *glsl_version = "#version 100";
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+#elif defined(__APPLE__)
+    // GL 3.2 Core + GLSL 150
+    const char *glsl_version = "#version 150";
+    SDL_GL_SetAttribute(
+        SDL_GL_CONTEXT_FLAGS,
+        SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG); // Always required on Mac
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+#else
+    // GL 3.0 + GLSL 130
+    const char *glsl_version = "#version 130";
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+#endif
+
+    // Create window with graphics context
+    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+    SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+    SDL_WindowFlags window_flags =
+        (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE |
+                          SDL_WINDOW_ALLOW_HIGHDPI);
+    window = SDL_CreateWindow("Control Simulation", SDL_WINDOWPOS_CENTERED,
+                              SDL_WINDOWPOS_CENTERED, 1280, 720, window_flags);
+    gl_context = SDL_GL_CreateContext(window);
+    SDL_GL_MakeCurrent(window, gl_context);
+    SDL_GL_SetSwapInterval(1); // Enable vsync
+
+    // Setup Dear ImGui context
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+
+    ImNodes::CreateContext();
+    // NodeEditorInitialize();
+
+    // Setup Dear ImGui style
+    ImGui::StyleColorsDark();
+    // ImGui::StyleColorsClassic();
+
+    // ImNodes style
+    ImNodes::StyleColorsDark();
+
+    // Setup Platform/Renderer backends
+    ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
+    ImGui_ImplOpenGL3_Init(glsl_version);
+
+    // Setup ImPlot context
+    ImPlot::CreateContext();
+
+    // Initialize the workspace
+    workspace_.Init();
+
+    // Initialize the diagram
+    diagram_.Init();
+}
+
+bool Gui::Update()
+{
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        ImGui_ImplSDL2_ProcessEvent(&event);
+        if (event.type == SDL_QUIT)
+            throw std::runtime_error("Program Closed");
+        if (event.type == SDL_WINDOWEVENT &&
+            event.window.event == SDL_WINDOWEVENT_CLOSE &&
+            event.window.windowID == SDL_GetWindowID(window))
+            throw std::runtime_error("Program Closed");
+    }
+
+    // Start the Dear ImGui frame
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplSDL2_NewFrame();
+    ImGui::NewFrame();
+
+    // Show menubar and toolbar
+    this->Menubar();
+    this->Toolbar();
+    this->RealTimeWindow();
+    this->ProfileWindow();
+
+    // Update the workspace
+    workspace_.Update();
+
+    // Show the diagram
+    editor_.Update(gui_data_);
+
+    return true;
+}
+
+void Gui::Render()
+{
+    ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+
+    // Get I/O
+    ImGuiIO &io = ImGui::GetIO();
+
+    // Rendering
+    ImGui::Render();
+    glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+    glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w,
+                 clear_color.z * clear_color.w, clear_color.w);
+    glClear(GL_COLOR_BUFFER_BIT);
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    SDL_GL_SwapWindow(window);
+}
+
+void Gui::Stop()
+{
+    // Shutdown the workspace
+    workspace_.Stop();
+
+    // Cleanup
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplSDL2_Shutdown();
+
+    ImNodes::DestroyContext();
+    ImGui::DestroyContext();
+
+    SDL_GL_DeleteContext(gl_context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+void Gui::Menubar()
+{
+    if (ImGui::BeginMainMenuBar())
+    {
+        if (ImGui::BeginMenu("Options"))
+        {
+            if (ImGui::MenuItem("Settings"))
+            {
+                // TODO
+            }
+
+            // Threads apply from the next run
+            ImGui::Separator();
+            ImGui::PushItemWidth(75.0);
+            if (ImGui::InputInt("Simulation Threads", &gui_data_.sim_threads))
+            {
+                int max_threads =
+                    std::max(1u, std::thread::hardware_concurrency());
+                gui_data_.sim_threads =
+                    std::clamp(gui_data_.sim_threads, 1, max_threads);
+            }
+            ImGui::PopItemWidth();
+
+            // Compiling applies from the next run, which stays interpreted
+            // until the compiler finishes
+            ImGui::MenuItem("Compile Diagram", NULL, &gui_data_.native);
+
+            // Fused and folded blocks read their parameters when the run
+            // starts, so turn these off to tune gains and constants live
+            ImGui::MenuItem("Fuse Linear Blocks", NULL,
+                            &gui_data_.fuse_linear);
+            ImGui::MenuItem("Fold Constants", NULL,
+                            &gui_data_.fold_constants);
+            ImGui::MenuItem("Solve Algebraic Loops", NULL,
+                            &gui_data_.solve_loops);
+
+            // Profiling applies from the next run. The trace can only be
+            // saved while the simulation thread isn't writing it.
+            ImGui::Separator();
+            ImGui::MenuItem("Profile Simulation", NULL, &gui_data_.profile);
+            if (ImGui::MenuItem("Export Chrome Trace...", NULL, false,
+                                !worker_.IsRunning()))
+            {
+                std::string trace_file = "";
+                if (SaveFileDialog(&trace_file) &&
+                    !diagram_.GetProfiler().WriteChromeTrace(trace_file))
+                {
+                    std::cout << "Could not write " << trace_file << "\n";
+                }
+            }
+
+            // Generating starts the diagram, so it can't overlap a run,
+            // including a paused one it would throw away
+            ImGui::Separator();
+            if (ImGui::MenuItem("Generate C++ Code...", NULL, false,
+                                !worker_.IsRunning() && !worker_.IsPaused()))
+            {
+                std::string code_file = "";
+                std::string errors = "";
+                CodeGenerator generator;
+                if (SaveFileDialog(&code_file) &&
+                    !generator.WriteFile(diagram_, gui_data_, code_file,
+                                         &errors))
+                {
+                    std::cout << errors;
+                }
+            }
+            ImGui::EndMenu();
+        }
+
+        ImGui::EndMainMenuBar();
+    }
+}
+
+void Gui::Toolbar()
+{
+    float height = ImGui::GetFrameHeight();
+
+    ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(viewport->Pos.x, viewport->Pos.y + height));
+    ImGui::SetNextWindowSize(ImVec2(viewport->Size.x, 50));
+    ImGuiWindowFlags window_flags =
+        0 | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
+        ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar |
+        ImGuiWindowFlags_NoSavedSettings;
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
+
+    // Begin the toolbar
+    ImGui::Begin("TOOLBAR", NULL, window_flags);
+    ImGui::PopStyleVar();
+
+    gui_data_.start = ImGui::Button("Run", ImVec2(0, 37));
+    ImGui::SameLine();
+    gui_data_.pause = ImGui::Button("Pause", ImVec2(0, 37));
+    ImGui::SameLine();
+    gui_data_.stop = ImGui::Button("Stop", ImVec2(0, 37));
+
+    // Timing
+    ImGui::SameLine();
+    ImGui::BeginGroup();
+    ImGui::TextUnformatted("tf:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(75.0);
+    ImGui::InputScalar("tf", ImGuiDataType_Double, &gui_data_.sim_time, NULL);
+    ImGui::PopItemWidth();
+
+    ImGui::TextUnformatted("dt:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(75.0);
+    ImGui::InputScalar("dt", ImGuiDataType_Double, &gui_data_.dt, NULL);
+    ImGui::PopItemWidth();
+    ImGui::EndGroup();
+
+    // Pacing of the simulation against the wall clock
+    ImGui::SameLine();
+    ImGui::BeginGroup();
+    ImGui::PushItemWidth(150.0);
+    if (ImGui::BeginCombo("Pacing", gui_data_.pacing.c_str()))
+    {
+        for (size_t i = 0; i < pacing_modes.size(); ++i)
+        {
+            bool is_selected = (gui_data_.pacing == pacing_modes[i]);
+            if (ImGui::Selectable(pacing_modes[i].c_str(), is_selected))
+            {
+                gui_data_.pacing = pacing_modes[i];
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::PopItemWidth();
+    ImGui::PushItemWidth(75.0);
+    if (gui_data_.pacing == "Real time")
+    {
+        ImGui::InputScalar("x real time", ImGuiDataType_Double,
+                           &gui_data_.realtime_factor, NULL);
+    }
+    else if (gui_data_.pacing == "Frame budget")
+    {
+        ImGui::InputScalar("ms / frame", ImGuiDataType_Double,
+                           &gui_data_.frame_budget_ms, NULL);
+    }
+    ImGui::PopItemWidth();
+    ImGui::EndGroup();
+
+    // Error tolerances for the adaptive solvers
+    ImGui::SameLine();
+    ImGui::BeginGroup();
+    ImGui::TextUnformatted("abs tol:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(75.0);
+    ImGui::InputScalar("abs tol", ImGuiDataType_Double, &gui_data_.abs_tol,
+                       NULL, NULL, "%.1e");
+    ImGui::PopItemWidth();
+
+    ImGui::TextUnformatted("rel tol:");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(75.0);
+    ImGui::InputScalar("rel tol", ImGuiDataType_Double, &gui_data_.rel_tol,
+                       NULL, NULL, "%.1e");
+    ImGui::PopItemWidth();
+    ImGui::EndGroup();
+
+    // ODE Solver
+    ImGui::SameLine();
+    if (ImGui::BeginCombo("ODE Solver", gui_data_.solver.data()))
+    {
+        for (int i = 0; i < ode_solvers.size(); i++)
+        {
+            bool is_selected =
+                (gui_data_.solver.c_str() ==
+                 ode_solvers[i]
+                     .c_str()); // You can store your selection however you
+                                // want, outside or inside your objects
+            if (ImGui::Selectable(ode_solvers[i].c_str(), is_selected))
+            {
+                gui_data_.solver = ode_solvers[i];
+            }
+            if (is_selected)
+            {
+                ImGui::SetItemDefaultFocus(); // You may set the initial focus
+                                              // when opening the combo
+                                              // (scrolling + for keyboard
+                                              // navigation support)
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    // Show simulation time
+    ImGui::SameLine();
+    ImGui::Text("%s: %f", "Simulation Time", worker_.GetTime());
+    ImGui::SameLine();
+    ImGui::Text("(%.2fx real time)", worker_.GetRealTimeRatio());
+
+    ImGui::End();
+}
+
+void Gui::RealTimeWindow()
+{
+    if (gui_data_.pacing != "Real time")
+    {
+        return;
+    }
+
+    ImGui::Begin("Real Time");
+
+    // Where the simulation thread runs
+    ImGui::PushItemWidth(75.0);
+    ImGui::InputInt("CPU (-1 for any)", &gui_data_.rt_cpu);
+    ImGui::InputInt("SCHED_FIFO priority (0 for normal)",
+                    &gui_data_.rt_priority);
+    ImGui::PopItemWidth();
+
+    // How well the steps are meeting their deadlines
+    RealTimeStats stats = worker_.GetRealTimeStats();
+    ImGui::Separator();
+    ImGui::Text("Steps: %zu", stats.steps);
+    ImGui::Text("Missed deadlines: %zu", stats.missed_deadlines);
+    ImGui::Text("Latency: %.3f ms mean, %.3f ms max",
+                stats.mean_latency * 1000.0, stats.max_latency * 1000.0);
+    ImGui::Text("Wake-up: %.3f ms mean, %.3f ms max",
+                stats.mean_wakeup * 1000.0, stats.max_wakeup * 1000.0);
+    ImGui::Text("Jitter: %.3f ms", stats.jitter * 1000.0);
+
+    ImGui::End();
+}
+
+void Gui::ProfileWindow()
+{
+    if (!gui_data_.profile)
+    {
+        return;
+    }
+
+    ImGui::Begin("Profile");
+
+    // Split of the step time between the blocks and the solver
+    StepProfile step = diagram_.GetProfiler().GetStepProfile();
+    double step_mean = (step.steps > 0) ? step.step_time / step.steps : 0.0;
+    double graph_share =
+        (step.step_time > 0.0) ? step.graph_time / step.step_time : 0.0;
+    ImGui::Text("Steps: %zu, %.3f us per step", step.steps, step_mean * 1e6);
+    ImGui::Text("Blocks: %.1f%%, solver: %.1f%%", graph_share * 100.0,
+                (1.0 - graph_share) * 100.0);
+
+    // Time in each block, slowest first
+    std::vector<BlockProfile> blocks =
+        diagram_.GetProfiler().GetBlockProfiles();
+    std::sort(blocks.begin(), blocks.end(),
+              [](const BlockProfile &a, const BlockProfile &b)
+              { return a.total > b.total; });
+
+    ImGuiTableFlags flags = ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_RowBg |
+                            ImGuiTableFlags_ScrollY;
+    if (ImGui::BeginTable("block_profiles", 6, flags))
+    {
+        ImGui::TableSetupColumn("Block");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Total (ms)");
+        ImGui::TableSetupColumn("Mean (us)");
+        ImGui::TableSetupColumn("Min (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableHeadersRow();
+
+        for (const BlockProfile &block : blocks)
+        {
+            double mean = (block.calls > 0) ? block.total / block.calls : 0.0;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(block.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", block.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", block.total * 1e3);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", mean * 1e6);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", block.min * 1e6);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", block.max * 1e6);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
@@ -1,4 +1,4 @@
-#include "controlblocks/gui_utils.h"
+#include "controlblocks/gui/gui_utils.h"
 
 bool DetectShortcut(SDL_Scancode code1, SDL_Scancode code2)
 {
@@ -1,4 +1,4 @@
-#include "controlblocks/workspace.h"
+#include "controlblocks/gui/workspace.h"
 
 namespace py = pybind11;
 
@@ -1,4 +1,5 @@
 #include "controlblocks/mux_block.h"
+#include "controlblocks/code_generator.h"
 #include "controlblocks/diagram.h"
 
 namespace ControlBlock
@@ -23,141 +24,139 @@ namespace ControlBlock
 
     void MuxBlock::Compute(double t)
     {
-        // Maintain a vector of Eigen::VectorXds
-        std::vector<Eigen::VectorXd> input_vals;
+        // Stack the inputs into the output buffer, which InferSizes() made
+        // wide enough for all of them.
+        Eigen::VectorXd &output = Block::GetOutputBuffer(0);
 
-        // Track the size
-        int total_size = 0;
-
-        for (size_t i = 0; i < input_ids_.size(); ++i)
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
         {
-            // Get the i-th input
-            Eigen::VectorXd val_i = Block::GetInput(input_ids_[i]);
+            const Eigen::VectorXd &val_i = Block::GetInput(i);
+            output.segment(idx, val_i.size()) = val_i;
+            idx += val_i.size();
+        }
 
-            // Sum up the sizes
-            total_size += val_i.size();
+        // Send the output
+        Block::Broadcast();
+    }
 
-            // Save the input
-            input_vals.push_back(val_i);
+    bool MuxBlock::GenerateCode(CodeGenerator &gen)
+    {
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            int size = gen.InputSize(i);
+            gen.Compute(gen.Output(0) + ".segment<" + std::to_string(size) +
+                        ">(" + std::to_string(idx) + ") = " + gen.Input(i) +
+                        ";");
+            idx += size;
         }
+        return true;
+    }
 
-        // Stack the vectors
-        Eigen::VectorXd output = ControlUtils::StackVectors(input_vals);
+    bool MuxBlock::IsFoldable() { return true; }
+
+    bool MuxBlock::ComputeLanes(double t)
+    {
+        // Stack the inputs row-wise, lane by lane
+        Eigen::MatrixXd &output = Block::GetOutputLanes(0);
+
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            const Eigen::MatrixXd &val_i = Block::GetInputLanes(i);
+            output.middleRows(idx, val_i.rows()) = val_i;
+            idx += val_i.rows();
+        }
 
-        // Send the output
-        Block::SetOutput(output_ids_[0], output);
         Block::Broadcast();
+        return true;
     }
 
-    void MuxBlock::Render()
+    void MuxBlock::InferSizes()
     {
-        ImNodes::BeginNode(this->id_);
-
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
-
-        // Allow the block name to be changed
-        ImNodes::BeginNodeTitleBar();
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
-
-        // Input group
-        ImGui::BeginGroup();
+        // The output is every input stacked on top of each other
+        int total_size = 0;
         for (size_t i = 0; i < inputs_.size(); ++i)
         {
-            std::string pin_name = "in" + std::to_string(i);
-            ImNodes::BeginInputAttribute(input_ids_[i]);
-            ImGui::TextUnformatted(pin_name.c_str());
-            ImNodes::EndInputAttribute();
+            total_size += inputs_[i]->GetSize();
         }
-        ImGui::EndGroup();
+        outputs_[0]->SetSize(total_size);
+    }
 
-        ImGui::SameLine();
+    bool MuxBlock::ComputeJacobian(int state_offset,
+                                   Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // Stack the input Jacobians the same way as the values
+        Eigen::MatrixXd &output = Block::GetOutputJacobian(0);
 
-        // Output group
-        ImGui::BeginGroup();
-        ImNodes::BeginOutputAttribute(output_ids_[0]);
-        const float label_width = ImGui::CalcTextSize(">").x;
-        ImGui::Indent(node_width - label_width);
-        ImGui::TextUnformatted(">");
-        ImNodes::EndOutputAttribute();
-        ImGui::EndGroup();
+        int idx = 0;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            const Eigen::MatrixXd &jac_i = Block::GetInputJacobian(i);
+            output.middleRows(idx, jac_i.rows()) = jac_i;
+            idx += jac_i.rows();
+        }
+        return true;
+    }
 
-        ImNodes::EndNode();
+    bool MuxBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        // The inputs are already stacked the same way as the output
+        int n = outputs_[0]->GetSize();
+        ss->SetABCD(Eigen::MatrixXd::Zero(0, 0), Eigen::MatrixXd::Zero(0, n),
+                    Eigen::MatrixXd::Zero(n, 0),
+                    Eigen::MatrixXd::Identity(n, n));
+        return true;
     }
 
-    void MuxBlock::Settings()
+    int MuxBlock::GetNumInputs() { return num_mux_inputs; }
+
+    void MuxBlock::SetNumInputs(int num_inputs)
     {
-        // If node is double clicked, show the settings
-        int hover_id = -1;
-        ImNodes::IsNodeHovered(&hover_id);
-        if ((hover_id == this->id_ && ImGui::IsMouseDoubleClicked(0)) ||
-            settings_open_)
+        // The mux must have at least one input.
+        num_mux_inputs = std::max(num_inputs, 1);
+
+        // Current size of the input ports pre-modification.
+        int original_size = inputs_.size();
+
+        if (num_mux_inputs < original_size)
         {
-            settings_open_ = true;
-            std::string setting_name = this->name_ + " settings";
-            bool is_open = true;
-            ImGui::Begin(setting_name.c_str(), &is_open);
-            if (settings_open_)
+            for (int i = 0; i < (original_size - num_mux_inputs); ++i)
             {
-                // Set the focus to the settings so the window isn't hidden.
-                ImGui::SetWindowFocus();
-                // Modify number of inputs
-                ImGui::InputInt("# inputs", &num_mux_inputs);
-
-                // The mux must have at least one input.
-                if (num_mux_inputs < 1)
-                {
-                    num_mux_inputs = 1;
-                }
-
-                // Current size of the input ports pre-modification.
-                int original_size = inputs_.size();
-
-                if (num_mux_inputs < original_size)
-                {
-                    for (int i = 0; i < (original_size - num_mux_inputs); ++i)
-                    {
-                        // Get the last port ID
-                        int id = input_ids_[original_size - 1 - i];
-
-                        // Remove the port from the diagram to free the ImNodes
-                        // ID and clear all the connections.
-                        diagram_.RemovePort(id, inputs_[original_size - 1 - i]);
-
-                        // Remove the port from this block's lists.
-                        input_ids_.pop_back();
-                        inputs_.pop_back();
-                    }
-                }
-                else if (num_mux_inputs > original_size)
-                {
-                    for (int i = 0; i < (num_mux_inputs - original_size); ++i)
-                    {
-                        // Get new ID from the diagram
-                        int new_id = diagram_.AddItem();
-
-                        // Create new input port
-                        std::string new_port_name =
-                            this->name_ + "_in" +
-                            std::to_string(inputs_.size());
-                        std::shared_ptr<Port> new_port = std::make_shared<Port>(
-                            new_id, new_port_name, PortType::INPUT_PORT,
-                            this->id_, true);
-
-                        // Add port info to lists
-                        inputs_.push_back(new_port);
-                        input_ids_.push_back(new_id);
-                    }
-                }
-            }
-            ImGui::End();
+                // Get the last port ID
+                int id = input_ids_[original_size - 1 - i];
+
+                // Remove the port from the diagram to free the ImNodes ID and
+                // clear all the connections.
+                diagram_.RemovePort(id, inputs_[original_size - 1 - i]);
 
-            settings_open_ = is_open;
+                // Remove the port from this block's lists.
+                input_ids_.pop_back();
+                inputs_.pop_back();
+            }
+        }
+        else if (num_mux_inputs > original_size)
+        {
+            for (int i = 0; i < (num_mux_inputs - original_size); ++i)
+            {
+                // Get new ID from the diagram
+                int new_id = diagram_.AddItem();
+
+                // Create new input port
+                std::string new_port_name =
+                    this->name_ + "_in" + std::to_string(inputs_.size());
+                std::shared_ptr<Port> new_port = std::make_shared<Port>(
+                    new_id, new_port_name, PortType::INPUT_PORT, this->id_,
+                    true);
+
+                // Add port info to lists
+                inputs_.push_back(new_port);
+                input_ids_.push_back(new_id);
+
+                // Let the diagram know the port exists so it can be wired
+                diagram_.AddPort(new_port);
+            }
         }
     }
 
@@ -180,13 +179,10 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{
             {"type", "MuxBlock"},  {"name", this->name_},   {"id", this->id_},
-            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", pos.x},
-            {"y_pos", pos.y}};
+            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", x_pos_},
+            {"y_pos", y_pos_}};
 
         return tbl;
     }
@@ -0,0 +1,308 @@
+#include "controlblocks/native_model.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#define CONTROLBLOCKS_HAS_DLOPEN
+#endif
+
+// Set by the build to the compiler and Eigen the simulator was built with
+#ifndef CONTROLBLOCKS_CXX_COMPILER
+#define CONTROLBLOCKS_CXX_COMPILER "c++"
+#endif
+#ifndef CONTROLBLOCKS_EIGEN_DIR
+#define CONTROLBLOCKS_EIGEN_DIR ""
+#endif
+
+struct NativeModel::Library
+{
+    // Set once the build finishes, to whether the library loaded
+    std::shared_future<bool> built;
+    void *handle = nullptr;
+    std::string error;
+};
+
+// Libraries by the hash of their code. They stay loaded for the life of the
+// process, since models may still be using them.
+static std::mutex library_mutex;
+static std::unordered_map<std::string, std::shared_ptr<NativeModel::Library>>
+    libraries;
+
+static std::string GetEnv(const char *name, const std::string &fallback)
+{
+    const char *value = std::getenv(name);
+    return (value != nullptr && value[0] != '\0') ? value : fallback;
+}
+
+static std::string CompileCommand()
+{
+    std::string command =
+        GetEnv("CONTROLBLOCKS_CXX", CONTROLBLOCKS_CXX_COMPILER) +
+        " -std=c++17 -O2 -DNDEBUG -shared -fPIC";
+    std::string eigen_dir =
+        GetEnv("CONTROLBLOCKS_EIGEN_DIR", CONTROLBLOCKS_EIGEN_DIR);
+    if (!eigen_dir.empty())
+    {
+        command += " -I\"" + eigen_dir + "\"";
+    }
+    return command;
+}
+
+// Compile the code unless it is in the cache, then load it. This runs on a
+// background thread.
+static bool BuildLibrary(const std::string &source, const std::string &hash,
+                         const std::string &command,
+                         NativeModel::Library *library)
+{
+#if defined(CONTROLBLOCKS_HAS_DLOPEN)
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path dir = NativeModel::CacheDirectory();
+    fs::create_directories(dir, ec);
+    fs::path lib_path = dir / (hash + ".so");
+    fs::path log_path = dir / (hash + ".log");
+
+    if (!fs::exists(lib_path))
+    {
+        fs::path src_path = dir / (hash + ".cpp");
+        {
+            std::ofstream src(src_path);
+            src << source;
+            if (!src)
+            {
+                library->error = "Could not write " + src_path.string();
+                return false;
+            }
+        }
+
+        // Build under a name of our own and move it into place, so other
+        // processes never load a half-written library
+        std::ostringstream tmp_name;
+        tmp_name << hash << "." << std::this_thread::get_id() << ".tmp";
+        fs::path tmp_path = dir / tmp_name.str();
+        std::string full_command = command + " \"" + src_path.string() +
+                                   "\" -o \"" + tmp_path.string() +
+                                   "\" > \"" + log_path.string() + "\" 2>&1";
+        if (std::system(full_command.c_str()) != 0)
+        {
+            fs::remove(tmp_path, ec);
+            library->error = "Compiling the diagram failed, see " +
+                             log_path.string();
+            return false;
+        }
+        fs::rename(tmp_path, lib_path, ec);
+        if (ec)
+        {
+            library->error = "Could not cache " + lib_path.string();
+            return false;
+        }
+    }
+
+    library->handle = dlopen(lib_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (library->handle == nullptr)
+    {
+        library->error = dlerror();
+        return false;
+    }
+    return true;
+#else
+    library->error = "Compiled diagrams aren't supported on this platform";
+    return false;
+#endif
+}
+
+NativeModel::NativeModel()
+    : instance_(nullptr), ready_(false), num_states_(0), num_signals_(0),
+      destroy_(nullptr), evaluate_(nullptr), get_signals_(nullptr),
+      set_signals_(nullptr)
+{
+}
+
+NativeModel::~NativeModel() { this->Reset(); }
+
+void NativeModel::Build(const std::string &source, int num_states,
+                        int num_signals)
+{
+    this->Reset();
+    num_states_ = num_states;
+    num_signals_ = num_signals;
+
+    // The hash covers the compiler and flags too, since they change the
+    // library
+    std::string command = CompileCommand();
+    std::string hash = Hash(command + "\n" + source);
+
+    // Models with the same code share one build
+    std::lock_guard<std::mutex> lock(library_mutex);
+    std::shared_ptr<Library> &library = libraries[hash];
+    if (library == nullptr)
+    {
+        library = std::make_shared<Library>();
+        Library *lib = library.get();
+        library->built = std::async(std::launch::async, BuildLibrary, source,
+                                    hash, command, lib)
+                             .share();
+    }
+    library_ = library;
+}
+
+void NativeModel::Reset()
+{
+    if (instance_ != nullptr)
+    {
+        destroy_(instance_);
+    }
+    library_.reset();
+    instance_ = nullptr;
+    ready_ = false;
+    destroy_ = nullptr;
+    evaluate_ = nullptr;
+    get_signals_ = nullptr;
+    set_signals_ = nullptr;
+}
+
+bool NativeModel::IsReady()
+{
+    if (ready_ || library_ == nullptr)
+    {
+        return ready_;
+    }
+    if (library_->built.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready)
+    {
+        return false;
+    }
+    ready_ = library_->built.get() && this->Load();
+    return ready_;
+}
+
+bool NativeModel::IsFailed()
+{
+    return library_ != nullptr && !this->IsReady() &&
+           library_->built.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+}
+
+bool NativeModel::Wait()
+{
+    if (library_ != nullptr)
+    {
+        library_->built.wait();
+    }
+    return this->IsReady();
+}
+
+std::string NativeModel::GetError()
+{
+    if (library_ == nullptr)
+    {
+        return "No model was built";
+    }
+    return library_->error;
+}
+
+void NativeModel::Evaluate(const double *x, double *dx, double t)
+{
+    evaluate_(instance_, x, dx, t);
+}
+
+void NativeModel::GetSignals(double *values)
+{
+    get_signals_(instance_, values);
+}
+
+void NativeModel::SetSignals(const double *values)
+{
+    set_signals_(instance_, values);
+}
+
+std::string NativeModel::Hash(const std::string &source)
+{
+    // 64-bit FNV-1a, which is the same on every platform and run
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return out.str();
+}
+
+std::string NativeModel::CacheDirectory()
+{
+    std::string dir = GetEnv("CONTROLBLOCKS_CACHE", "");
+    if (!dir.empty())
+    {
+        return dir;
+    }
+
+    std::string xdg = GetEnv("XDG_CACHE_HOME", "");
+    if (!xdg.empty())
+    {
+        return (std::filesystem::path(xdg) / "controlblocks").string();
+    }
+    std::string home = GetEnv("HOME", "");
+    if (!home.empty())
+    {
+        return (std::filesystem::path(home) / ".cache" / "controlblocks")
+            .string();
+    }
+    return (std::filesystem::temp_directory_path() / "controlblocks")
+        .string();
+}
+
+bool NativeModel::Load()
+{
+#if defined(CONTROLBLOCKS_HAS_DLOPEN)
+    void *handle = library_->handle;
+    void *(*create)() =
+        reinterpret_cast<void *(*)()>(dlsym(handle, "cb_create"));
+    int (*num_states)() =
+        reinterpret_cast<int (*)()>(dlsym(handle, "cb_num_states"));
+    int (*num_signals)() =
+        reinterpret_cast<int (*)()>(dlsym(handle, "cb_num_signals"));
+    destroy_ = reinterpret_cast<void (*)(void *)>(dlsym(handle, "cb_destroy"));
+    evaluate_ = reinterpret_cast<void (*)(void *, const double *, double *,
+                                          double)>(
+        dlsym(handle, "cb_evaluate"));
+    get_signals_ = reinterpret_cast<void (*)(void *, double *)>(
+        dlsym(handle, "cb_get_signals"));
+    set_signals_ = reinterpret_cast<void (*)(void *, const double *)>(
+        dlsym(handle, "cb_set_signals"));
+
+    if (create == nullptr || num_states == nullptr ||
+        num_signals == nullptr || destroy_ == nullptr ||
+        evaluate_ == nullptr || get_signals_ == nullptr ||
+        set_signals_ == nullptr)
+    {
+        library_->error = "The compiled diagram is missing entry points";
+        return false;
+    }
+
+    // Make sure the library was built for this layout
+    if (num_states() != num_states_ || num_signals() != num_signals_)
+    {
+        library_->error = "The compiled diagram doesn't match the diagram";
+        return false;
+    }
+
+    instance_ = create();
+    return instance_ != nullptr;
+#else
+    return false;
+#endif
+}
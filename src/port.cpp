@@ -39,11 +39,24 @@ namespace ControlBlock
 
     bool Port::ConnectedInput() { return (in_conn_ != nullptr); }
 
-    Eigen::VectorXd Port::GetValue()
+    std::shared_ptr<Port> Port::GetConnection() { return in_conn_; }
+
+    const std::vector<std::shared_ptr<Port>> &Port::GetOutputConnections()
+    {
+        return out_conns_;
+    }
+
+    const Eigen::VectorXd &Port::GetValue()
     {
         // Since the port value is being read, the port will need to Receive()
         // again before the value is "ready" (fresh).
         ready_ = false;
+
+        // Connected inputs share the buffer of the output driving them.
+        if (this->type_ == INPUT_PORT && in_conn_ != nullptr)
+        {
+            return in_conn_->val_;
+        }
         return val_;
     }
 
@@ -60,7 +73,7 @@ namespace ControlBlock
         return ready_;
     }
 
-    void Port::SetValue(Eigen::VectorXd val)
+    void Port::SetValue(const Eigen::VectorXd &val)
     {
         // This can only be used with output ports
         if (this->type_ == OUTPUT_PORT)
@@ -69,6 +82,55 @@ namespace ControlBlock
         }
     }
 
+    Eigen::VectorXd &Port::GetBuffer() { return val_; }
+
+    const Eigen::MatrixXd &Port::GetJacobian()
+    {
+        if (this->type_ == INPUT_PORT && in_conn_ != nullptr)
+        {
+            return in_conn_->jac_;
+        }
+        return jac_;
+    }
+
+    Eigen::MatrixXd &Port::GetJacobianBuffer() { return jac_; }
+
+    const Eigen::MatrixXd &Port::GetLanes()
+    {
+        if (this->type_ == INPUT_PORT && in_conn_ != nullptr)
+        {
+            return in_conn_->lanes_;
+        }
+        return lanes_;
+    }
+
+    Eigen::MatrixXd &Port::GetLanesBuffer() { return lanes_; }
+
+    void Port::ResetLanes(int num_lanes)
+    {
+        lanes_ = Eigen::MatrixXd::Zero(size_, num_lanes);
+    }
+
+    int Port::GetSize()
+    {
+        if (this->type_ == INPUT_PORT && in_conn_ != nullptr)
+        {
+            return in_conn_->GetSize();
+        }
+        return size_;
+    }
+
+    void Port::SetSize(int size)
+    {
+        size_ = size;
+
+        // Keep the current value if it is already the right width
+        if (val_.size() != size)
+        {
+            val_ = Eigen::VectorXd::Zero(size);
+        }
+    }
+
     void Port::Broadcast()
     {
         // Send values to any attached ports
@@ -83,18 +145,17 @@ namespace ControlBlock
                 continue;
             }
 
-            // Make the connected ports receive this.
-            out_conns_[i]->Receive(val_, *this);
+            // Let the connected ports know there is a new value to read.
+            out_conns_[i]->Receive(*this);
         }
     }
 
-    void Port::Receive(Eigen::VectorXd val, Port &caller)
+    void Port::Receive(Port &caller)
     {
-        // If this is an input port receiving from its subscribed caller,
-        // receive the message.
-        if (this->type_ == INPUT_PORT && caller == *in_conn_.get())
+        // If this is an input port receiving from its subscribed caller, the
+        // value in the caller's buffer is fresh.
+        if (this->type_ == INPUT_PORT && &caller == in_conn_.get())
         {
-            val_ = val;
             ready_ = true;
         }
     }
@@ -170,6 +231,6 @@ namespace ControlBlock
         return is_equal;
     }
 
-    void Port::ResetValue() { val_ = Eigen::VectorXd::Zero(1); }
+    void Port::ResetValue() { this->SetSize(1); }
 
 } // namespace ControlBlock
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "controlblocks/profiler.h"
+
+Profiler::Profiler()
+    : enabled_(false), epoch_(clock::now()), steps_({0, 0.0, 0.0}),
+      published_steps_({0, 0.0, 0.0}), max_trace_events_(1000000)
+{
+}
+
+void Profiler::SetEnabled(bool enabled) { enabled_ = enabled; }
+
+bool Profiler::IsEnabled() const { return enabled_; }
+
+void Profiler::Init(const std::vector<ControlBlock::ScheduledBlock> &order)
+{
+    epoch_ = clock::now();
+
+    ids_.clear();
+    names_.clear();
+    blocks_.clear();
+    for (const ControlBlock::ScheduledBlock &entry : order)
+    {
+        ids_.push_back(entry.block->GetId());
+        names_.push_back(entry.block->GetName() +
+                         (entry.output_only ? " (outputs)" : ""));
+        blocks_.push_back({entry.block->GetId(), "", 0, 0.0, 0.0, 0.0});
+    }
+    steps_ = {0, 0.0, 0.0};
+    trace_.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    published_blocks_ = blocks_;
+    published_steps_ = steps_;
+}
+
+void Profiler::RecordBlock(size_t index, clock::time_point start,
+                           clock::time_point end)
+{
+    double duration = std::chrono::duration<double>(end - start).count();
+
+    BlockProfile &block = blocks_[index];
+    block.min = (block.calls == 0) ? duration : std::min(block.min, duration);
+    block.max = std::max(block.max, duration);
+    block.total += duration;
+    block.calls++;
+
+    this->AddTraceEvent(static_cast<int>(index), start, end);
+}
+
+void Profiler::RecordGraph(clock::time_point start, clock::time_point end)
+{
+    steps_.graph_time += std::chrono::duration<double>(end - start).count();
+    this->AddTraceEvent(-1, start, end);
+}
+
+void Profiler::RecordStep(clock::time_point start, clock::time_point end)
+{
+    steps_.step_time += std::chrono::duration<double>(end - start).count();
+    steps_.steps++;
+    this->AddTraceEvent(-2, start, end);
+
+    // Publish if no one is reading, otherwise try again next step
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (lock.owns_lock())
+    {
+        published_blocks_ = blocks_;
+        published_steps_ = steps_;
+    }
+}
+
+std::vector<BlockProfile> Profiler::GetBlockProfiles()
+{
+    std::vector<BlockProfile> profiles;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        profiles = published_blocks_;
+    }
+
+    // Names are only set by Init(), so they aren't copied on every publish
+    for (size_t i = 0; i < profiles.size() && i < names_.size(); ++i)
+    {
+        profiles[i].name = names_[i];
+    }
+    return profiles;
+}
+
+StepProfile Profiler::GetStepProfile()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return published_steps_;
+}
+
+bool Profiler::WriteChromeTrace(const std::string &filename)
+{
+    std::ofstream file(filename, std::ofstream::out | std::ofstream::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    // Complete ("X") events with times in microseconds. Steps, graph
+    // evaluations and blocks nest on one thread.
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file.precision(3);
+    file << std::fixed;
+    for (size_t i = 0; i < trace_.size(); ++i)
+    {
+        const TraceEvent &event = trace_[i];
+        std::string name = "Step";
+        std::string category = "step";
+        if (event.index == -1)
+        {
+            name = "ComputeGraph";
+            category = "graph";
+        }
+        else if (event.index >= 0)
+        {
+            name = names_[event.index];
+            category = "block";
+        }
+
+        // Escape the characters JSON doesn't allow in strings
+        std::string escaped = "";
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                escaped += c;
+            }
+        }
+
+        file << "{\"name\":\"" << escaped << "\",\"cat\":\"" << category
+             << "\",\"ph\":\"X\",\"ts\":" << event.start_ns / 1000.0
+             << ",\"dur\":" << event.duration_ns / 1000.0
+             << ",\"pid\":1,\"tid\":1";
+        if (event.index >= 0)
+        {
+            file << ",\"args\":{\"id\":" << ids_[event.index] << "}";
+        }
+        file << "}" << ((i + 1 < trace_.size()) ? ",\n" : "\n");
+    }
+    file << "]}\n";
+
+    file << std::flush;
+    file.close();
+
+    return true;
+}
+
+void Profiler::AddTraceEvent(int index, clock::time_point start,
+                             clock::time_point end)
+{
+    if (trace_.size() >= max_trace_events_)
+    {
+        return;
+    }
+
+    trace_.push_back(
+        {index,
+         std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_)
+             .count(),
+         std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+             .count()});
+}
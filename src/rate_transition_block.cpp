@@ -0,0 +1,164 @@
+#include "controlblocks/rate_transition_block.h"
+#include "controlblocks/code_generator.h"
+
+namespace ControlBlock
+{
+
+    void RateTransitionBlock::Init(std::string block_name)
+    {
+        std::vector<std::string> input_names = {"u"};
+        std::vector<std::string> output_names = {"y"};
+
+        // The held value is a discrete state
+        Block::Init(block_name, input_names, output_names,
+                    std::vector<bool>(), true);
+    }
+
+    void RateTransitionBlock::SetDelay(bool delay) { delay_ = delay; }
+
+    bool RateTransitionBlock::GetDelay() { return delay_; }
+
+    bool RateTransitionBlock::ApplyInitial()
+    {
+        x_ = x0_;
+        if (!delay_)
+        {
+            // The output follows the input, so it is sized from it
+            return true;
+        }
+        outputs_[0]->SetSize(x_.size());
+        this->SetOutput(0, x_);
+        return true;
+    }
+
+    void RateTransitionBlock::SetInitial(Eigen::VectorXd x0) { x0_ = x0; }
+
+    const Eigen::VectorXd &RateTransitionBlock::GetInitial() { return x0_; }
+
+    void RateTransitionBlock::Compute(double t)
+    {
+        if (delay_)
+        {
+            this->ComputeOutput(t);
+            return;
+        }
+        Block::GetOutputBuffer(0) = Block::GetInput(0);
+        Block::Broadcast();
+    }
+
+    void RateTransitionBlock::ComputeOutput(double t)
+    {
+        Block::GetOutputBuffer(0) = x_;
+        Block::Broadcast();
+    }
+
+    void RateTransitionBlock::InferSizes()
+    {
+        if (!delay_)
+        {
+            outputs_[0]->SetSize(inputs_[0]->GetSize());
+            return;
+        }
+
+        // The output was sized from the initial value before the blocks
+        // reading it, so the input has to match it
+        if (inputs_[0]->GetSize() != x_.size())
+        {
+            throw std::runtime_error(
+                "Error: block '" + name_ + "': the input has " +
+                std::to_string(inputs_[0]->GetSize()) +
+                " elements but the initial value has " +
+                std::to_string(x_.size()) +
+                ". Set an initial value as wide as the input.");
+        }
+    }
+
+    bool RateTransitionBlock::IsDiscrete() { return true; }
+
+    bool RateTransitionBlock::HasDirectFeedthrough() { return !delay_; }
+
+    void RateTransitionBlock::Update(double t, double dt)
+    {
+        if (delay_)
+        {
+            x_ = Block::GetInput(0);
+        }
+    }
+
+    bool RateTransitionBlock::GenerateCode(CodeGenerator &gen)
+    {
+        if (!delay_)
+        {
+            gen.Compute(gen.Output(0) + " = " + gen.Input(0) + ";");
+            return true;
+        }
+        gen.Compute(gen.Output(0) + " = " + gen.State() + ";");
+        gen.Update(gen.State() + " = " + gen.Input(0) + ";");
+        return true;
+    }
+
+    toml::table RateTransitionBlock::Serialize()
+    {
+        std::cout << "- Serializing RateTransitionBlock: " << this->name_
+                  << std::endl;
+
+        // Get the port serialization for each port
+        toml::array input_arr, output_arr;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            toml::table port_tbl = inputs_[i]->Serialize();
+            input_arr.push_back(port_tbl);
+        }
+
+        // Outputs
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            toml::table port_tbl = outputs_[i]->Serialize();
+            output_arr.push_back(port_tbl);
+        }
+
+        toml::array x0_arr;
+        for (int i = 0; i < x0_.size(); ++i)
+        {
+            x0_arr.push_back(x0_(i));
+        }
+
+        toml::table tbl = toml::table{{"type", "RateTransitionBlock"},
+                                      {"name", this->name_},
+                                      {"id", this->id_},
+                                      {"inputs", input_arr},
+                                      {"outputs", output_arr},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
+                                      {"dynamic_sys", dynamic_sys_},
+                                      {"delay", delay_},
+                                      {"x0", x0_arr},
+                                      {"sample_time", sample_time_.period},
+                                      {"sample_offset", sample_time_.offset}};
+
+        return tbl;
+    }
+
+    void RateTransitionBlock::Deserialize(toml::table tbl)
+    {
+        delay_ = tbl["delay"].value_or(true);
+
+        // Get the initial output
+        toml::array *x0_arr = tbl["x0"].as_array();
+        if (x0_arr != nullptr && !x0_arr->empty())
+        {
+            x0_.resize(x0_arr->size());
+            for (size_t i = 0; i < x0_arr->size(); ++i)
+            {
+                x0_(i) = x0_arr->at(i).value_or(0.0);
+            }
+        }
+
+        // Deserialize the general components.
+        Block::Deserialize(tbl);
+
+        // The held value is always a state
+        dynamic_sys_ = true;
+    }
+
+} // namespace ControlBlock
@@ -0,0 +1,131 @@
+#include "controlblocks/realtime_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+RealTimePacer::RealTimePacer()
+    : period_(std::chrono::milliseconds(1)),
+      release_(std::chrono::steady_clock::now()), wakeup_m2_(0.0)
+{
+}
+
+void RealTimePacer::Start(double period)
+{
+    period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(period));
+    release_ = std::chrono::steady_clock::now();
+}
+
+void RealTimePacer::ResetStats()
+{
+    stats_ = RealTimeStats();
+    wakeup_m2_ = 0.0;
+}
+
+std::chrono::steady_clock::time_point RealTimePacer::NextRelease()
+{
+    return release_;
+}
+
+void RealTimePacer::Wait() { std::this_thread::sleep_until(release_); }
+
+void RealTimePacer::BeginStep()
+{
+    double wakeup = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - release_)
+                        .count();
+    wakeup = std::max(wakeup, 0.0);
+
+    // Welford's update of the mean and variance of the wake-up delay
+    size_t n = stats_.steps + 1;
+    double delta = wakeup - stats_.mean_wakeup;
+    stats_.mean_wakeup += delta / n;
+    wakeup_m2_ += delta * (wakeup - stats_.mean_wakeup);
+    stats_.jitter = std::sqrt(wakeup_m2_ / n);
+    stats_.max_wakeup = std::max(stats_.max_wakeup, wakeup);
+}
+
+void RealTimePacer::EndStep()
+{
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double latency = std::chrono::duration<double>(now - release_).count();
+
+    stats_.steps++;
+    stats_.mean_latency += (latency - stats_.mean_latency) / stats_.steps;
+    stats_.max_latency = std::max(stats_.max_latency, latency);
+
+    // The step had until the next release to finish
+    release_ += period_;
+    if (now > release_)
+    {
+        stats_.missed_deadlines++;
+    }
+}
+
+RealTimeStats RealTimePacer::GetStats() { return stats_; }
+
+bool RealTimePacer::ConfigureThread(int cpu, int priority, std::string *errors)
+{
+#if defined(__linux__)
+    bool is_success = true;
+    pthread_t thread = pthread_self();
+
+    // CPU affinity
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    if (cpu >= 0 && cpu < num_cpus)
+    {
+        CPU_SET(cpu, &cpus);
+    }
+    else
+    {
+        for (int i = 0; i < num_cpus; ++i)
+        {
+            CPU_SET(i, &cpus);
+        }
+    }
+    int result = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    if (result != 0)
+    {
+        *errors += "Could not set CPU affinity: " +
+                   std::string(std::strerror(result)) + "\n";
+        is_success = false;
+    }
+
+    // Scheduling policy
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    int policy = SCHED_OTHER;
+    if (priority > 0)
+    {
+        policy = SCHED_FIFO;
+        param.sched_priority =
+            std::min(priority, sched_get_priority_max(policy));
+    }
+    result = pthread_setschedparam(thread, policy, &param);
+    if (result != 0)
+    {
+        *errors += "Could not set SCHED_FIFO priority: " +
+                   std::string(std::strerror(result)) + "\n";
+        is_success = false;
+    }
+
+    return is_success;
+#else
+    if (cpu >= 0 || priority > 0)
+    {
+        *errors += "CPU affinity and priority are only supported on Linux\n";
+        return false;
+    }
+    return true;
+#endif
+}
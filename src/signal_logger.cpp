@@ -0,0 +1,93 @@
+#include "controlblocks/signal_logger.h"
+
+void SignalLogger::Init(
+    const std::vector<std::shared_ptr<ControlBlock::Block>> &blocks)
+{
+    displays_.clear();
+    widths_.clear();
+    samples_.clear();
+    row_size_ = 0;
+
+    // Every display block is a logged signal
+    for (const std::shared_ptr<ControlBlock::Block> &blk : blocks)
+    {
+        std::shared_ptr<ControlBlock::DisplayBlock> display =
+            std::dynamic_pointer_cast<ControlBlock::DisplayBlock>(blk);
+        if (display != nullptr)
+        {
+            displays_.push_back(display);
+        }
+    }
+}
+
+void SignalLogger::Record(double t)
+{
+    // The first sample decides how wide each signal is.
+    if (widths_.empty())
+    {
+        row_size_ = 1;
+        for (size_t i = 0; i < displays_.size(); ++i)
+        {
+            int width = displays_[i]->GetValue().size();
+            widths_.push_back(width);
+            row_size_ += width;
+        }
+    }
+
+    samples_.push_back(t);
+    for (size_t i = 0; i < displays_.size(); ++i)
+    {
+        const Eigen::VectorXd &val = displays_[i]->GetValue();
+
+        // Pad with zeros if the signal shrank since the first sample
+        for (int j = 0; j < widths_[i]; ++j)
+        {
+            samples_.push_back(j < val.size() ? val(j) : 0.0);
+        }
+    }
+}
+
+bool SignalLogger::WriteCsv(const std::string &filename)
+{
+    std::ofstream file(filename, std::ofstream::out | std::ofstream::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    // Header
+    file << "t";
+    for (size_t i = 0; i < displays_.size(); ++i)
+    {
+        for (int j = 0; j < widths_[i]; ++j)
+        {
+            file << "," << displays_[i]->GetName() << "[" << j << "]";
+        }
+    }
+    file << "\n";
+
+    // Samples
+    file.precision(17);
+    for (size_t row = 0; row < this->NumSamples(); ++row)
+    {
+        for (size_t col = 0; col < row_size_; ++col)
+        {
+            if (col > 0)
+            {
+                file << ",";
+            }
+            file << samples_[row * row_size_ + col];
+        }
+        file << "\n";
+    }
+
+    file << std::flush;
+    file.close();
+
+    return true;
+}
+
+size_t SignalLogger::NumSamples()
+{
+    return (row_size_ > 0) ? samples_.size() / row_size_ : 0;
+}
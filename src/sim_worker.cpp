@@ -0,0 +1,302 @@
+#include "controlblocks/sim_worker.h"
+
+SimWorker::SimWorker(Diagram &diagram)
+    : diagram_(diagram), run_(false), busy_(false), quit_(false),
+      pacing_(AS_FAST_AS_POSSIBLE), realtime_factor_(1.0),
+      frame_budget_(0.0), pace_sim_start_(0.0), frame_ready_(false),
+      cpu_(-1), priority_(0), thread_config_pending_(false),
+      running_(false), paused_(false), time_(0.0), realtime_ratio_(0.0)
+{
+    thread_ = std::thread(&SimWorker::Loop, this);
+}
+
+SimWorker::~SimWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void SimWorker::Start(const GuiData &gui_data)
+{
+    // Park the worker so the diagram can be set up on this thread
+    this->Stop();
+
+    gui_data_ = gui_data;
+    diagram_.Start(gui_data_);
+    time_ = diagram_.GetTime();
+
+    // Size the published values once so publishing never allocates
+    SimSnapshot initial;
+    initial.t = diagram_.GetTime();
+    displays_.clear();
+    display_index_.clear();
+    for (const std::shared_ptr<ControlBlock::Block> &blk : diagram_.GetBlocks())
+    {
+        std::shared_ptr<ControlBlock::DisplayBlock> display =
+            std::dynamic_pointer_cast<ControlBlock::DisplayBlock>(blk);
+        if (display != nullptr)
+        {
+            display_index_[display->GetId()] = displays_.size();
+            displays_.push_back(display);
+            initial.displays.push_back(display->GetValue());
+        }
+    }
+    snapshots_.Reset(initial);
+
+    // Hand the diagram over. It may have failed to initialize.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        run_ = diagram_.IsRunning();
+        running_ = run_;
+        paused_ = false;
+        this->ResetPacing();
+        pacer_.ResetStats();
+    }
+    cv_.notify_all();
+}
+
+void SimWorker::Pause()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (run_)
+    {
+        run_ = false;
+        running_ = false;
+        paused_ = true;
+        cv_.notify_all();
+        this->WaitIdle(lock);
+    }
+}
+
+void SimWorker::Resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!paused_)
+        {
+            return;
+        }
+        run_ = true;
+        running_ = true;
+        paused_ = false;
+        this->ResetPacing();
+    }
+    cv_.notify_all();
+}
+
+void SimWorker::Stop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    run_ = false;
+    running_ = false;
+    paused_ = false;
+    cv_.notify_all();
+    this->WaitIdle(lock);
+    diagram_.Stop();
+}
+
+void SimWorker::SetPacing(const GuiData &gui_data)
+{
+    PacingMode pacing = AS_FAST_AS_POSSIBLE;
+    if (gui_data.pacing == "Real time")
+    {
+        pacing = REAL_TIME;
+    }
+    else if (gui_data.pacing == "Frame budget")
+    {
+        pacing = FRAME_BUDGET;
+    }
+
+    double realtime_factor = std::max(gui_data.realtime_factor, 1e-6);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool changed = (pacing != pacing_) ||
+                       (realtime_factor != realtime_factor_);
+        pacing_ = pacing;
+        realtime_factor_ = realtime_factor;
+        frame_budget_ =
+            std::chrono::duration<double>(gui_data.frame_budget_ms / 1000.0);
+
+        // The worker changes its own CPU and priority when it next wakes
+        if (gui_data.rt_cpu != cpu_ || gui_data.rt_priority != priority_)
+        {
+            cpu_ = gui_data.rt_cpu;
+            priority_ = gui_data.rt_priority;
+            thread_config_pending_ = true;
+        }
+
+        // Don't let real time mode catch up on time run at another pace
+        if (changed)
+        {
+            this->ResetPacing();
+        }
+    }
+    cv_.notify_all();
+}
+
+bool SimWorker::IsRunning() { return running_; }
+
+bool SimWorker::IsPaused() { return paused_; }
+
+double SimWorker::GetTime() { return time_; }
+
+double SimWorker::GetRealTimeRatio() { return realtime_ratio_; }
+
+RealTimeStats SimWorker::GetRealTimeStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pacer_.GetStats();
+}
+
+void SimWorker::Refresh()
+{
+    snapshots_.Consume();
+
+    // Give the worker its next slice of steps
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame_start_ = std::chrono::steady_clock::now();
+        frame_ready_ = true;
+    }
+    cv_.notify_all();
+}
+
+const Eigen::VectorXd *SimWorker::GetDisplayValue(int block_id)
+{
+    auto iter = display_index_.find(block_id);
+    if (iter == display_index_.end())
+    {
+        return nullptr;
+    }
+    return &snapshots_.Front().displays[iter->second];
+}
+
+void SimWorker::ClearPublished()
+{
+    // The worker reads the display list while it runs
+    this->Stop();
+
+    displays_.clear();
+    display_index_.clear();
+    time_ = 0.0;
+}
+
+void SimWorker::Loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        // Sleep until there is a run to step or the worker is shut down
+        cv_.wait(lock, [this] { return (run_ && this->CanStep()) || quit_; });
+        if (quit_)
+        {
+            break;
+        }
+
+        if (thread_config_pending_)
+        {
+            std::string errors = "";
+            if (!RealTimePacer::ConfigureThread(cpu_, priority_, &errors))
+            {
+                std::cout << errors;
+            }
+            thread_config_pending_ = false;
+        }
+
+        // Step without holding the lock so commands never wait on the GUI
+        bool timed = (pacing_ == REAL_TIME);
+        if (timed)
+        {
+            pacer_.BeginStep();
+        }
+        busy_ = true;
+        lock.unlock();
+
+        diagram_.Step(gui_data_);
+        this->Publish();
+        bool finished = !diagram_.IsRunning();
+
+        lock.lock();
+        busy_ = false;
+        if (timed)
+        {
+            pacer_.EndStep();
+        }
+        if (finished)
+        {
+            run_ = false;
+            running_ = false;
+        }
+        cv_.notify_all();
+
+        if (run_)
+        {
+            this->Pace(lock);
+        }
+    }
+}
+
+void SimWorker::Pace(std::unique_lock<std::mutex> &lock)
+{
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double sim_elapsed = time_.load(std::memory_order_relaxed) -
+                         pace_sim_start_;
+    std::chrono::duration<double> wall_elapsed = now - pace_wall_start_;
+    if (wall_elapsed.count() > 0.0)
+    {
+        realtime_ratio_ = sim_elapsed / wall_elapsed.count();
+    }
+
+    if (pacing_ == REAL_TIME)
+    {
+        // Sleep until the next step is released. Commands wake the worker
+        // early.
+        cv_.wait_until(lock, pacer_.NextRelease(),
+                       [this] { return !run_ || quit_; });
+    }
+    else if (pacing_ == FRAME_BUDGET)
+    {
+        // Wait for the next frame once this one's time is used up
+        if (now - frame_start_ >= frame_budget_)
+        {
+            frame_ready_ = false;
+        }
+    }
+}
+
+bool SimWorker::CanStep()
+{
+    return (pacing_ != FRAME_BUDGET) || frame_ready_;
+}
+
+void SimWorker::ResetPacing()
+{
+    pace_wall_start_ = std::chrono::steady_clock::now();
+    pace_sim_start_ = time_;
+    realtime_ratio_ = 0.0;
+    pacer_.Start(gui_data_.dt / realtime_factor_);
+}
+
+void SimWorker::Publish()
+{
+    SimSnapshot &snapshot = snapshots_.Back();
+    snapshot.t = diagram_.GetTime();
+    for (size_t i = 0; i < displays_.size(); ++i)
+    {
+        snapshot.displays[i] = displays_[i]->GetValue();
+    }
+    snapshots_.Publish();
+
+    time_.store(snapshot.t, std::memory_order_relaxed);
+}
+
+void SimWorker::WaitIdle(std::unique_lock<std::mutex> &lock)
+{
+    cv_.wait(lock, [this] { return !busy_; });
+}
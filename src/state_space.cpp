@@ -1,48 +1,110 @@
 #include "controlblocks/state_space.h"
 
+#include <unsupported/Eigen/MatrixFunctions>
+
 namespace ControlUtils
 {
-    Eigen::VectorXd StateSpace::UpdateDynamics(Eigen::VectorXd x,
-                                               Eigen::VectorXd u)
+    void StateSpace::CheckDimensions(int num_inputs)
     {
         // Ensure A,B,C,D match x,u dimensions
-        bool A_match = (A_.rows() == x.size()) && (A_.cols() == x.size());
-        bool B_match = (B_.rows() == x.size()) && (B_.cols() == u.size());
+        int num_states = A_.rows();
+        bool A_match = (A_.cols() == num_states);
+        bool B_match = (B_.rows() == num_states) && (B_.cols() == num_inputs);
+        bool C_match = (C_.cols() == num_states);
+        bool D_match = (D_.cols() == num_inputs) && (D_.rows() == C_.rows());
 
         // Throw an exception for the user to figure out
         // where they went wrong.
-        if (!(A_match && B_match))
+        if (!(A_match && B_match && C_match && D_match))
         {
             throw std::runtime_error(
-                "SS update matrices dimensions do not commute! A: " +
-                std::to_string(A_match) + " B: " + std::to_string(B_match));
+                "SS matrices dimensions do not commute! A: " +
+                std::to_string(A_match) + " B: " + std::to_string(B_match) +
+                " C: " + std::to_string(C_match) +
+                " D: " + std::to_string(D_match));
         }
+    }
 
+    void StateSpace::UpdateDynamics(const Eigen::Ref<const Eigen::VectorXd> &x,
+                                    const Eigen::Ref<const Eigen::VectorXd> &u,
+                                    Eigen::Ref<Eigen::VectorXd> dx)
+    {
         // Update dx
-        Eigen::VectorXd dx = A_ * x + B_ * u;
-        return dx;
+        dx.noalias() = A_ * x;
+        dx.noalias() += B_ * u;
     }
 
-    Eigen::VectorXd StateSpace::GetOutput(Eigen::VectorXd x, Eigen::VectorXd u)
+    void StateSpace::GetOutput(const Eigen::Ref<const Eigen::VectorXd> &x,
+                               const Eigen::Ref<const Eigen::VectorXd> &u,
+                               Eigen::Ref<Eigen::VectorXd> y)
     {
-        bool C_match = (C_.cols() == x.size());
-        bool D_match = D_.cols() == u.size();
+        // Compute the output, y
+        y.noalias() = C_ * x;
+        y.noalias() += D_ * u;
+    }
 
-        // Throw an exception for the user to figure out
-        // where they went wrong.
-        if (!(C_match && D_match && (C_.rows() == D_.rows())))
+    void StateSpace::UpdateDynamicsLanes(
+        const Eigen::Ref<const Eigen::MatrixXd> &X,
+        const Eigen::Ref<const Eigen::MatrixXd> &U,
+        Eigen::Ref<Eigen::MatrixXd> dX)
+    {
+        dX.noalias() = A_ * X;
+        dX.noalias() += B_ * U;
+    }
+
+    void StateSpace::GetOutputLanes(const Eigen::Ref<const Eigen::MatrixXd> &X,
+                                    const Eigen::Ref<const Eigen::MatrixXd> &U,
+                                    Eigen::Ref<Eigen::MatrixXd> Y)
+    {
+        Y.noalias() = C_ * X;
+        Y.noalias() += D_ * U;
+    }
+
+    void StateSpace::Discretize(double dt)
+    {
+        // Reuse the matrices from the last call if the sample time is the
+        // same
+        if (dt == discrete_dt_)
         {
-            throw std::runtime_error(
-                "SS output matrices dimensions do not commute! C: " +
-                std::to_string(C_match) + " D: " + std::to_string(D_match) +
-                " C and D: " + std::to_string(C_.rows() == D_.rows()));
+            return;
         }
 
-        // Compute the output, y
-        Eigen::VectorXd y = C_ * x + D_ * u;
-        return y;
+        // Both matrices come from one exponential of the augmented system
+        // [A B; 0 0] dt, which is [Ad Bd; 0 I].
+        int num_states = A_.rows();
+        int num_inputs = B_.cols();
+        Eigen::MatrixXd M =
+            Eigen::MatrixXd::Zero(num_states + num_inputs,
+                                  num_states + num_inputs);
+        M.topLeftCorner(num_states, num_states) = A_ * dt;
+        M.topRightCorner(num_states, num_inputs) = B_ * dt;
+        Eigen::MatrixXd M_exp = M.exp();
+
+        Ad_ = M_exp.topLeftCorner(num_states, num_states);
+        Bd_ = M_exp.topRightCorner(num_states, num_inputs);
+        discrete_dt_ = dt;
     }
 
+    const Eigen::MatrixXd &StateSpace::GetDiscreteA() { return Ad_; }
+
+    const Eigen::MatrixXd &StateSpace::GetDiscreteB() { return Bd_; }
+
+    void StateSpace::Advance(const Eigen::Ref<const Eigen::VectorXd> &x,
+                             const Eigen::Ref<const Eigen::VectorXd> &u,
+                             Eigen::Ref<Eigen::VectorXd> x_next)
+    {
+        x_next.noalias() = Ad_ * x;
+        x_next.noalias() += Bd_ * u;
+    }
+
+    const Eigen::MatrixXd &StateSpace::GetA() { return A_; }
+
+    const Eigen::MatrixXd &StateSpace::GetB() { return B_; }
+
+    const Eigen::MatrixXd &StateSpace::GetC() { return C_; }
+
+    const Eigen::MatrixXd &StateSpace::GetD() { return D_; }
+
     int StateSpace::NumInputs() { return B_.cols(); }
     int StateSpace::NumOutputs() { return C_.rows(); }
     int StateSpace::NumStates() { return A_.rows(); }
@@ -54,5 +116,8 @@ namespace ControlUtils
         B_ = B;
         C_ = C;
         D_ = D;
+
+        // The discretization is out of date
+        discrete_dt_ = 0.0;
     }
 } // namespace ControlUtils
\ No newline at end of file
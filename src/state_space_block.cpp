@@ -1,4 +1,5 @@
 #include "controlblocks/state_space_block.h"
+#include "controlblocks/code_generator.h"
 #include "controlblocks/diagram.h"
 #include "controlblocks/python_utils.h"
 
@@ -31,31 +32,27 @@ namespace ControlBlock
         bool is_success = true;
 
         // A
-        if (!PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(A_mat_str_,
-                                                                &errors, &A_))
+        if (!diagram_.GetWorkspaceVariable(A_mat_str_, &errors, &A_))
         {
-            py::print(errors);
+            diagram_.PrintError(errors);
             is_success = false;
         }
         // B
-        if (!PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(B_mat_str_,
-                                                                &errors, &B_))
+        if (!diagram_.GetWorkspaceVariable(B_mat_str_, &errors, &B_))
         {
-            py::print(errors);
+            diagram_.PrintError(errors);
             is_success = false;
         }
         // C
-        if (!PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(C_mat_str_,
-                                                                &errors, &C_))
+        if (!diagram_.GetWorkspaceVariable(C_mat_str_, &errors, &C_))
         {
-            py::print(errors);
+            diagram_.PrintError(errors);
             is_success = false;
         }
         // D
-        if (!PythonUtils::GetWorkspaceVariable<Eigen::MatrixXd>(D_mat_str_,
-                                                                &errors, &D_))
+        if (!diagram_.GetWorkspaceVariable(D_mat_str_, &errors, &D_))
         {
-            py::print(errors);
+            diagram_.PrintError(errors);
             is_success = false;
         }
 
@@ -67,8 +64,19 @@ namespace ControlBlock
                                      "' missing inputs");
         }
 
-        // Output the initial condition to ensure feedback works
-        this->SetOutput(output_ids_[0], x_);
+        // Set up the system and start it from the initial state if it has
+        // one, or at rest
+        ss.SetABCD(A_, B_, C_, D_);
+        x_ = Eigen::VectorXd::Zero(A_.rows());
+        if (x0_.size() == A_.rows())
+        {
+            x_ = x0_;
+        }
+
+        // Output the initial condition to ensure feedback works. The output
+        // width is known now so blocks in a loop with this one can use it.
+        outputs_[0]->SetSize(C_.rows());
+        this->SetOutput(0, C_ * x_);
 
         return is_success;
     }
@@ -76,112 +84,216 @@ namespace ControlBlock
     void StateSpaceBlock::Compute(double t)
     {
         // Get the input, u
-        Eigen::VectorXd u = Block::GetInput(input_ids_[0]);
-        if (u.size() == 0)
+        const Eigen::VectorXd &u = Block::GetInput(0);
+
+        // Update the system and get the output using StateSpace. The state
+        // and derivative live in the diagram's state vector.
+        Eigen::Map<const Eigen::VectorXd> x = this->StateView();
+        if (!zoh_)
         {
-            u = Eigen::VectorXd::Zero(x_.size());
+            Eigen::Map<Eigen::VectorXd> dx = this->DerivativeView();
+            ss.UpdateDynamics(x, u, dx);
         }
-
-        // Update the system and get the output using StateSpace
-        dx_ = ss.UpdateDynamics(x_, u);
-        Eigen::VectorXd y = ss.GetOutput(x_, u);
+        ss.GetOutput(x, u, Block::GetOutputBuffer(0));
 
         // Send the output
-        Block::SetOutput(output_ids_[0], y);
         Block::Broadcast();
     }
 
-    void StateSpaceBlock::Render()
+    void StateSpaceBlock::ComputeOutput(double t)
     {
-        ImNodes::BeginNode(this->id_);
+        // Only called when D is zero, so the output is C x
+        Block::GetOutputBuffer(0).noalias() = C_ * this->StateView();
+        Block::Broadcast();
+    }
 
-        ImGui::Spacing();
+    bool StateSpaceBlock::ComputeLanes(double t)
+    {
+        // The discrete update isn't done per lane
+        if (zoh_)
+        {
+            return false;
+        }
 
-        // Ensure the node is just as wide as the title or the minimum width.
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
+        const Eigen::MatrixXd &U = Block::GetInputLanes(0);
+        ConstLanesView X = this->StateLanesView();
+        ss.UpdateDynamicsLanes(X, U, this->DerivativeLanesView());
+        ss.GetOutputLanes(X, U, Block::GetOutputLanes(0));
 
-        ImNodes::BeginNodeTitleBar();
+        Block::Broadcast();
+        return true;
+    }
 
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
+    bool StateSpaceBlock::ComputeOutputLanes(double t)
+    {
+        if (zoh_)
+        {
+            return false;
+        }
 
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
+        // Only called when D is zero, so the output is C x
+        Block::GetOutputLanes(0).noalias() = C_ * this->StateLanesView();
+        Block::Broadcast();
+        return true;
+    }
 
-        // Input
-        ImGui::BeginGroup();
-        ImNodes::BeginInputAttribute(input_ids_[0]);
-        ImGui::TextUnformatted("u");
-        ImNodes::EndInputAttribute();
-        ImGui::EndGroup();
+    bool StateSpaceBlock::GenerateCode(CodeGenerator &gen)
+    {
+        // Terms with all-zero matrices are left out
+        std::string x = gen.State();
+        std::string u = gen.Input(0);
+        std::string output = gen.Output(0) + " = ";
+        if (!C_.isZero(0.0))
+        {
+            output += gen.Parameter("C", C_) + " * " + x;
+        }
+        if (!D_.isZero(0.0))
+        {
+            output += (C_.isZero(0.0) ? "" : " + ") + gen.Parameter("D", D_) +
+                      " * " + u;
+        }
+        if (C_.isZero(0.0) && D_.isZero(0.0))
+        {
+            output += CodeGenerator::MatrixType(C_.rows(), 1) + "::Zero()";
+        }
 
-        ImGui::SameLine();
+        // In zero-order hold mode the states jump once per step with the
+        // discretized system, and otherwise they are integrated
+        if (zoh_)
+        {
+            ss.Discretize(gen.GetDt());
+            gen.Compute(output + ";");
+            gen.Update(x + " = (" + gen.Parameter("Ad", ss.GetDiscreteA()) +
+                       " * " + x + " + " +
+                       gen.Parameter("Bd", ss.GetDiscreteB()) + " * " + u +
+                       ").eval();");
+            return true;
+        }
 
-        // Output
-        ImGui::BeginGroup();
-        ImNodes::BeginOutputAttribute(output_ids_[0]);
-        const float label_width = ImGui::CalcTextSize("y").x;
-        ImGui::Indent(node_width - label_width);
-        ImGui::TextUnformatted("y");
-        ImNodes::EndOutputAttribute();
-        ImGui::EndGroup();
+        std::string derivative = gen.Derivative() + " = ";
+        if (!A_.isZero(0.0))
+        {
+            derivative += gen.Parameter("A", A_) + " * " + x;
+        }
+        if (!B_.isZero(0.0))
+        {
+            derivative += (A_.isZero(0.0) ? "" : " + ") +
+                          gen.Parameter("B", B_) + " * " + u;
+        }
+        if (A_.isZero(0.0) && B_.isZero(0.0))
+        {
+            derivative += CodeGenerator::MatrixType(A_.rows(), 1) + "::Zero()";
+        }
+        gen.Compute(derivative + ";");
+        gen.Compute(output + ";");
+        return true;
+    }
 
-        // Reset item width for the next block.
-        ImGui::PopItemWidth();
+    void StateSpaceBlock::InferSizes()
+    {
+        // An unconnected input reads zeros as wide as B expects
+        if (!inputs_[0]->ConnectedInput())
+        {
+            inputs_[0]->SetSize(B_.cols());
+        }
 
-        ImNodes::EndNode();
+        // Check the matrices against the input once, rather than on every
+        // evaluation.
+        try
+        {
+            ss.CheckDimensions(inputs_[0]->GetSize());
+        }
+        catch (std::runtime_error &e)
+        {
+            throw std::runtime_error("Error: block '" + name_ + "': " +
+                                     e.what());
+        }
+
+        outputs_[0]->SetSize(C_.rows());
     }
 
-    void StateSpaceBlock::Settings()
+    bool StateSpaceBlock::ComputeJacobian(int state_offset,
+                                          Eigen::Ref<Eigen::MatrixXd> dfdx)
     {
-        // If node is double clicked, show the settings
-        int hover_id = -1;
-        ImNodes::IsNodeHovered(&hover_id);
-        if ((hover_id == this->id_ && ImGui::IsMouseDoubleClicked(0)) ||
-            settings_open_)
+        // The input reaches the derivative through B and the output through
+        // D, while the block's own states enter through A and C.
+        const Eigen::MatrixXd &du = Block::GetInputJacobian(0);
+        Eigen::MatrixXd &dy = Block::GetOutputJacobian(0);
+        int num_states = A_.rows();
+
+        // In zero-order hold mode the output is held between samples, so it
+        // doesn't change with the continuous states.
+        if (zoh_)
         {
-            settings_open_ = true;
-            std::string setting_name = this->name_ + " settings";
-            bool is_open = true;
-            ImGui::Begin(setting_name.c_str(), &is_open);
-            if (settings_open_)
-            {
-                // Set the focus to the settings so the window isn't hidden.
-                ImGui::SetWindowFocus();
-                // Modify matrices
-                // A
-                char A_str[128];
-                strcpy(A_str, A_mat_str_.c_str());
-                ImGui::InputText("A:", A_str, IM_ARRAYSIZE(A_str));
-                A_mat_str_ = A_str;
+            dy.setZero();
+            return true;
+        }
 
-                // B
-                char B_str[128];
-                strcpy(B_str, B_mat_str_.c_str());
-                ImGui::InputText("B:", B_str, IM_ARRAYSIZE(B_str));
-                B_mat_str_ = B_str;
+        dfdx.noalias() = B_ * du;
+        dfdx.middleCols(state_offset, num_states) += A_;
 
-                // C
-                char C_str[128];
-                strcpy(C_str, C_mat_str_.c_str());
-                ImGui::InputText("C:", C_str, IM_ARRAYSIZE(C_str));
-                C_mat_str_ = C_str;
+        dy.noalias() = D_ * du;
+        dy.middleCols(state_offset, num_states) += C_;
+        return true;
+    }
 
-                // D
-                char D_str[128];
-                strcpy(D_str, D_mat_str_.c_str());
-                ImGui::InputText("D:", D_str, IM_ARRAYSIZE(D_str));
-                D_mat_str_ = D_str;
-            }
-            ImGui::End();
+    bool StateSpaceBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        // Zero-order hold systems are advanced between steps, not
+        // integrated with the rest
+        if (zoh_)
+        {
+            return false;
+        }
+
+        ss->SetABCD(A_, B_, C_, D_);
+        return true;
+    }
+
+    bool StateSpaceBlock::IsDiscrete() { return zoh_; }
 
-            settings_open_ = is_open;
+    bool StateSpaceBlock::HasDirectFeedthrough() { return !D_.isZero(0.0); }
+
+    void StateSpaceBlock::Update(double t, double dt)
+    {
+        // The exponential is only recomputed if dt changes. The input was
+        // computed at this sample and is held until the next.
+        ss.Discretize(dt);
+        x_next_.resize(x_.size());
+        ss.Advance(x_, Block::GetInput(0), x_next_);
+        x_.swap(x_next_);
+    }
+
+    std::vector<std::string> StateSpaceBlock::GetMatrixNames()
+    {
+        return {A_mat_str_, B_mat_str_, C_mat_str_, D_mat_str_};
+    }
+
+    std::vector<std::string> StateSpaceBlock::GetWorkspaceNames()
+    {
+        return this->GetMatrixNames();
+    }
+
+    void StateSpaceBlock::SetInitial(Eigen::VectorXd x0) { x0_ = x0; }
+
+    void StateSpaceBlock::SetMatrixNames(const std::vector<std::string> &names)
+    {
+        if (names.size() != 4)
+        {
+            throw std::invalid_argument(
+                "State space blocks need 4 matrix names (A, B, C, D)");
         }
+
+        A_mat_str_ = names[0];
+        B_mat_str_ = names[1];
+        C_mat_str_ = names[2];
+        D_mat_str_ = names[3];
     }
 
+    bool StateSpaceBlock::GetZeroOrderHold() { return zoh_; }
+
+    void StateSpaceBlock::SetZeroOrderHold(bool zoh) { zoh_ = zoh; }
+
     toml::table StateSpaceBlock::Serialize()
     {
         std::cout << "- Serializing StateSpaceBlock: " << this->name_
@@ -202,31 +314,39 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{{"type", "StateSpaceBlock"},
                                       {"name", this->name_},
                                       {"id", this->id_},
                                       {"inputs", input_arr},
                                       {"outputs", output_arr},
-                                      {"x_pos", pos.x},
-                                      {"y_pos", pos.y},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
+                                      {"dynamic_sys", dynamic_sys_},
                                       {"A", A_mat_str_},
                                       {"B", B_mat_str_},
                                       {"C", C_mat_str_},
-                                      {"D", D_mat_str_}};
+                                      {"D", D_mat_str_},
+                                      {"zoh", zoh_},
+                                      {"sample_time", sample_time_.period},
+                                      {"sample_offset", sample_time_.offset}};
 
         return tbl;
     }
 
     void StateSpaceBlock::Deserialize(toml::table tbl)
     {
-        // Get the matrices
-        // TODO
+        // Get the matrix names
+        A_mat_str_ = tbl["A"].value_or("");
+        B_mat_str_ = tbl["B"].value_or("");
+        C_mat_str_ = tbl["C"].value_or("");
+        D_mat_str_ = tbl["D"].value_or("");
+        zoh_ = tbl["zoh"].value_or(false);
 
         // Deserialize the general components.
         Block::Deserialize(tbl);
+
+        // State space blocks are always dynamical systems
+        dynamic_sys_ = true;
     }
 
 } // namespace ControlBlock
@@ -1,4 +1,5 @@
 #include "controlblocks/sum_block.h"
+#include "controlblocks/code_generator.h"
 
 namespace ControlBlock
 {
@@ -21,74 +22,93 @@ namespace ControlBlock
 
     void SumBlock::Compute(double t)
     {
-        // Get the input
-        Eigen::VectorXd val1 = Block::GetInput(input_ids_[0]);
-        Eigen::VectorXd val2 = Block::GetInput(input_ids_[1]);
-
-        // Ensure the vectors are the same size.
-        // If the vectors aren't the same size, fill the smaller one in with
-        // zeros.
-        if (val1.size() != val2.size())
-        {
-            // Ensure val1 is the smaller vector.
-            if (val1.size() > val2.size())
-            {
-                std::swap(val1, val2);
-            }
-
-            // Add zeros to val1.
-            size_t diff = val2.size() - val1.size();
-            Eigen::VectorXd val1_tmp(val2.size());
-            val1_tmp << val1, Eigen::VectorXd::Zero(diff);
-            val1 = val1_tmp;
-        }
+        // Get the input. If the vectors aren't the same size, the smaller one
+        // is treated as if it were filled in with zeros.
+        const Eigen::VectorXd &larger = Block::GetInput(larger_input_);
+        const Eigen::VectorXd &smaller = Block::GetInput(1 - larger_input_);
 
-        // Sum
-        Eigen::VectorXd output = val1 + val2;
+        // Sum into the output buffer
+        Eigen::VectorXd &output = Block::GetOutputBuffer(0);
+        output = larger;
+        output.head(smaller.size()) += smaller;
 
         // Send the output
-        Block::SetOutput(output_ids_[0], output);
         Block::Broadcast();
     }
 
-    void SumBlock::Render()
+    bool SumBlock::IsFoldable() { return true; }
+
+    bool SumBlock::ComputeLanes(double t)
+    {
+        const Eigen::MatrixXd &larger = Block::GetInputLanes(larger_input_);
+        const Eigen::MatrixXd &smaller =
+            Block::GetInputLanes(1 - larger_input_);
+
+        Eigen::MatrixXd &output = Block::GetOutputLanes(0);
+        output = larger;
+        output.topRows(smaller.rows()) += smaller;
+
+        Block::Broadcast();
+        return true;
+    }
+
+    bool SumBlock::GenerateCode(CodeGenerator &gen)
     {
-        ImNodes::BeginNode(this->id_);
-
-        float node_width =
-            std::max(min_node_width_, ImGui::CalcTextSize(name_.c_str()).x);
-        ImGui::PushItemWidth(node_width);
-
-        // Allow the block name to be changed
-        ImNodes::BeginNodeTitleBar();
-        char name_str[128];
-        strcpy(name_str, this->name_.c_str());
-        ImGui::InputText("", name_str, IM_ARRAYSIZE(name_str));
-        this->name_ = name_str;
-        ImNodes::EndNodeTitleBar();
-
-        // Input group
-        ImGui::BeginGroup();
-        for (size_t i = 0; i < inputs_.size(); ++i)
+        int larger = larger_input_;
+        int smaller = 1 - larger_input_;
+        if (gen.InputSize(smaller) == gen.InputSize(larger))
         {
-            ImNodes::BeginInputAttribute(input_ids_[i]);
-            ImGui::TextUnformatted("+");
-            ImNodes::EndInputAttribute();
+            gen.Compute(gen.Output(0) + " = " + gen.Input(0) + " + " +
+                        gen.Input(1) + ";");
+            return true;
         }
-        ImGui::EndGroup();
 
-        ImGui::SameLine();
+        // Same zero-padding as Compute()
+        gen.Compute(gen.Output(0) + " = " + gen.Input(larger) + ";");
+        gen.Compute(gen.Output(0) + ".head<" +
+                    std::to_string(gen.InputSize(smaller)) + ">() += " +
+                    gen.Input(smaller) + ";");
+        return true;
+    }
+
+    void SumBlock::InferSizes()
+    {
+        // The smaller input is zero-padded, so the output is as wide as the
+        // larger input.
+        int size1 = inputs_[0]->GetSize();
+        int size2 = inputs_[1]->GetSize();
+        larger_input_ = (size1 >= size2) ? 0 : 1;
+        outputs_[0]->SetSize(std::max(size1, size2));
+    }
 
-        // Output group
-        ImGui::BeginGroup();
-        ImNodes::BeginOutputAttribute(output_ids_[0]);
-        const float label_width = ImGui::CalcTextSize("Sum").x;
-        ImGui::Indent(node_width - label_width);
-        ImGui::TextUnformatted("Sum");
-        ImNodes::EndOutputAttribute();
-        ImGui::EndGroup();
+    bool SumBlock::ComputeJacobian(int state_offset,
+                                   Eigen::Ref<Eigen::MatrixXd> dfdx)
+    {
+        // Same zero-padding as Compute(), applied to the rows
+        const Eigen::MatrixXd &larger = Block::GetInputJacobian(larger_input_);
+        const Eigen::MatrixXd &smaller =
+            Block::GetInputJacobian(1 - larger_input_);
+
+        Eigen::MatrixXd &output = Block::GetOutputJacobian(0);
+        output = larger;
+        output.topRows(smaller.rows()) += smaller;
+        return true;
+    }
 
-        ImNodes::EndNode();
+    bool SumBlock::GetLinearSystem(ControlUtils::StateSpace *ss)
+    {
+        // Same zero-padding as Compute(), so each input adds to the top rows
+        int size1 = inputs_[0]->GetSize();
+        int size2 = inputs_[1]->GetSize();
+        int n = outputs_[0]->GetSize();
+        Eigen::MatrixXd D = Eigen::MatrixXd::Zero(n, size1 + size2);
+        D.block(0, 0, size1, size1).setIdentity();
+        D.block(0, size1, size2, size2).setIdentity();
+
+        ss->SetABCD(Eigen::MatrixXd::Zero(0, 0),
+                    Eigen::MatrixXd::Zero(0, size1 + size2),
+                    Eigen::MatrixXd::Zero(n, 0), D);
+        return true;
     }
 
     toml::table SumBlock::Serialize()
@@ -110,13 +130,10 @@ namespace ControlBlock
             output_arr.push_back(port_tbl);
         }
 
-        // Block position
-        ImVec2 pos = ImNodes::GetNodeGridSpacePos(this->id_);
-
         toml::table tbl = toml::table{
             {"type", "SumBlock"},  {"name", this->name_},   {"id", this->id_},
-            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", pos.x},
-            {"y_pos", pos.y}};
+            {"inputs", input_arr}, {"outputs", output_arr}, {"x_pos", x_pos_},
+            {"y_pos", y_pos_}};
 
         return tbl;
     }
@@ -0,0 +1,108 @@
+#include "controlblocks/thread_pool.h"
+
+namespace ControlUtils
+{
+    ThreadPool::ThreadPool(size_t num_threads)
+        : task_(nullptr), end_(0), next_(0), generation_(0), busy_(0),
+          quit_(false)
+    {
+        for (size_t i = 1; i < num_threads; ++i)
+        {
+            workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        work_cv_.notify_all();
+        for (std::thread &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::NumThreads() const { return workers_.size() + 1; }
+
+    void ThreadPool::ParallelFor(size_t begin, size_t end,
+                                 const std::function<void(size_t)> &task)
+    {
+        if (begin >= end)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            end_ = end;
+            next_.store(begin);
+            error_ = nullptr;
+            busy_ = workers_.size();
+            generation_++;
+        }
+        work_cv_.notify_all();
+
+        // Take a share of the work rather than waiting idle
+        this->RunTasks();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return busy_ == 0; });
+        task_ = nullptr;
+        if (error_)
+        {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        uint64_t finished = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [this, finished]
+                              { return quit_ || generation_ != finished; });
+                if (quit_)
+                {
+                    return;
+                }
+                finished = generation_;
+            }
+
+            this->RunTasks();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0)
+            {
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::RunTasks()
+    {
+        // Each thread claims the next unclaimed index until none are left
+        for (size_t i = next_.fetch_add(1); i < end_; i = next_.fetch_add(1))
+        {
+            try
+            {
+                (*task_)(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+    }
+} // namespace ControlUtils
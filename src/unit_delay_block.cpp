@@ -0,0 +1,135 @@
+#include "controlblocks/unit_delay_block.h"
+#include "controlblocks/code_generator.h"
+
+namespace ControlBlock
+{
+
+    void UnitDelayBlock::Init(std::string block_name)
+    {
+        std::vector<std::string> input_names = {"u"};
+        std::vector<std::string> output_names = {"y"};
+
+        // The held value is a discrete state
+        Block::Init(block_name, input_names, output_names,
+                    std::vector<bool>(), true);
+    }
+
+    bool UnitDelayBlock::ApplyInitial()
+    {
+        // Output the initial value so blocks in a loop with this one can
+        // start from it
+        x_ = x0_;
+        outputs_[0]->SetSize(x_.size());
+        this->SetOutput(0, x_);
+        return true;
+    }
+
+    void UnitDelayBlock::SetInitial(Eigen::VectorXd x0) { x0_ = x0; }
+
+    const Eigen::VectorXd &UnitDelayBlock::GetInitial() { return x0_; }
+
+    void UnitDelayBlock::Compute(double t)
+    {
+        // The input is only read when the held value is updated
+        this->ComputeOutput(t);
+    }
+
+    void UnitDelayBlock::ComputeOutput(double t)
+    {
+        Block::GetOutputBuffer(0) = x_;
+        Block::Broadcast();
+    }
+
+    void UnitDelayBlock::InferSizes()
+    {
+        // The output was sized from the initial value before the blocks
+        // reading it, so the input has to match it
+        if (inputs_[0]->GetSize() != x_.size())
+        {
+            throw std::runtime_error(
+                "Error: block '" + name_ + "': the input has " +
+                std::to_string(inputs_[0]->GetSize()) +
+                " elements but the initial value has " +
+                std::to_string(x_.size()) +
+                ". Set an initial value as wide as the input.");
+        }
+    }
+
+    bool UnitDelayBlock::IsDiscrete() { return true; }
+
+    bool UnitDelayBlock::HasDirectFeedthrough() { return false; }
+
+    void UnitDelayBlock::Update(double t, double dt)
+    {
+        x_ = Block::GetInput(0);
+    }
+
+    bool UnitDelayBlock::GenerateCode(CodeGenerator &gen)
+    {
+        gen.Compute(gen.Output(0) + " = " + gen.State() + ";");
+        gen.Update(gen.State() + " = " + gen.Input(0) + ";");
+        return true;
+    }
+
+    toml::table UnitDelayBlock::Serialize()
+    {
+        std::cout << "- Serializing UnitDelayBlock: " << this->name_
+                  << std::endl;
+
+        // Get the port serialization for each port
+        toml::array input_arr, output_arr;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            toml::table port_tbl = inputs_[i]->Serialize();
+            input_arr.push_back(port_tbl);
+        }
+
+        // Outputs
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            toml::table port_tbl = outputs_[i]->Serialize();
+            output_arr.push_back(port_tbl);
+        }
+
+        toml::array x0_arr;
+        for (int i = 0; i < x0_.size(); ++i)
+        {
+            x0_arr.push_back(x0_(i));
+        }
+
+        toml::table tbl = toml::table{{"type", "UnitDelayBlock"},
+                                      {"name", this->name_},
+                                      {"id", this->id_},
+                                      {"inputs", input_arr},
+                                      {"outputs", output_arr},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
+                                      {"dynamic_sys", dynamic_sys_},
+                                      {"x0", x0_arr},
+                                      {"sample_time", sample_time_.period},
+                                      {"sample_offset", sample_time_.offset}};
+
+        return tbl;
+    }
+
+    void UnitDelayBlock::Deserialize(toml::table tbl)
+    {
+        // Get the initial output
+        toml::array *x0_arr = tbl["x0"].as_array();
+        if (x0_arr != nullptr && !x0_arr->empty())
+        {
+            x0_.resize(x0_arr->size());
+            for (size_t i = 0; i < x0_arr->size(); ++i)
+            {
+                x0_(i) = x0_arr->at(i).value_or(0.0);
+            }
+        }
+
+        // Deserialize the general components.
+        Block::Deserialize(tbl);
+
+        // Unit delays are always dynamical systems
+        dynamic_sys_ = true;
+    }
+
+} // namespace ControlBlock
@@ -0,0 +1,74 @@
+#include "controlblocks/zero_order_hold_block.h"
+#include "controlblocks/code_generator.h"
+
+namespace ControlBlock
+{
+
+    void ZeroOrderHoldBlock::Init(std::string block_name)
+    {
+        std::vector<std::string> input_names = {"u"};
+        std::vector<std::string> output_names = {"y"};
+
+        Block::Init(block_name, input_names, output_names);
+    }
+
+    void ZeroOrderHoldBlock::Compute(double t)
+    {
+        // Only computed at samples, so the output holds in between
+        Block::GetOutputBuffer(0) = Block::GetInput(0);
+        Block::Broadcast();
+    }
+
+    void ZeroOrderHoldBlock::InferSizes()
+    {
+        outputs_[0]->SetSize(inputs_[0]->GetSize());
+    }
+
+    bool ZeroOrderHoldBlock::IsDiscrete() { return true; }
+
+    bool ZeroOrderHoldBlock::GenerateCode(CodeGenerator &gen)
+    {
+        gen.Compute(gen.Output(0) + " = " + gen.Input(0) + ";");
+        return true;
+    }
+
+    toml::table ZeroOrderHoldBlock::Serialize()
+    {
+        std::cout << "- Serializing ZeroOrderHoldBlock: " << this->name_
+                  << std::endl;
+
+        // Get the port serialization for each port
+        toml::array input_arr, output_arr;
+        for (int i = 0; i < inputs_.size(); ++i)
+        {
+            toml::table port_tbl = inputs_[i]->Serialize();
+            input_arr.push_back(port_tbl);
+        }
+
+        // Outputs
+        for (int i = 0; i < outputs_.size(); ++i)
+        {
+            toml::table port_tbl = outputs_[i]->Serialize();
+            output_arr.push_back(port_tbl);
+        }
+
+        toml::table tbl = toml::table{{"type", "ZeroOrderHoldBlock"},
+                                      {"name", this->name_},
+                                      {"id", this->id_},
+                                      {"inputs", input_arr},
+                                      {"outputs", output_arr},
+                                      {"x_pos", x_pos_},
+                                      {"y_pos", y_pos_},
+                                      {"sample_time", sample_time_.period},
+                                      {"sample_offset", sample_time_.offset}};
+
+        return tbl;
+    }
+
+    void ZeroOrderHoldBlock::Deserialize(toml::table tbl)
+    {
+        // Deserialize the general components, including the sample time
+        Block::Deserialize(tbl);
+    }
+
+} // namespace ControlBlock
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pybind11/eigen.h>
+#include <pybind11/embed.h>
+
+#include "controlblocks/diagram.h"
+#include "controlblocks/gui_data.h"
+
+namespace py = pybind11;
+
+// Largest difference allowed between a dense solver and RK4
+static const double kTolerance = 1e-5;
+
+// A damped second order plant with one input and one output
+static void DefineWorkspace()
+{
+    Eigen::MatrixXd A(2, 2);
+    A << 0.0, 1.0, -4.0, -0.8;
+    Eigen::MatrixXd B(2, 1);
+    B << 0.0, 1.0;
+    Eigen::MatrixXd C(1, 2);
+    C << 4.0, 0.0;
+    Eigen::MatrixXd D = Eigen::MatrixXd::Zero(1, 1);
+
+    py::dict global_vars = py::globals();
+    global_vars["plant_A"] = A;
+    global_vars["plant_B"] = B;
+    global_vars["plant_C"] = C;
+    global_vars["plant_D"] = D;
+}
+
+// Connect an output port of one block to an input port of another
+static void Connect(Diagram &diagram,
+                    std::shared_ptr<ControlBlock::Block> from, int output,
+                    std::shared_ptr<ControlBlock::Block> to, int input)
+{
+    diagram.AddWire(from->GetOutputPortId(output), to->GetInputPortId(input));
+}
+
+/**
+ * @brief Build a continuous plant under a controller sampled every 0.05 s,
+ * with its output displayed directly and sampled every 0.02 s. Both rates
+ * are faster than the 0.1 s step, so the base rate is 0.01 s.
+ *
+ * @return The displays of the continuous and the sampled plant output
+ */
+static std::vector<std::shared_ptr<ControlBlock::DisplayBlock>>
+BuildDiagram(Diagram &diagram)
+{
+    std::shared_ptr<ControlBlock::ConstantBlock> reference =
+        diagram.AddBlock<ControlBlock::ConstantBlock>();
+    reference->SetValue(1.0);
+    std::shared_ptr<ControlBlock::SumBlock> error =
+        diagram.AddBlock<ControlBlock::SumBlock>();
+    std::shared_ptr<ControlBlock::ZeroOrderHoldBlock> controller_hold =
+        diagram.AddBlock<ControlBlock::ZeroOrderHoldBlock>();
+    controller_hold->SetSampleTime(0.05, 0.0);
+    std::shared_ptr<ControlBlock::GainBlock> controller =
+        diagram.AddBlock<ControlBlock::GainBlock>();
+    controller->SetGain(2.0);
+    std::shared_ptr<ControlBlock::StateSpaceBlock> plant =
+        diagram.AddBlock<ControlBlock::StateSpaceBlock>();
+    plant->SetMatrixNames({"plant_A", "plant_B", "plant_C", "plant_D"});
+    std::shared_ptr<ControlBlock::GainBlock> feedback =
+        diagram.AddBlock<ControlBlock::GainBlock>();
+    feedback->SetGain(-1.0);
+    std::shared_ptr<ControlBlock::ZeroOrderHoldBlock> output_hold =
+        diagram.AddBlock<ControlBlock::ZeroOrderHoldBlock>();
+    output_hold->SetSampleTime(0.02, 0.0);
+    std::shared_ptr<ControlBlock::DisplayBlock> continuous =
+        diagram.AddBlock<ControlBlock::DisplayBlock>();
+    std::shared_ptr<ControlBlock::DisplayBlock> sampled =
+        diagram.AddBlock<ControlBlock::DisplayBlock>();
+
+    Connect(diagram, reference, 0, error, 0);
+    Connect(diagram, feedback, 0, error, 1);
+    Connect(diagram, error, 0, controller_hold, 0);
+    Connect(diagram, controller_hold, 0, controller, 0);
+    Connect(diagram, controller, 0, plant, 0);
+    Connect(diagram, plant, 0, feedback, 0);
+    Connect(diagram, plant, 0, continuous, 0);
+    Connect(diagram, plant, 0, output_hold, 0);
+    Connect(diagram, output_hold, 0, sampled, 0);
+
+    return {continuous, sampled};
+}
+
+// Run the diagram with a solver and record both displays after every step
+static std::vector<double> Run(const std::string &solver)
+{
+    Diagram diagram;
+    std::vector<std::shared_ptr<ControlBlock::DisplayBlock>> displays =
+        BuildDiagram(diagram);
+
+    GuiData gui_data;
+    gui_data.solver = solver;
+    gui_data.dt = 0.1;
+    gui_data.sim_time = 5.0;
+    gui_data.abs_tol = 1e-10;
+    gui_data.rel_tol = 1e-10;
+
+    std::vector<double> samples;
+    diagram.Start(gui_data);
+    while (diagram.IsRunning())
+    {
+        diagram.Step(gui_data);
+        for (std::shared_ptr<ControlBlock::DisplayBlock> display : displays)
+        {
+            const Eigen::VectorXd &val = display->GetValue();
+            samples.insert(samples.end(), val.data(), val.data() + val.size());
+        }
+    }
+    return samples;
+}
+
+// The dense solvers step past the samples of the discrete blocks, so they
+// have to start again from each sample to see the new held outputs. Check
+// that they follow the same trajectory as fixed-step RK4.
+int main()
+{
+    py::scoped_interpreter guard{};
+    DefineWorkspace();
+
+    std::vector<double> expected = Run("RK4");
+    if (expected.empty())
+    {
+        std::cerr << "RK4 didn't run\n";
+        return 1;
+    }
+
+    int num_failed = 0;
+    for (const std::string solver :
+         {"dopri5 (adaptive)", "Rosenbrock4 (stiff)"})
+    {
+        std::vector<double> samples = Run(solver);
+        double max_error = 0.0;
+        if (samples.size() != expected.size())
+        {
+            max_error = INFINITY;
+        }
+        for (size_t i = 0; i < samples.size() && i < expected.size(); ++i)
+        {
+            max_error =
+                std::max(max_error, std::abs(samples[i] - expected[i]));
+        }
+
+        bool is_success = (max_error <= kTolerance);
+        std::cerr << solver << ": max difference from RK4 " << max_error
+                  << (is_success ? "" : " (FAILED)") << "\n";
+        num_failed += is_success ? 0 : 1;
+    }
+
+    return (num_failed == 0) ? 0 : 1;
+}